@@ -0,0 +1,89 @@
+#include "bench.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> allocation_count(0);
+
+void* allocate(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* allocate_aligned(size_t size, std::align_val_t align) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    size_t a = static_cast<size_t>(align);
+    // aligned_alloc needs a nonzero size that is a multiple of the alignment.
+    size_t rounded = size ? (size + a - 1) / a * a : a;
+    if (void* p = std::aligned_alloc(a, rounded)) return p;
+    throw std::bad_alloc();
+}
+
+}
+
+/* Counting replacements for the global allocation functions ******************/
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void* operator new(size_t size, std::align_val_t align) { return allocate_aligned(size, align); }
+void* operator new[](size_t size, std::align_val_t align) { return allocate_aligned(size, align); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+namespace bench {
+
+uint64_t allocations() {
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+Meter::Meter(benchmark::State& state, double ops) : state_(state), ops_(ops), start_(allocations()) {}
+
+void Meter::pause() {
+    state_.PauseTiming();
+    paused_ = allocations();
+}
+
+void Meter::resume() {
+    excluded_ += allocations() - paused_;
+    state_.ResumeTiming();
+}
+
+Meter::~Meter() {
+    using benchmark::Counter;
+    double iterations = static_cast<double>(state_.iterations());
+    uint64_t allocs = allocations() - start_ - excluded_;
+    // An inverted rate of ops per iteration is seconds per op; the console
+    // prints it with an SI prefix and the JSON report holds seconds.
+    state_.counters["time/op"] = Counter(ops_, Counter::kIsIterationInvariantRate | Counter::kInvert);
+    state_.counters["allocs/op"] = Counter(iterations > 0 ? allocs / (iterations * ops_) : 0);
+    if (flops_ > 0) state_.counters["GFLOP"] = Counter(flops_ * 1e-9, Counter::kIsIterationInvariantRate);
+    if (bytes_ > 0) state_.counters["GB"] = Counter(bytes_ * 1e-9, Counter::kIsIterationInvariantRate);
+}
+
+}
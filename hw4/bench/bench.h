@@ -0,0 +1,55 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <cstdint>
+#include "benchmark/benchmark.h"
+
+namespace bench {
+
+// Calls to any form of the global operator new made by this process so far.
+// The bench binary replaces operator new (see bench.cc) to count them.
+uint64_t allocations();
+
+// Reports the per-operation counters of one benchmark, where each iteration
+// of the benchmark loop performs ops operations:
+//
+//     time/op     wall time per operation
+//     allocs/op   heap allocations per operation
+//     GFLOP       floating-point rate in GFLOP/s, when flops() was given
+//     GB          memory traffic in GB/s, when bytes() was given
+//
+// Construct it before the loop; it sets the counters when it goes out of
+// scope. Setup done between pause() and resume() is excluded from the time
+// and from the allocation count.
+//
+// Google Benchmark divides the rate counters by CPU time unless the
+// benchmark is registered with UseRealTime(), and the CPU time of the
+// benchmark thread leaves out work done on the thread pool, so every
+// benchmark that uses a Meter must be registered with UseRealTime().
+class Meter {
+public:
+    Meter(benchmark::State& state, double ops);
+    ~Meter();
+    Meter(const Meter&) = delete;
+    Meter& operator=(const Meter&) = delete;
+
+    // Floating-point operations and bytes moved per iteration.
+    void flops(double per_iteration) { flops_ = per_iteration; }
+    void bytes(double per_iteration) { bytes_ = per_iteration; }
+
+    void pause();
+    void resume();
+
+private:
+    benchmark::State& state_;
+    double ops_;
+    double flops_ = 0;
+    double bytes_ = 0;
+    uint64_t start_;
+    uint64_t paused_ = 0;
+    uint64_t excluded_ = 0;
+};
+
+}
+
+#endif
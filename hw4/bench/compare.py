@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""Compares two Google Benchmark JSON reports.
+
+    compare.py baseline.json current.json [--threshold 0.10]
+
+Prints every benchmark present in both files with its baseline and current
+ns/op (from the time/op counter, or the time per iteration when a benchmark
+has none) and allocs/op. Exits with status 1 if any benchmark got slower by
+more than the threshold, or allocates more per op than it did, so it can
+gate a change. With --benchmark_repetitions the median aggregate is
+compared.
+
+Benchmarks are matched by name. Since they switched to real time their
+names end in /real_time, so baselines recorded before then match nothing
+and have to be recorded again.
+"""
+
+import argparse
+import json
+import sys
+
+TIME_UNITS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def load(path):
+    with open(path) as f:
+        report = json.load(f)
+    runs = {}
+    for b in report["benchmarks"]:
+        if b.get("run_type") == "aggregate":
+            if b.get("aggregate_name") != "median":
+                continue
+            name = b["run_name"]
+        elif "run_name" in b and b.get("repetitions", 1) > 1:
+            continue
+        else:
+            name = b["name"]
+        if "time/op" in b:
+            ns = b["time/op"] * 1e9
+        else:
+            ns = b["real_time"] * TIME_UNITS[b.get("time_unit", "ns")]
+        runs[name] = (ns, b.get("allocs/op"))
+    return runs
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="relative slowdown that counts as a regression")
+    args = parser.parse_args()
+
+    old = load(args.baseline)
+    new = load(args.current)
+    regressions = 0
+    print("%-40s %12s %12s %8s %10s %10s" % ("benchmark", "base ns/op", "ns/op", "change", "base alloc", "alloc"))
+    for name in sorted(old.keys() & new.keys()):
+        (t0, a0), (t1, a1) = old[name], new[name]
+        change = t1 / t0 - 1 if t0 > 0 else 0.0
+        slower = change > args.threshold
+        more_allocs = a0 is not None and a1 is not None and a1 > a0 + 1e-9
+        flag = "  REGRESSION" if slower or more_allocs else ""
+        regressions += bool(flag)
+        print("%-40s %12.3f %12.3f %+7.1f%% %10s %10s%s" % (
+            name, t0, t1, 100 * change,
+            "-" if a0 is None else "%.3g" % a0, "-" if a1 is None else "%.3g" % a1, flag))
+    for name in sorted(old.keys() - new.keys()):
+        print("%-40s missing from %s" % (name, args.current))
+    if regressions:
+        print("%d regression(s) above %.0f%%" % (regressions, 100 * args.threshold))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,105 @@
+#include <cmath>
+#include "bench.h"
+#include "matrix.h"
+#include "reduce.h"
+
+// Square n x n matrices of doubles, n from 8 to 8192. Every benchmark uses
+// real time, so its name ends in /real_time. Run a subset with
+// --benchmark_filter, e.g. --benchmark_filter='Multiply/(8|64|512)/'.
+
+namespace {
+
+Matrix filled(size_t n, double seed) {
+    Matrix m(n, n);
+    for (size_t i = 0; i < n * n; i++) m.data()[i] = std::sin(seed + double(i));
+    return m;
+}
+
+void Sizes(benchmark::internal::Benchmark* b) {
+    b->RangeMultiplier(2)->Range(8, 8192)->Unit(benchmark::kMicrosecond)->UseRealTime();
+}
+
+// c = a * b through operator*, which allocates the result.
+void BM_Matrix_Multiply(benchmark::State& state) {
+    size_t n = state.range(0);
+    Matrix a = filled(n, 0), b = filled(n, 1), c;
+    bench::Meter meter(state, 1);
+    meter.flops(2.0 * n * n * n);
+    for (auto _ : state) {
+        c = a * b;
+        benchmark::DoNotOptimize(c.data());
+    }
+}
+BENCHMARK(BM_Matrix_Multiply)->Apply(Sizes);
+
+// The same product into a preallocated result.
+void BM_Matrix_GemmInto(benchmark::State& state) {
+    size_t n = state.range(0);
+    Matrix a = filled(n, 0), b = filled(n, 1), c(n, n);
+    bench::Meter meter(state, 1);
+    meter.flops(2.0 * n * n * n);
+    for (auto _ : state) {
+        gemm(1.0, a, b, 0.0, c);
+        benchmark::DoNotOptimize(c.data());
+    }
+}
+BENCHMARK(BM_Matrix_GemmInto)->Apply(Sizes);
+
+void BM_Matrix_Transpose(benchmark::State& state) {
+    size_t n = state.range(0);
+    Matrix a = filled(n, 0), t;
+    bench::Meter meter(state, 1);
+    meter.bytes(2.0 * n * n * sizeof(double));
+    for (auto _ : state) {
+        t = a.transpose();
+        benchmark::DoNotOptimize(t.data());
+    }
+}
+BENCHMARK(BM_Matrix_Transpose)->Apply(Sizes);
+
+void BM_Matrix_TransposeInPlace(benchmark::State& state) {
+    size_t n = state.range(0);
+    Matrix a = filled(n, 0);
+    bench::Meter meter(state, 1);
+    meter.bytes(2.0 * n * n * sizeof(double));
+    for (auto _ : state) {
+        a.transpose_in_place();
+        benchmark::DoNotOptimize(a.data());
+    }
+}
+BENCHMARK(BM_Matrix_TransposeInPlace)->Apply(Sizes);
+
+// A fused elementwise expression into an existing matrix.
+void BM_Matrix_Axpy(benchmark::State& state) {
+    size_t n = state.range(0);
+    Matrix a = filled(n, 0), b = filled(n, 1), c(n, n);
+    bench::Meter meter(state, 1);
+    meter.flops(2.0 * n * n);
+    meter.bytes(3.0 * n * n * sizeof(double));
+    for (auto _ : state) {
+        c = a * 2.0 + b;
+        benchmark::DoNotOptimize(c.data());
+    }
+}
+BENCHMARK(BM_Matrix_Axpy)->Apply(Sizes);
+
+void BM_Matrix_Norm(benchmark::State& state) {
+    size_t n = state.range(0);
+    Matrix a = filled(n, 0);
+    bench::Meter meter(state, 1);
+    meter.flops(2.0 * n * n);
+    meter.bytes(double(n) * n * sizeof(double));
+    for (auto _ : state) benchmark::DoNotOptimize(a.norm());
+}
+BENCHMARK(BM_Matrix_Norm)->Apply(Sizes);
+
+void BM_Matrix_Equal(benchmark::State& state) {
+    size_t n = state.range(0);
+    Matrix a = filled(n, 0), b = a;
+    bench::Meter meter(state, 1);
+    meter.bytes(2.0 * n * n * sizeof(double));
+    for (auto _ : state) benchmark::DoNotOptimize(a == b);
+}
+BENCHMARK(BM_Matrix_Equal)->Apply(Sizes);
+
+}
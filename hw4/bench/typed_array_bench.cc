@@ -0,0 +1,293 @@
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+#include "bench.h"
+#include "concurrent_typed_array.h"
+#include "parallel_algorithms.h"
+#include "segmented_array.h"
+#include "typed_array.h"
+#include "typed_ring.h"
+
+// TypedArray<double> with n from 8 to 8192 elements. Each iteration builds or
+// walks a whole array, and time/op and allocs/op are per element operation.
+
+namespace {
+
+TypedArray<double> filled(int n) {
+    TypedArray<double> a;
+    for (int i = 0; i < n; i++) a.push(i);
+    return a;
+}
+
+void Sizes(benchmark::internal::Benchmark* b) {
+    b->RangeMultiplier(2)->Range(8, 8192)->UseRealTime();
+}
+
+void BM_TypedArray_Push(benchmark::State& state) {
+    int n = state.range(0);
+    bench::Meter meter(state, n);
+    meter.bytes(double(n) * sizeof(double));
+    for (auto _ : state) {
+        TypedArray<double> a;
+        for (int i = 0; i < n; i++) a.push(i);
+        benchmark::DoNotOptimize(a.get(0));
+    }
+}
+BENCHMARK(BM_TypedArray_Push)->Apply(Sizes);
+
+void BM_TypedArray_PushFront(benchmark::State& state) {
+    int n = state.range(0);
+    bench::Meter meter(state, n);
+    meter.bytes(double(n) * sizeof(double));
+    for (auto _ : state) {
+        TypedArray<double> a;
+        for (int i = 0; i < n; i++) a.push_front(i);
+        benchmark::DoNotOptimize(a.get(0));
+    }
+}
+BENCHMARK(BM_TypedArray_PushFront)->Apply(Sizes);
+
+void BM_TypedArray_Get(benchmark::State& state) {
+    int n = state.range(0);
+    TypedArray<double> a = filled(n);
+    bench::Meter meter(state, n);
+    meter.bytes(double(n) * sizeof(double));
+    for (auto _ : state) {
+        double s = 0;
+        for (int i = 0; i < n; i++) s += a.get(i);
+        benchmark::DoNotOptimize(s);
+    }
+}
+BENCHMARK(BM_TypedArray_Get)->Apply(Sizes);
+
+// One concat of two n-element arrays per iteration.
+void BM_TypedArray_Concat(benchmark::State& state) {
+    int n = state.range(0);
+    TypedArray<double> a = filled(n), b = filled(n);
+    bench::Meter meter(state, 1);
+    meter.bytes(4.0 * n * sizeof(double));
+    for (auto _ : state) {
+        TypedArray<double> c = a.concat(b);
+        benchmark::DoNotOptimize(c.get(0));
+    }
+}
+BENCHMARK(BM_TypedArray_Concat)->Apply(Sizes);
+
+// Pops every element off a copy of an n-element array; the copy is setup.
+void BM_TypedArray_Pop(benchmark::State& state) {
+    int n = state.range(0);
+    TypedArray<double> a = filled(n);
+    bench::Meter meter(state, n);
+    for (auto _ : state) {
+        meter.pause();
+        TypedArray<double> b = a;
+        meter.resume();
+        double s = 0;
+        for (int i = 0; i < n; i++) s += b.pop();
+        benchmark::DoNotOptimize(s);
+    }
+}
+BENCHMARK(BM_TypedArray_Pop)->Apply(Sizes);
+
+// n rows of three elements, as in a matrix-like TypedArray<TypedArray<T>>;
+// InlineCapacity 3 keeps every row inside the outer buffer.
+template <int InlineCapacity>
+void BM_TypedArray_Rows(benchmark::State& state) {
+    int n = state.range(0);
+    bench::Meter meter(state, n);
+    for (auto _ : state) {
+        TypedArray<TypedArray<double, InlineCapacity>> m;
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < 3; j++) m.get(i).set(j, j);
+        benchmark::DoNotOptimize(m.get(0).get(0));
+    }
+}
+BENCHMARK_TEMPLATE(BM_TypedArray_Rows, 0)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_TypedArray_Rows, 3)->Apply(Sizes);
+
+// A FIFO that holds n elements: each op pushes one and pops the oldest.
+template <typename Queue>
+void BM_Fifo(benchmark::State& state) {
+    int n = state.range(0);
+    Queue q;
+    for (int i = 0; i < n; i++) q.push(i);
+    bench::Meter meter(state, 1);
+    for (auto _ : state) {
+        q.push(q.pop_front());
+    }
+    benchmark::DoNotOptimize(q.get(0));
+}
+BENCHMARK_TEMPLATE(BM_Fifo, TypedArray<double>)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_Fifo, TypedRing<double>)->Apply(Sizes);
+
+// Per-tick scratch: n arrays of 16 doubles built and thrown away each
+// iteration, from the heap or from a monotonic arena released in one go.
+void BM_TypedArray_ScratchHeap(benchmark::State& state) {
+    int n = state.range(0);
+    bench::Meter meter(state, n);
+    for (auto _ : state) {
+        for (int i = 0; i < n; i++) {
+            TypedArray<double> a;
+            for (int j = 0; j < 16; j++) a.push(j);
+            benchmark::DoNotOptimize(a.get(0));
+        }
+    }
+}
+BENCHMARK(BM_TypedArray_ScratchHeap)->Apply(Sizes);
+
+void BM_TypedArray_ScratchArena(benchmark::State& state) {
+    int n = state.range(0);
+    std::vector<char> bytes(n * 256 * sizeof(double));
+    bench::Meter meter(state, n);
+    for (auto _ : state) {
+        std::pmr::monotonic_buffer_resource arena(bytes.data(), bytes.size());
+        for (int i = 0; i < n; i++) {
+            pmr::TypedArray<double> a(&arena);
+            for (int j = 0; j < 16; j++) a.push(j);
+            benchmark::DoNotOptimize(a.get(0));
+        }
+    }
+}
+BENCHMARK(BM_TypedArray_ScratchArena)->Apply(Sizes);
+
+// Growth at both ends without relocation, and indexed reads through the
+// block index.
+void BM_SegmentedArray_Push(benchmark::State& state) {
+    int n = state.range(0);
+    bench::Meter meter(state, n);
+    meter.bytes(double(n) * sizeof(double));
+    for (auto _ : state) {
+        SegmentedArray<double> a;
+        for (int i = 0; i < n; i++) a.push(i);
+        benchmark::DoNotOptimize(a.get(0));
+    }
+}
+BENCHMARK(BM_SegmentedArray_Push)->Apply(Sizes);
+
+void BM_SegmentedArray_PushFront(benchmark::State& state) {
+    int n = state.range(0);
+    bench::Meter meter(state, n);
+    meter.bytes(double(n) * sizeof(double));
+    for (auto _ : state) {
+        SegmentedArray<double> a;
+        for (int i = 0; i < n; i++) a.push_front(i);
+        benchmark::DoNotOptimize(a.get(0));
+    }
+}
+BENCHMARK(BM_SegmentedArray_PushFront)->Apply(Sizes);
+
+void BM_SegmentedArray_Get(benchmark::State& state) {
+    int n = state.range(0);
+    SegmentedArray<double> a;
+    for (int i = 0; i < n; i++) a.push(i);
+    bench::Meter meter(state, n);
+    meter.bytes(double(n) * sizeof(double));
+    for (auto _ : state) {
+        double s = 0;
+        for (int i = 0; i < n; i++) s += a.get(i);
+        benchmark::DoNotOptimize(s);
+    }
+}
+BENCHMARK(BM_SegmentedArray_Get)->Apply(Sizes);
+
+// The parallel algorithms over 2^16 to 2^22 doubles with one and four
+// threads. A sort iteration first restores the unsorted contents by
+// assignment, which reuses the buffer, so its time includes that copy.
+void Bulk(benchmark::internal::Benchmark* b) {
+    for (int n : {1 << 16, 1 << 19, 1 << 22}) {
+        for (int threads : {1, 4}) b->Args({n, threads});
+    }
+    b->UseRealTime();
+}
+
+TypedArray<double> shuffled(int n) {
+    TypedArray<double> a;
+    a.reserve(n);
+    unsigned seed = 1;
+    for (int i = 0; i < n; i++) {
+        seed = seed * 1103515245 + 12345;
+        a.push(seed >> 8);
+    }
+    return a;
+}
+
+void BM_TypedArray_ParallelSort(benchmark::State& state) {
+    int n = state.range(0);
+    parallel::ScopedNumThreads threads(state.range(1));
+    TypedArray<double> unsorted = shuffled(n), a = unsorted;
+    bench::Meter meter(state, n);
+    for (auto _ : state) {
+        a = unsorted;
+        parallel::parallel_sort(a.begin(), a.end());
+        benchmark::DoNotOptimize(a.data());
+    }
+}
+BENCHMARK(BM_TypedArray_ParallelSort)->Apply(Bulk);
+
+void BM_TypedArray_ParallelReduce(benchmark::State& state) {
+    int n = state.range(0);
+    parallel::ScopedNumThreads threads(state.range(1));
+    TypedArray<double> a = shuffled(n);
+    bench::Meter meter(state, n);
+    meter.bytes(double(n) * sizeof(double));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parallel::parallel_reduce(a.begin(), a.end(), 0.0));
+    }
+}
+BENCHMARK(BM_TypedArray_ParallelReduce)->Apply(Bulk);
+
+void BM_TypedArray_ParallelTransform(benchmark::State& state) {
+    int n = state.range(0);
+    parallel::ScopedNumThreads threads(state.range(1));
+    TypedArray<double> a = shuffled(n);
+    bench::Meter meter(state, n);
+    meter.bytes(2.0 * n * sizeof(double));
+    for (auto _ : state) {
+        parallel::parallel_transform(a.begin(), a.end(), a.begin(), [](double x) { return 0.5 * x + 1; });
+        benchmark::DoNotOptimize(a.data());
+    }
+}
+BENCHMARK(BM_TypedArray_ParallelTransform)->Apply(Bulk);
+
+// 2^20 doubles pushed by 1, 4 or 16 producers on the thread pool, into a
+// ConcurrentTypedArray or into a TypedArray behind a mutex.
+void Producers(benchmark::internal::Benchmark* b) {
+    for (int producers : {1, 4, 16}) b->Arg(producers);
+    b->UseRealTime();
+}
+
+void BM_ConcurrentTypedArray_Push(benchmark::State& state) {
+    const int n = 1 << 20;
+    size_t producers = state.range(0);
+    parallel::ScopedNumThreads threads(producers);
+    bench::Meter meter(state, n);
+    for (auto _ : state) {
+        ConcurrentTypedArray<double> a;
+        parallel::run(producers, [&](size_t p) {
+            for (int i = n * p / producers; i < int(n * (p + 1) / producers); i++) a.push(i);
+        });
+        benchmark::DoNotOptimize(a.size());
+    }
+}
+BENCHMARK(BM_ConcurrentTypedArray_Push)->Apply(Producers);
+
+void BM_TypedArray_LockedPush(benchmark::State& state) {
+    const int n = 1 << 20;
+    size_t producers = state.range(0);
+    parallel::ScopedNumThreads threads(producers);
+    bench::Meter meter(state, n);
+    for (auto _ : state) {
+        TypedArray<double> a;
+        std::mutex m;
+        parallel::run(producers, [&](size_t p) {
+            for (int i = n * p / producers; i < int(n * (p + 1) / producers); i++) {
+                std::lock_guard<std::mutex> lock(m);
+                a.push(i);
+            }
+        });
+        benchmark::DoNotOptimize(a.size());
+    }
+}
+BENCHMARK(BM_TypedArray_LockedPush)->Apply(Producers);
+
+}
@@ -0,0 +1,285 @@
+#ifndef CONCURRENT_TYPED_ARRAY
+#define CONCURRENT_TYPED_ARRAY
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+namespace concurrent_typed_array {
+
+// Segment k holds FIRST_SEGMENT << k elements. A 26th segment would not fit
+// its size in an int, so the array holds at most the MAX_SIZE elements of
+// the first 25, which is just under INT_MAX.
+constexpr int FIRST_SEGMENT = 64;
+constexpr int MAX_SEGMENTS = 25;
+constexpr int MAX_SIZE = FIRST_SEGMENT * ((1 << MAX_SEGMENTS) - 1);
+
+template <typename ElementType>
+struct Segment {
+    explicit Segment(int n) : elements(std::allocator<ElementType>().allocate(n)), ready(new std::atomic<bool>[n]()), size(n) {}
+    ~Segment() {
+        std::allocator<ElementType>().deallocate(elements, size);
+        delete[] ready;
+    }
+    Segment(const Segment&) = delete;
+    Segment& operator=(const Segment&) = delete;
+
+    ElementType* elements;
+    std::atomic<bool>* ready;   // set once the element is constructed
+    int size;
+};
+
+// Segment and offset in it of element index.
+inline std::pair<int, int> locate(int index) {
+    unsigned j = unsigned(index) / FIRST_SEGMENT + 1;
+    int k = 31 - __builtin_clz(j);
+    return {k, int(unsigned(index) - FIRST_SEGMENT * ((1u << k) - 1))};
+}
+
+}
+
+// Append-only array that any number of threads may push onto at once
+// while others read it, without locks. push claims the next index with one
+// atomic fetch-add, constructs the element in place and flags it ready;
+// append claims a whole range with one fetch-add and flags each element
+// once all of them are constructed. Elements live in segments that double
+// in size and are never moved or freed before the array is, so references
+// and iterators stay valid for its lifetime.
+//
+// Readers see the committed prefix: the elements before the first one not
+// yet flagged ready. Producers never touch it; size() extends it over the
+// ready flags past its end and stores the new length for the next caller,
+// so it only grows and each flag is scanned about once. The only line all
+// producers write is the claim counter, plus the flags and elements of
+// neighbouring indices.
+//
+// If constructing an element throws, the exception reaches the pushing
+// thread but the index stays claimed, so the committed prefix stops before
+// it for good; an append still flags the elements it constructed before the
+// one that threw. Only reads of the prefix, pushes and appends are safe to
+// run concurrently; destroying the array requires that they have all
+// returned.
+template <typename ElementType>
+class ConcurrentTypedArray {
+
+public:
+    class const_iterator;
+    typedef ElementType value_type;
+
+    ConcurrentTypedArray();
+    ConcurrentTypedArray(const ConcurrentTypedArray& other) = delete;
+    ConcurrentTypedArray& operator=(const ConcurrentTypedArray& other) = delete;
+    ~ConcurrentTypedArray();
+
+    void push(const ElementType& value);
+    void push(ElementType&& value);
+    template <typename... Args> ElementType& emplace(Args&&... args);
+    // Copies [first, last) to consecutive indices.
+    template <typename Iterator> void append(Iterator first, Iterator last);
+
+    int size() const;
+    const ElementType &safe_get(int index) const;
+    // Iterate over the committed prefix as of the call to end().
+    const_iterator begin() const;
+    const_iterator end() const;
+
+private:
+    typedef concurrent_typed_array::Segment<ElementType> Segment;
+
+    // Producers bump claimed and readers advance the prefix behind it;
+    // separate cache lines keep them from slowing each other down.
+    alignas(64) std::atomic<int> claimed;
+    alignas(64) mutable std::atomic<int> committed;
+    alignas(64) std::atomic<Segment*> segments[concurrent_typed_array::MAX_SEGMENTS];
+
+    int claim(int n);
+    Segment* segment(int k);
+    ElementType* at(int index) const;
+    void publish(int index, int n);
+};
+
+// Random-access iterator over a snapshot of the committed prefix.
+template <typename ElementType>
+class ConcurrentTypedArray<ElementType>::const_iterator {
+public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef ElementType value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const ElementType* pointer;
+    typedef const ElementType& reference;
+
+    const_iterator() : array(nullptr), index(0) {}
+
+    reference operator*() const { return *array->at(index); }
+    pointer operator->() const { return array->at(index); }
+    reference operator[](difference_type n) const { return *array->at(index + n); }
+
+    const_iterator& operator++() { index++; return *this; }
+    const_iterator operator++(int) { const_iterator r = *this; index++; return r; }
+    const_iterator& operator--() { index--; return *this; }
+    const_iterator operator--(int) { const_iterator r = *this; index--; return r; }
+    const_iterator& operator+=(difference_type n) { index += n; return *this; }
+    const_iterator& operator-=(difference_type n) { index -= n; return *this; }
+    const_iterator operator+(difference_type n) const { return const_iterator(array, index + n); }
+    const_iterator operator-(difference_type n) const { return const_iterator(array, index - n); }
+    friend const_iterator operator+(difference_type n, const const_iterator& it) { return it + n; }
+    difference_type operator-(const const_iterator& other) const { return index - other.index; }
+
+    bool operator==(const const_iterator& other) const { return index == other.index; }
+    bool operator!=(const const_iterator& other) const { return index != other.index; }
+    bool operator<(const const_iterator& other) const { return index < other.index; }
+    bool operator>(const const_iterator& other) const { return index > other.index; }
+    bool operator<=(const const_iterator& other) const { return index <= other.index; }
+    bool operator>=(const const_iterator& other) const { return index >= other.index; }
+
+private:
+    friend class ConcurrentTypedArray;
+    const_iterator(const ConcurrentTypedArray* array, int index) : array(array), index(index) {}
+
+    const ConcurrentTypedArray* array;
+    int index;
+};
+
+template <typename ElementType>
+ConcurrentTypedArray<ElementType>::ConcurrentTypedArray() : claimed(0), committed(0) {
+    for (std::atomic<Segment*>& s : segments) s.store(nullptr, std::memory_order_relaxed);
+}
+
+template <typename ElementType>
+ConcurrentTypedArray<ElementType>::~ConcurrentTypedArray() {
+    int n = claimed.load(std::memory_order_acquire);
+    for (int k = 0; k < concurrent_typed_array::MAX_SEGMENTS; k++) {
+        Segment* s = segments[k].load(std::memory_order_acquire);
+        if (s == nullptr) continue;
+        int first = concurrent_typed_array::FIRST_SEGMENT * ((1u << k) - 1);
+        for (int i = 0; i < s->size && first + i < n; i++) {
+            if (s->ready[i].load(std::memory_order_acquire)) std::destroy_at(s->elements + i);
+        }
+        delete s;
+    }
+}
+
+template <typename ElementType>
+void ConcurrentTypedArray<ElementType>::push(const ElementType& value) {
+    emplace(value);
+}
+
+template <typename ElementType>
+void ConcurrentTypedArray<ElementType>::push(ElementType&& value) {
+    emplace(std::move(value));
+}
+
+template <typename ElementType>
+template <typename... Args>
+ElementType& ConcurrentTypedArray<ElementType>::emplace(Args&&... args) {
+    int index = claim(1);
+    std::pair<int, int> p = concurrent_typed_array::locate(index);
+    ElementType* slot = segment(p.first)->elements + p.second;
+    ::new (static_cast<void*>(slot)) ElementType(std::forward<Args>(args)...);
+    publish(index, 1);
+    return *slot;
+}
+
+template <typename ElementType>
+template <typename Iterator>
+void ConcurrentTypedArray<ElementType>::append(Iterator first, Iterator last) {
+    int n = std::distance(first, last);
+    if (n <= 0) return;
+    int index = claim(n);
+    int i = index;
+    try {
+        for (; i < index + n; ++i, ++first) {
+            std::pair<int, int> p = concurrent_typed_array::locate(i);
+            ::new (static_cast<void*>(segment(p.first)->elements + p.second)) ElementType(*first);
+        }
+    } catch (...) {
+        publish(index, i - index);
+        throw;
+    }
+    publish(index, n);
+}
+
+// Extends the prefix over the elements flagged ready after it. Readers that
+// race to extend it keep the longest length any of them found.
+template <typename ElementType>
+int ConcurrentTypedArray<ElementType>::size() const {
+    int c = committed.load(std::memory_order_acquire);
+    int end = c, limit = std::min(claimed.load(std::memory_order_relaxed), concurrent_typed_array::MAX_SIZE);
+    while (end < limit) {
+        std::pair<int, int> p = concurrent_typed_array::locate(end);
+        Segment* s = segments[p.first].load(std::memory_order_acquire);
+        if (s == nullptr || !s->ready[p.second].load(std::memory_order_acquire)) break;
+        end++;
+    }
+    while (c < end && !committed.compare_exchange_weak(c, end, std::memory_order_acq_rel, std::memory_order_acquire)) {}
+    return std::max(c, end);
+}
+
+template <typename ElementType>
+const ElementType &ConcurrentTypedArray<ElementType>::safe_get(int index) const {
+    if (index < 0 || index >= size()) {
+        throw std::range_error("Out of range index in array");
+    }
+    return *at(index);
+}
+
+template <typename ElementType>
+typename ConcurrentTypedArray<ElementType>::const_iterator ConcurrentTypedArray<ElementType>::begin() const {
+    return const_iterator(this, 0);
+}
+
+template <typename ElementType>
+typename ConcurrentTypedArray<ElementType>::const_iterator ConcurrentTypedArray<ElementType>::end() const {
+    return const_iterator(this, size());
+}
+
+// Returns the first of n newly claimed indices. Throws std::range_error if
+// they would reach past MAX_SIZE.
+template <typename ElementType>
+int ConcurrentTypedArray<ElementType>::claim(int n) {
+    int index = claimed.fetch_add(n, std::memory_order_relaxed);
+    if (index < 0 || index > concurrent_typed_array::MAX_SIZE - n) {
+        throw std::range_error("Concurrent array is full");
+    }
+    return index;
+}
+
+// Segment k, allocated by the first thread to need it. Threads that race to
+// allocate it keep the one that was published first and free their own.
+template <typename ElementType>
+typename ConcurrentTypedArray<ElementType>::Segment* ConcurrentTypedArray<ElementType>::segment(int k) {
+    Segment* s = segments[k].load(std::memory_order_acquire);
+    if (s != nullptr) return s;
+    Segment* fresh = new Segment(concurrent_typed_array::FIRST_SEGMENT << k);
+    if (segments[k].compare_exchange_strong(s, fresh, std::memory_order_acq_rel, std::memory_order_acquire)) {
+        return fresh;
+    }
+    delete fresh;
+    return s;
+}
+
+// Only called for indices below size(), whose segment is published.
+template <typename ElementType>
+ElementType* ConcurrentTypedArray<ElementType>::at(int index) const {
+    std::pair<int, int> p = concurrent_typed_array::locate(index);
+    return segments[p.first].load(std::memory_order_acquire)->elements + p.second;
+}
+
+// Flags the n newly constructed elements from index on as ready. The
+// release stores make each element visible to the reader whose acquire load
+// of its flag extends the prefix over it, and through the prefix to every
+// later reader.
+template <typename ElementType>
+void ConcurrentTypedArray<ElementType>::publish(int index, int n) {
+    for (int i = index; i < index + n; i++) {
+        std::pair<int, int> p = concurrent_typed_array::locate(i);
+        segments[p.first].load(std::memory_order_relaxed)->ready[p.second].store(true, std::memory_order_release);
+    }
+}
+
+#endif
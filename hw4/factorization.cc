@@ -0,0 +1,371 @@
+#include "factorization.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "thread_pool.h"
+
+namespace {
+
+// Panel width of the blocked algorithms: the rank of each gemm update.
+const size_t BLOCK = 64;
+// Rows of a panel handed to one thread while the panel is factored.
+const size_t PANEL_GRAIN = Matrix::ELEMENTWISE_GRAIN / BLOCK;
+
+template <typename T>
+T* row_of(MatrixView<T> b, size_t r) {
+    return b.data() + r * b.row_stride();
+}
+
+// Solves L X = B in place, where L is lower triangular (with an implied unit
+// diagonal if unit) and B has unit column stride. Entries of L above the
+// diagonal are never read.
+template <typename T>
+void solve_lower(ConstMatrixView<T> l, MatrixView<T> b, bool unit) {
+    size_t n = l.rows(), m = b.cols();
+    for (size_t k0 = 0; k0 < n; k0 += BLOCK) {
+        size_t k1 = std::min(n, k0 + BLOCK);
+        for (size_t r = k0; r < k1; r++) {
+            T* br = row_of(b, r);
+            for (size_t s = k0; s < r; s++) {
+                T f = l(r, s);
+                const T* bs = row_of(b, s);
+                for (size_t j = 0; j < m; j++) br[j] -= f * bs[j];
+            }
+            if (!unit) {
+                T d = l(r, r);
+                if (d == T(0)) throw std::runtime_error("Singular matrix");
+                for (size_t j = 0; j < m; j++) br[j] /= d;
+            }
+        }
+        if (k1 < n) {
+            gemm<T>(T(-1), l.block(k1, k0, n - k1, k1 - k0), b.block(k0, 0, k1 - k0, m),
+                    T(1), b.block(k1, 0, n - k1, m));
+        }
+    }
+}
+
+// Solves U X = B in place for upper triangular U, working up from the last
+// block. Entries of U below the diagonal are never read.
+template <typename T>
+void solve_upper(ConstMatrixView<T> u, MatrixView<T> b) {
+    size_t n = u.rows(), m = b.cols();
+    for (size_t k1 = n; k1 > 0;) {
+        size_t k0 = k1 > BLOCK ? k1 - BLOCK : 0;
+        if (k1 < n) {
+            gemm<T>(T(-1), u.block(k0, k1, k1 - k0, n - k1), b.block(k1, 0, n - k1, m),
+                    T(1), b.block(k0, 0, k1 - k0, m));
+        }
+        for (size_t r = k1; r-- > k0;) {
+            T* br = row_of(b, r);
+            for (size_t s = r + 1; s < k1; s++) {
+                T f = u(r, s);
+                const T* bs = row_of(b, s);
+                for (size_t j = 0; j < m; j++) br[j] -= f * bs[j];
+            }
+            T d = u(r, r);
+            if (d == T(0)) throw std::runtime_error("Singular matrix");
+            for (size_t j = 0; j < m; j++) br[j] /= d;
+        }
+        k1 = k0;
+    }
+}
+
+template <typename T>
+void require_square(const TypedMatrix<T>& a) {
+    if (!a.isSquare()) throw std::invalid_argument("Matrix is not square");
+}
+
+// Builds the compact WY form of the reflectors stored in columns [k0, k1) of
+// a packed QR: H(k0) ... H(k1 - 1) = I - V T V^T, with V unit lower
+// trapezoidal (rows k0 and below) and T upper triangular.
+template <typename T>
+void block_reflector(const TypedMatrix<T>& qr, const std::vector<T>& tau, size_t k0, size_t k1,
+                     TypedMatrix<T>& v, TypedMatrix<T>& t) {
+    size_t m = qr.rows(), kb = k1 - k0;
+    v = TypedMatrix<T>(m - k0, kb);
+    for (size_t i = 0; i < m - k0; i++) {
+        for (size_t c = 0; c < kb && c <= i; c++) {
+            v(i, c) = i == c ? T(1) : qr(k0 + i, k0 + c);
+        }
+    }
+    t = TypedMatrix<T>(kb, kb);
+    std::vector<T> z(kb);
+    for (size_t j = 0; j < kb; j++) {
+        // T(0:j, j) = -tau_j T(0:j, 0:j) V(:, 0:j)^T v_j
+        std::fill(z.begin(), z.end(), T(0));
+        for (size_t i = j; i < m - k0; i++) {
+            T vij = v(i, j);
+            for (size_t c = 0; c < j; c++) z[c] += v(i, c) * vij;
+        }
+        for (size_t r = 0; r < j; r++) {
+            T s = T(0);
+            for (size_t c = r; c < j; c++) s += t(r, c) * z[c];
+            t(r, j) = -tau[k0 + j] * s;
+        }
+        t(j, j) = tau[k0 + j];
+    }
+}
+
+// c = (I - V T V^T) c, or with T^T in place of T when transpose is set.
+template <typename T>
+void apply_block_reflector(const TypedMatrix<T>& v, const TypedMatrix<T>& t, MatrixView<T> c, bool transpose) {
+    TypedMatrix<T> w(v.cols(), c.cols());
+    TypedMatrix<T> tw(v.cols(), c.cols());
+    gemm<T>(T(1), v.transpose_view(), c, T(0), MatrixView<T>(w));
+    gemm<T>(T(1), transpose ? t.transpose_view() : ConstMatrixView<T>(t), w, T(0), MatrixView<T>(tw));
+    gemm<T>(T(-1), v, tw, T(1), c);
+}
+
+}
+
+/* LU ************************************************************************/
+
+template <typename T>
+LU<T>::LU(const TypedMatrix<T>& a) : lu_(a), pivots_(a.rows()), singular_(false) {
+    require_square(a);
+    size_t n = a.rows();
+    T* A = lu_.data();
+    for (size_t k0 = 0; k0 < n; k0 += BLOCK) {
+        size_t k1 = std::min(n, k0 + BLOCK);
+        // Factor the panel of columns [k0, k1). Row swaps are applied to whole
+        // rows, which are contiguous.
+        for (size_t j = k0; j < k1; j++) {
+            size_t p = j;
+            for (size_t i = j + 1; i < n; i++) {
+                if (std::fabs(A[i * n + j]) > std::fabs(A[p * n + j])) p = i;
+            }
+            pivots_[j] = p;
+            if (p != j) std::swap_ranges(A + j * n, A + (j + 1) * n, A + p * n);
+            T d = A[j * n + j];
+            if (d == T(0)) {
+                singular_ = true;
+                continue;
+            }
+            const T* rj = A + j * n;
+            parallel::parallel_for(n - j - 1, PANEL_GRAIN, [&](size_t i0, size_t i1) {
+                for (size_t i = j + 1 + i0; i < j + 1 + i1; i++) {
+                    T* ri = A + i * n;
+                    T f = ri[j] /= d;
+                    for (size_t c = j + 1; c < k1; c++) ri[c] -= f * rj[c];
+                }
+            });
+        }
+        if (k1 == n) break;
+        // U12 = L11^-1 A12, then A22 -= L21 U12.
+        solve_lower<T>(lu_.block(k0, k0, k1 - k0, k1 - k0), lu_.block(k0, k1, k1 - k0, n - k1), true);
+        gemm<T>(T(-1), lu_.block(k1, k0, n - k1, k1 - k0), lu_.block(k0, k1, k1 - k0, n - k1),
+                T(1), lu_.block(k1, k1, n - k1, n - k1));
+    }
+}
+
+template <typename T>
+TypedMatrix<T> LU<T>::solve(const TypedMatrix<T>& b) const {
+    if (b.rows() != lu_.rows()) throw std::invalid_argument("Dimension mismatch");
+    if (singular_) throw std::runtime_error("Singular matrix");
+    TypedMatrix<T> x(b);
+    for (size_t j = 0; j < pivots_.size(); j++) {
+        if (pivots_[j] != j) {
+            std::swap_ranges(x.data() + j * x.cols(), x.data() + (j + 1) * x.cols(),
+                             x.data() + pivots_[j] * x.cols());
+        }
+    }
+    solve_lower<T>(lu_, x, true);
+    solve_upper<T>(lu_, x);
+    return x;
+}
+
+template <typename T>
+TypedMatrix<T> LU<T>::inverse() const {
+    return solve(TypedMatrix<T>::identity(lu_.rows()));
+}
+
+template <typename T>
+T LU<T>::determinant() const {
+    if (singular_) return T(0);
+    T det = T(1);
+    for (size_t i = 0; i < lu_.rows(); i++) {
+        det *= lu_(i, i);
+        if (pivots_[i] != i) det = -det;
+    }
+    return det;
+}
+
+/* Cholesky ******************************************************************/
+
+template <typename T>
+Cholesky<T>::Cholesky(const TypedMatrix<T>& a) : l_(a) {
+    require_square(a);
+    size_t n = a.rows();
+    T* L = l_.data();
+    for (size_t k0 = 0; k0 < n; k0 += BLOCK) {
+        size_t k1 = std::min(n, k0 + BLOCK);
+        // Diagonal block; earlier blocks were already subtracted by the
+        // trailing updates.
+        for (size_t j = k0; j < k1; j++) {
+            T* rj = L + j * n;
+            T d = rj[j];
+            for (size_t s = k0; s < j; s++) d -= rj[s] * rj[s];
+            if (!(d > T(0))) throw std::invalid_argument("Matrix is not positive definite");
+            d = std::sqrt(d);
+            rj[j] = d;
+            for (size_t i = j + 1; i < k1; i++) {
+                T* ri = L + i * n;
+                T s = ri[j];
+                for (size_t t = k0; t < j; t++) s -= ri[t] * rj[t];
+                ri[j] = s / d;
+            }
+        }
+        if (k1 == n) break;
+        // L21 = A21 L11^-T, one row at a time.
+        parallel::parallel_for(n - k1, PANEL_GRAIN, [&](size_t i0, size_t i1) {
+            for (size_t i = k1 + i0; i < k1 + i1; i++) {
+                T* ri = L + i * n;
+                for (size_t j = k0; j < k1; j++) {
+                    const T* rj = L + j * n;
+                    T s = ri[j];
+                    for (size_t t = k0; t < j; t++) s -= ri[t] * rj[t];
+                    ri[j] = s / rj[j];
+                }
+            }
+        });
+        // A22 -= L21 L21^T on the lower triangle, a few block columns at a
+        // time; the part each update spills above the diagonal is cleared below.
+        for (size_t j0 = k1; j0 < n; j0 += 4 * BLOCK) {
+            size_t jb = std::min(4 * BLOCK, n - j0);
+            gemm<T>(T(-1), l_.block(j0, k0, n - j0, k1 - k0), l_.block(j0, k0, jb, k1 - k0).transpose_view(),
+                    T(1), l_.block(j0, j0, n - j0, jb));
+        }
+    }
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = i + 1; j < n; j++) L[i * n + j] = T(0);
+}
+
+template <typename T>
+TypedMatrix<T> Cholesky<T>::solve(const TypedMatrix<T>& b) const {
+    if (b.rows() != l_.rows()) throw std::invalid_argument("Dimension mismatch");
+    TypedMatrix<T> x(b);
+    solve_lower<T>(l_, x, false);
+    solve_upper<T>(l_.transpose_view(), x);
+    return x;
+}
+
+template <typename T>
+TypedMatrix<T> Cholesky<T>::inverse() const {
+    return solve(TypedMatrix<T>::identity(l_.rows()));
+}
+
+template <typename T>
+T Cholesky<T>::determinant() const {
+    T det = T(1);
+    for (size_t i = 0; i < l_.rows(); i++) det *= l_(i, i) * l_(i, i);
+    return det;
+}
+
+/* QR ************************************************************************/
+
+template <typename T>
+QR<T>::QR(const TypedMatrix<T>& a) : qr_(a), tau_(a.cols(), T(0)) {
+    size_t m = a.rows(), n = a.cols();
+    if (m < n) throw std::invalid_argument("QR needs at least as many rows as columns");
+    T* A = qr_.data();
+    std::vector<T> w(BLOCK);
+    TypedMatrix<T> v, t;
+    for (size_t k0 = 0; k0 < n; k0 += BLOCK) {
+        size_t k1 = std::min(n, k0 + BLOCK);
+        for (size_t j = k0; j < k1; j++) {
+            // Reflector I - tau v v^T with v(j) = 1 mapping column j onto e_j.
+            T alpha = A[j * n + j];
+            T sigma = T(0);
+            for (size_t i = j + 1; i < m; i++) sigma += A[i * n + j] * A[i * n + j];
+            if (sigma == T(0)) continue;
+            T beta = -std::copysign(std::hypot(alpha, std::sqrt(sigma)), alpha);
+            tau_[j] = (beta - alpha) / beta;
+            T scale = T(1) / (alpha - beta);
+            for (size_t i = j + 1; i < m; i++) A[i * n + j] *= scale;
+            A[j * n + j] = beta;
+            // Apply it to the rest of the panel, accumulating v^T A row by row.
+            size_t c0 = j + 1, nc = k1 - c0;
+            for (size_t c = 0; c < nc; c++) w[c] = A[j * n + c0 + c];
+            for (size_t i = j + 1; i < m; i++) {
+                T vi = A[i * n + j];
+                const T* ri = A + i * n + c0;
+                for (size_t c = 0; c < nc; c++) w[c] += vi * ri[c];
+            }
+            for (size_t c = 0; c < nc; c++) A[j * n + c0 + c] -= tau_[j] * w[c];
+            for (size_t i = j + 1; i < m; i++) {
+                T f = tau_[j] * A[i * n + j];
+                T* ri = A + i * n + c0;
+                for (size_t c = 0; c < nc; c++) ri[c] -= f * w[c];
+            }
+        }
+        if (k1 == n) break;
+        block_reflector(qr_, tau_, k0, k1, v, t);
+        apply_block_reflector(v, t, qr_.block(k0, k1, m - k0, n - k1), true);
+    }
+}
+
+template <typename T>
+void QR<T>::apply_q(MatrixView<T> c, bool transpose) const {
+    size_t m = qr_.rows(), n = qr_.cols();
+    size_t blocks = (n + BLOCK - 1) / BLOCK;
+    TypedMatrix<T> v, t;
+    // Q = H(0) H(1) ... so Q^T applies the blocks first to last, Q last to first.
+    for (size_t b = 0; b < blocks; b++) {
+        size_t k0 = (transpose ? b : blocks - 1 - b) * BLOCK;
+        size_t k1 = std::min(n, k0 + BLOCK);
+        block_reflector(qr_, tau_, k0, k1, v, t);
+        apply_block_reflector(v, t, c.block(k0, 0, m - k0, c.cols()), transpose);
+    }
+}
+
+template <typename T>
+TypedMatrix<T> QR<T>::Q() const {
+    TypedMatrix<T> q(qr_.rows(), qr_.cols());
+    for (size_t i = 0; i < qr_.cols(); i++) q(i, i) = T(1);
+    apply_q(q, false);
+    return q;
+}
+
+template <typename T>
+TypedMatrix<T> QR<T>::R() const {
+    size_t n = qr_.cols();
+    TypedMatrix<T> r(n, n);
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = i; j < n; j++) r(i, j) = qr_(i, j);
+    return r;
+}
+
+template <typename T>
+TypedMatrix<T> QR<T>::solve(const TypedMatrix<T>& b) const {
+    if (b.rows() != qr_.rows()) throw std::invalid_argument("Dimension mismatch");
+    size_t n = qr_.cols();
+    TypedMatrix<T> x(b);
+    apply_q(x, true);
+    solve_upper<T>(qr_.block(0, 0, n, n), x.block(0, 0, n, x.cols()));
+    return TypedMatrix<T>(x.block(0, 0, n, x.cols()));
+}
+
+template <typename T>
+TypedMatrix<T> QR<T>::inverse() const {
+    require_square(qr_);
+    return solve(TypedMatrix<T>::identity(qr_.rows()));
+}
+
+template <typename T>
+T QR<T>::determinant() const {
+    require_square(qr_);
+    // Each nontrivial reflector has determinant -1.
+    T det = T(1);
+    for (size_t i = 0; i < qr_.cols(); i++) {
+        det *= qr_(i, i);
+        if (tau_[i] != T(0)) det = -det;
+    }
+    return det;
+}
+
+template class LU<float>;
+template class LU<double>;
+template class Cholesky<float>;
+template class Cholesky<double>;
+template class QR<float>;
+template class QR<double>;
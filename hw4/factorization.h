@@ -0,0 +1,87 @@
+#ifndef FACTORIZATION_H
+#define FACTORIZATION_H
+
+#include <cstddef>
+#include <vector>
+#include "matrix.h"
+
+// Dense factorizations of float and double matrices. Each is computed once by
+// the constructor with a blocked right-looking algorithm whose trailing
+// updates go through gemm(), and can then solve any number of systems.
+//
+// solve() and inverse() throw std::runtime_error("Singular matrix") when the
+// factored matrix is singular; shape errors throw std::invalid_argument.
+
+// PA = LU with partial pivoting, for square A.
+template <typename T>
+class LU {
+    static_assert(std::is_floating_point<T>::value, "LU needs a floating-point matrix");
+
+private:
+    TypedMatrix<T> lu_;
+    std::vector<size_t> pivots_;
+    bool singular_;
+
+public:
+    explicit LU(const TypedMatrix<T>& a);
+
+    // Unit lower L below the diagonal and U on and above it.
+    const TypedMatrix<T>& factors() const { return lu_; }
+    // Row i was swapped with row pivots()[i] at step i.
+    const std::vector<size_t>& pivots() const { return pivots_; }
+    bool isSingular() const { return singular_; }
+
+    TypedMatrix<T> solve(const TypedMatrix<T>& b) const;
+    TypedMatrix<T> inverse() const;
+    T determinant() const;
+};
+
+// A = L L^T for symmetric positive definite A. Only the lower triangle of A
+// is read. The constructor throws std::invalid_argument if A is not
+// positive definite.
+template <typename T>
+class Cholesky {
+    static_assert(std::is_floating_point<T>::value, "Cholesky needs a floating-point matrix");
+
+private:
+    TypedMatrix<T> l_;
+
+public:
+    explicit Cholesky(const TypedMatrix<T>& a);
+
+    // Lower triangular factor; entries above the diagonal are zero.
+    const TypedMatrix<T>& lower() const { return l_; }
+
+    TypedMatrix<T> solve(const TypedMatrix<T>& b) const;
+    TypedMatrix<T> inverse() const;
+    T determinant() const;
+};
+
+// A = QR by Householder reflections, for m x n A with m >= n. Reflectors are
+// applied a panel at a time as compact WY blocks I - V T V^T.
+template <typename T>
+class QR {
+    static_assert(std::is_floating_point<T>::value, "QR needs a floating-point matrix");
+
+private:
+    // R on and above the diagonal, reflector vectors below it.
+    TypedMatrix<T> qr_;
+    std::vector<T> tau_;
+
+    void apply_q(MatrixView<T> c, bool transpose) const;
+
+public:
+    explicit QR(const TypedMatrix<T>& a);
+
+    // Thin factors: Q is m x n with orthonormal columns, R is n x n upper.
+    TypedMatrix<T> Q() const;
+    TypedMatrix<T> R() const;
+
+    // Least-squares solution of A x = b; exact when A is square.
+    TypedMatrix<T> solve(const TypedMatrix<T>& b) const;
+    // Square A only.
+    TypedMatrix<T> inverse() const;
+    T determinant() const;
+};
+
+#endif
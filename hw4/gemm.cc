@@ -0,0 +1,456 @@
+#include "gemm.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GEMM_X86 1
+#endif
+
+namespace matrix_kernels {
+
+namespace {
+
+/* Microkernels ***************************************************************/
+
+// A microkernel multiplies an MR x kc packed sliver of A by a kc x NR packed
+// sliver of B and writes alpha * AB + beta * C into a row-major MR x NR tile
+// of C with row stride ldc.
+template <typename T>
+struct MicroKernel {
+    typedef void (*fn_type)(size_t kc, const T* a, const T* b,
+                            T* c, size_t ldc, T alpha, T beta);
+    const char* name;
+    size_t mr, nr;       // register tile
+    size_t mc, kc, nc;   // cache blocking: A block in L2, B panel in L3
+    fn_type fn;
+};
+
+// Plain C++ kernel. It is always inlined into the wrappers below, which
+// compile it for a specific instruction set and let the vectorizer map the
+// NR columns onto vector lanes. Used where no intrinsic kernel exists.
+template <typename T, int MR, int NR>
+__attribute__((always_inline)) inline
+void kernel_body(size_t kc, const T* a, const T* b, T* c, size_t ldc, T alpha, T beta) {
+    T acc[MR][NR] = {};
+    for (size_t p = 0; p < kc; p++) {
+        for (int i = 0; i < MR; i++) {
+            T ai = a[i];
+            for (int j = 0; j < NR; j++) acc[i][j] += ai * b[j];
+        }
+        a += MR;
+        b += NR;
+    }
+    for (int i = 0; i < MR; i++) {
+        for (int j = 0; j < NR; j++) {
+            T v = alpha * acc[i][j];
+            c[i * ldc + j] = (beta == T(0)) ? v : v + beta * c[i * ldc + j];
+        }
+    }
+}
+
+template <typename T, int MR, int NR>
+void kernel_scalar(size_t kc, const T* a, const T* b, T* c, size_t ldc, T alpha, T beta) {
+    kernel_body<T, MR, NR>(kc, a, b, c, ldc, alpha, beta);
+}
+
+#ifdef GEMM_X86
+
+#define GEMM_AVX2 __attribute__((target("avx2,fma"), always_inline)) inline
+#define GEMM_AVX512 __attribute__((target("avx512f,avx512dq"), always_inline)) inline
+
+template <typename T, int MR, int NR>
+__attribute__((target("avx2,fma")))
+void kernel_generic_avx2(size_t kc, const T* a, const T* b, T* c, size_t ldc, T alpha, T beta) {
+    kernel_body<T, MR, NR>(kc, a, b, c, ldc, alpha, beta);
+}
+
+// Thin wrappers over the intrinsics so one hand-blocked kernel per
+// instruction set serves every element type.
+struct Avx2Double {
+    typedef double scalar;
+    typedef __m256d vec;
+    static const int width = 4;
+    static GEMM_AVX2 vec zero() { return _mm256_setzero_pd(); }
+    static GEMM_AVX2 vec set1(double v) { return _mm256_set1_pd(v); }
+    static GEMM_AVX2 vec load(const double* p) { return _mm256_loadu_pd(p); }
+    static GEMM_AVX2 void store(double* p, vec v) { _mm256_storeu_pd(p, v); }
+    static GEMM_AVX2 vec mul(vec a, vec b) { return _mm256_mul_pd(a, b); }
+    static GEMM_AVX2 vec fma(vec a, vec b, vec c) { return _mm256_fmadd_pd(a, b, c); }
+};
+
+struct Avx2Float {
+    typedef float scalar;
+    typedef __m256 vec;
+    static const int width = 8;
+    static GEMM_AVX2 vec zero() { return _mm256_setzero_ps(); }
+    static GEMM_AVX2 vec set1(float v) { return _mm256_set1_ps(v); }
+    static GEMM_AVX2 vec load(const float* p) { return _mm256_loadu_ps(p); }
+    static GEMM_AVX2 void store(float* p, vec v) { _mm256_storeu_ps(p, v); }
+    static GEMM_AVX2 vec mul(vec a, vec b) { return _mm256_mul_ps(a, b); }
+    static GEMM_AVX2 vec fma(vec a, vec b, vec c) { return _mm256_fmadd_ps(a, b, c); }
+};
+
+struct Avx512Double {
+    typedef double scalar;
+    typedef __m512d vec;
+    static const int width = 8;
+    static GEMM_AVX512 vec zero() { return _mm512_setzero_pd(); }
+    static GEMM_AVX512 vec set1(double v) { return _mm512_set1_pd(v); }
+    static GEMM_AVX512 vec load(const double* p) { return _mm512_loadu_pd(p); }
+    static GEMM_AVX512 void store(double* p, vec v) { _mm512_storeu_pd(p, v); }
+    static GEMM_AVX512 vec mul(vec a, vec b) { return _mm512_mul_pd(a, b); }
+    static GEMM_AVX512 vec fma(vec a, vec b, vec c) { return _mm512_fmadd_pd(a, b, c); }
+};
+
+struct Avx512Float {
+    typedef float scalar;
+    typedef __m512 vec;
+    static const int width = 16;
+    static GEMM_AVX512 vec zero() { return _mm512_setzero_ps(); }
+    static GEMM_AVX512 vec set1(float v) { return _mm512_set1_ps(v); }
+    static GEMM_AVX512 vec load(const float* p) { return _mm512_loadu_ps(p); }
+    static GEMM_AVX512 void store(float* p, vec v) { _mm512_storeu_ps(p, v); }
+    static GEMM_AVX512 vec mul(vec a, vec b) { return _mm512_mul_ps(a, b); }
+    static GEMM_AVX512 vec fma(vec a, vec b, vec c) { return _mm512_fmadd_ps(a, b, c); }
+};
+
+// Integer "fma" is a low-half multiply followed by an add; products wrap on
+// overflow exactly like the scalar code.
+struct Avx2Int32 {
+    typedef int32_t scalar;
+    typedef __m256i vec;
+    static const int width = 8;
+    static GEMM_AVX2 vec zero() { return _mm256_setzero_si256(); }
+    static GEMM_AVX2 vec set1(int32_t v) { return _mm256_set1_epi32(v); }
+    static GEMM_AVX2 vec load(const int32_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    static GEMM_AVX2 void store(int32_t* p, vec v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+    static GEMM_AVX2 vec mul(vec a, vec b) { return _mm256_mullo_epi32(a, b); }
+    static GEMM_AVX2 vec fma(vec a, vec b, vec c) { return _mm256_add_epi32(_mm256_mullo_epi32(a, b), c); }
+};
+
+struct Avx512Int32 {
+    typedef int32_t scalar;
+    typedef __m512i vec;
+    static const int width = 16;
+    static GEMM_AVX512 vec zero() { return _mm512_setzero_si512(); }
+    static GEMM_AVX512 vec set1(int32_t v) { return _mm512_set1_epi32(v); }
+    static GEMM_AVX512 vec load(const int32_t* p) { return _mm512_loadu_si512(p); }
+    static GEMM_AVX512 void store(int32_t* p, vec v) { _mm512_storeu_si512(p, v); }
+    static GEMM_AVX512 vec mul(vec a, vec b) { return _mm512_mullo_epi32(a, b); }
+    static GEMM_AVX512 vec fma(vec a, vec b, vec c) { return _mm512_add_epi32(_mm512_mullo_epi32(a, b), c); }
+};
+
+struct Avx512Int64 {
+    typedef int64_t scalar;
+    typedef __m512i vec;
+    static const int width = 8;
+    static GEMM_AVX512 vec zero() { return _mm512_setzero_si512(); }
+    static GEMM_AVX512 vec set1(int64_t v) { return _mm512_set1_epi64(v); }
+    static GEMM_AVX512 vec load(const int64_t* p) { return _mm512_loadu_si512(p); }
+    static GEMM_AVX512 void store(int64_t* p, vec v) { _mm512_storeu_si512(p, v); }
+    static GEMM_AVX512 vec mul(vec a, vec b) { return _mm512_mullo_epi64(a, b); }
+    static GEMM_AVX512 vec fma(vec a, vec b, vec c) { return _mm512_add_epi64(_mm512_mullo_epi64(a, b), c); }
+};
+
+// MR rows by NV vectors of V::width columns, all accumulators in registers.
+template <typename V, int MR, int NV>
+__attribute__((target("avx2,fma")))
+void kernel_avx2(size_t kc, const typename V::scalar* a, const typename V::scalar* b,
+                 typename V::scalar* c, size_t ldc,
+                 typename V::scalar alpha, typename V::scalar beta) {
+    typename V::vec acc[MR][NV];
+#pragma GCC unroll 16
+    for (int i = 0; i < MR; i++)
+#pragma GCC unroll 4
+        for (int v = 0; v < NV; v++) acc[i][v] = V::zero();
+
+    for (size_t p = 0; p < kc; p++) {
+        typename V::vec bv[NV];
+#pragma GCC unroll 4
+        for (int v = 0; v < NV; v++) bv[v] = V::load(b + V::width * v);
+#pragma GCC unroll 16
+        for (int i = 0; i < MR; i++) {
+            typename V::vec ai = V::set1(a[i]);
+#pragma GCC unroll 4
+            for (int v = 0; v < NV; v++) acc[i][v] = V::fma(ai, bv[v], acc[i][v]);
+        }
+        a += MR;
+        b += V::width * NV;
+    }
+
+    typename V::vec va = V::set1(alpha), vb = V::set1(beta);
+#pragma GCC unroll 16
+    for (int i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+        for (int v = 0; v < NV; v++) {
+            typename V::scalar* cp = c + i * ldc + V::width * v;
+            typename V::vec r = V::mul(acc[i][v], va);
+            if (beta != 0) r = V::fma(vb, V::load(cp), r);
+            V::store(cp, r);
+        }
+    }
+}
+
+template <typename V, int MR, int NV>
+__attribute__((target("avx512f,avx512dq")))
+void kernel_avx512(size_t kc, const typename V::scalar* a, const typename V::scalar* b,
+                   typename V::scalar* c, size_t ldc,
+                   typename V::scalar alpha, typename V::scalar beta) {
+    typename V::vec acc[MR][NV];
+#pragma GCC unroll 16
+    for (int i = 0; i < MR; i++)
+#pragma GCC unroll 4
+        for (int v = 0; v < NV; v++) acc[i][v] = V::zero();
+
+    for (size_t p = 0; p < kc; p++) {
+        typename V::vec bv[NV];
+#pragma GCC unroll 4
+        for (int v = 0; v < NV; v++) bv[v] = V::load(b + V::width * v);
+#pragma GCC unroll 16
+        for (int i = 0; i < MR; i++) {
+            typename V::vec ai = V::set1(a[i]);
+#pragma GCC unroll 4
+            for (int v = 0; v < NV; v++) acc[i][v] = V::fma(ai, bv[v], acc[i][v]);
+        }
+        a += MR;
+        b += V::width * NV;
+    }
+
+    typename V::vec va = V::set1(alpha), vb = V::set1(beta);
+#pragma GCC unroll 16
+    for (int i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+        for (int v = 0; v < NV; v++) {
+            typename V::scalar* cp = c + i * ldc + V::width * v;
+            typename V::vec r = V::mul(acc[i][v], va);
+            if (beta != 0) r = V::fma(vb, V::load(cp), r);
+            V::store(cp, r);
+        }
+    }
+}
+
+bool has_avx512() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq");
+}
+
+bool has_avx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+#endif
+
+// Picks the widest kernel the CPU supports, once per element type.
+template <typename T>
+const MicroKernel<T>& pick(const MicroKernel<T>& avx512, const MicroKernel<T>& avx2,
+                           const MicroKernel<T>& scalar) {
+#ifdef GEMM_X86
+    if (has_avx512()) return avx512;
+    if (has_avx2()) return avx2;
+#endif
+    (void)avx512;
+    (void)avx2;
+    return scalar;
+}
+
+#ifdef GEMM_X86
+#define GEMM_SIMD(kernel) kernel
+#else
+#define GEMM_SIMD(kernel) nullptr
+#endif
+
+template <typename T>
+const MicroKernel<T>& select_kernel();
+
+template <>
+const MicroKernel<double>& select_kernel<double>() {
+    static const MicroKernel<double> scalar = {"scalar", 4, 4, 128, 256, 4096, kernel_scalar<double, 4, 4>};
+    static const MicroKernel<double> avx2 = {"avx2", 6, 8, 120, 256, 4096, GEMM_SIMD((kernel_avx2<Avx2Double, 6, 2>))};
+    static const MicroKernel<double> avx512 = {"avx512", 12, 16, 144, 256, 4096, GEMM_SIMD((kernel_avx512<Avx512Double, 12, 2>))};
+    static const MicroKernel<double>& chosen = pick(avx512, avx2, scalar);
+    return chosen;
+}
+
+template <>
+const MicroKernel<float>& select_kernel<float>() {
+    static const MicroKernel<float> scalar = {"scalar", 4, 8, 128, 256, 4096, kernel_scalar<float, 4, 8>};
+    static const MicroKernel<float> avx2 = {"avx2", 6, 16, 120, 256, 4096, GEMM_SIMD((kernel_avx2<Avx2Float, 6, 2>))};
+    static const MicroKernel<float> avx512 = {"avx512", 12, 32, 144, 256, 4096, GEMM_SIMD((kernel_avx512<Avx512Float, 12, 2>))};
+    static const MicroKernel<float>& chosen = pick(avx512, avx2, scalar);
+    return chosen;
+}
+
+template <>
+const MicroKernel<int32_t>& select_kernel<int32_t>() {
+    static const MicroKernel<int32_t> scalar = {"scalar", 4, 8, 128, 256, 4096, kernel_scalar<int32_t, 4, 8>};
+    static const MicroKernel<int32_t> avx2 = {"avx2", 4, 16, 128, 256, 4096, GEMM_SIMD((kernel_avx2<Avx2Int32, 4, 2>))};
+    static const MicroKernel<int32_t> avx512 = {"avx512", 8, 32, 128, 256, 4096, GEMM_SIMD((kernel_avx512<Avx512Int32, 8, 2>))};
+    static const MicroKernel<int32_t>& chosen = pick(avx512, avx2, scalar);
+    return chosen;
+}
+
+template <>
+const MicroKernel<int64_t>& select_kernel<int64_t>() {
+    static const MicroKernel<int64_t> scalar = {"scalar", 4, 4, 128, 256, 4096, kernel_scalar<int64_t, 4, 4>};
+    static const MicroKernel<int64_t> avx2 = {"avx2", 4, 8, 128, 256, 4096, GEMM_SIMD((kernel_generic_avx2<int64_t, 4, 8>))};
+    static const MicroKernel<int64_t> avx512 = {"avx512", 8, 16, 128, 256, 4096, GEMM_SIMD((kernel_avx512<Avx512Int64, 8, 2>))};
+    static const MicroKernel<int64_t>& chosen = pick(avx512, avx2, scalar);
+    return chosen;
+}
+
+/* Packing ********************************************************************/
+
+// Copies an mc x kc block of A into consecutive MR-row slivers, each stored
+// column by column. Rows past mc are zero so the kernel never needs edge cases.
+template <typename T>
+void pack_a(size_t mc, size_t kc, const T* a, size_t rs, size_t cs,
+            size_t mr, T* dst) {
+    for (size_t i0 = 0; i0 < mc; i0 += mr) {
+        size_t rows = std::min(mr, mc - i0);
+        for (size_t p = 0; p < kc; p++) {
+            const T* src = a + i0 * rs + p * cs;
+            size_t i = 0;
+            for (; i < rows; i++) dst[i] = src[i * rs];
+            for (; i < mr; i++) dst[i] = T(0);
+            dst += mr;
+        }
+    }
+}
+
+// Copies a kc x nc block of B into consecutive NR-column slivers, each stored
+// row by row, zero padded past nc.
+template <typename T>
+void pack_b(size_t kc, size_t nc, const T* b, size_t rs, size_t cs,
+            size_t nr, T* dst) {
+    for (size_t j0 = 0; j0 < nc; j0 += nr) {
+        size_t cols = std::min(nr, nc - j0);
+        for (size_t p = 0; p < kc; p++) {
+            const T* src = b + p * rs + j0 * cs;
+            size_t j = 0;
+            if (cs == 1) {
+                for (; j < cols; j++) dst[j] = src[j];
+            } else {
+                for (; j < cols; j++) dst[j] = src[j * cs];
+            }
+            for (; j < nr; j++) dst[j] = T(0);
+            dst += nr;
+        }
+    }
+}
+
+size_t round_up(size_t x, size_t m) {
+    return (x + m - 1) / m * m;
+}
+
+template <typename T>
+void scale(size_t m, size_t n, T beta, T* c, size_t rs_c, size_t cs_c) {
+    for (size_t i = 0; i < m; i++) {
+        for (size_t j = 0; j < n; j++) {
+            T& v = c[i * rs_c + j * cs_c];
+            v = (beta == T(0)) ? T(0) : beta * v;
+        }
+    }
+}
+
+// Straight triple loop for products too small to amortize packing.
+template <typename T>
+void gemm_small(size_t m, size_t n, size_t k, T alpha,
+                const T* a, size_t rs_a, size_t cs_a,
+                const T* b, size_t rs_b, size_t cs_b,
+                T beta, T* c, size_t rs_c, size_t cs_c) {
+    scale(m, n, beta, c, rs_c, cs_c);
+    for (size_t i = 0; i < m; i++) {
+        for (size_t p = 0; p < k; p++) {
+            T aip = alpha * a[i * rs_a + p * cs_a];
+            for (size_t j = 0; j < n; j++) {
+                c[i * rs_c + j * cs_c] += aip * b[p * rs_b + j * cs_b];
+            }
+        }
+    }
+}
+
+const size_t SMALL_GEMM_FLOPS = 16 * 16 * 16;
+
+}
+
+template <typename T>
+void gemm(size_t m, size_t n, size_t k, T alpha,
+          const T* a, size_t rs_a, size_t cs_a,
+          const T* b, size_t rs_b, size_t cs_b,
+          T beta, T* c, size_t rs_c, size_t cs_c) {
+    if (m == 0 || n == 0) return;
+    if (k == 0 || alpha == T(0)) {
+        scale(m, n, beta, c, rs_c, cs_c);
+        return;
+    }
+    if (m * n * k <= SMALL_GEMM_FLOPS) {
+        gemm_small(m, n, k, alpha, a, rs_a, cs_a, b, rs_b, cs_b, beta, c, rs_c, cs_c);
+        return;
+    }
+
+    const MicroKernel<T>& uk = select_kernel<T>();
+    const size_t MR = uk.mr, NR = uk.nr;
+
+    thread_local std::vector<T> a_pack, b_pack;
+    a_pack.resize(round_up(std::min(uk.mc, m), MR) * uk.kc);
+    b_pack.resize(uk.kc * round_up(std::min(uk.nc, n), NR));
+    T tile[16 * 32];
+
+    for (size_t jc = 0; jc < n; jc += uk.nc) {
+        size_t nc = std::min(uk.nc, n - jc);
+        for (size_t pc = 0; pc < k; pc += uk.kc) {
+            size_t kc = std::min(uk.kc, k - pc);
+            T beta_eff = (pc == 0) ? beta : T(1);
+            pack_b(kc, nc, b + pc * rs_b + jc * cs_b, rs_b, cs_b, NR, b_pack.data());
+
+            for (size_t ic = 0; ic < m; ic += uk.mc) {
+                size_t mc = std::min(uk.mc, m - ic);
+                pack_a(mc, kc, a + ic * rs_a + pc * cs_a, rs_a, cs_a, MR, a_pack.data());
+
+                for (size_t jr = 0; jr < nc; jr += NR) {
+                    size_t nr = std::min(NR, nc - jr);
+                    const T* bp = b_pack.data() + jr * kc;
+                    for (size_t ir = 0; ir < mc; ir += MR) {
+                        size_t mr = std::min(MR, mc - ir);
+                        const T* ap = a_pack.data() + ir * kc;
+                        T* cp = c + (ic + ir) * rs_c + (jc + jr) * cs_c;
+                        if (mr == MR && nr == NR && cs_c == 1) {
+                            uk.fn(kc, ap, bp, cp, rs_c, alpha, beta_eff);
+                            continue;
+                        }
+                        // Edge or strided tile: compute into scratch, then merge.
+                        uk.fn(kc, ap, bp, tile, NR, alpha, T(0));
+                        for (size_t i = 0; i < mr; i++) {
+                            for (size_t j = 0; j < nr; j++) {
+                                T& dst = cp[i * rs_c + j * cs_c];
+                                T v = tile[i * NR + j];
+                                dst = (beta_eff == T(0)) ? v : v + beta_eff * dst;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+template <typename T>
+const char* gemm_kernel_name() {
+    return select_kernel<T>().name;
+}
+
+#define INSTANTIATE_GEMM(T) \
+    template void gemm<T>(size_t, size_t, size_t, T, const T*, size_t, size_t, \
+                          const T*, size_t, size_t, T, T*, size_t, size_t); \
+    template const char* gemm_kernel_name<T>();
+
+INSTANTIATE_GEMM(float)
+INSTANTIATE_GEMM(double)
+INSTANTIATE_GEMM(int32_t)
+INSTANTIATE_GEMM(int64_t)
+
+}
@@ -0,0 +1,25 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <cstddef>
+
+namespace matrix_kernels {
+
+// C = alpha * A * B + beta * C, where A is m x k, B is k x n and C is m x n.
+// Each operand is addressed through a row stride and a column stride, so
+// row-major, column-major and transposed operands all go through the same path.
+// When beta is zero C is never read. Instantiated for float, double, int32_t
+// and int64_t.
+template <typename T>
+void gemm(size_t m, size_t n, size_t k, T alpha,
+          const T* a, size_t rs_a, size_t cs_a,
+          const T* b, size_t rs_b, size_t cs_b,
+          T beta, T* c, size_t rs_c, size_t cs_c);
+
+// Name of the microkernel selected for T on this CPU ("avx512", "avx2" or "scalar").
+template <typename T>
+const char* gemm_kernel_name();
+
+}
+
+#endif
@@ -1,25 +1,57 @@
 #include "matrix.h"
+#include <algorithm>
+#include <functional>
+#include "gemm.h"
+#include "reduce.h"
+#include "strassen.h"
+#include "thread_pool.h"
+#include "transpose.h"
+
+namespace {
+
+// Below these sizes the cost of waking workers outweighs the parallel speedup.
+const size_t GEMM_PARALLEL_FLOPS = 1 << 21;
+const size_t GEMM_TILE_ROWS = 128;
+const size_t GEMM_TILE_COLS = 256;
+const size_t TRANSPOSE_TILE = 256;
+
+// Applies f(begin, end) to chunks of a flat element range.
+template <typename F>
+void for_each_chunk(size_t n, F f) {
+    parallel::parallel_for(n, Matrix::ELEMENTWISE_GRAIN, f);
+}
+
+template <typename M>
+void require_shape(const M& m, size_t rows, size_t cols) {
+    if (m.rows() != rows || m.cols() != cols) throw std::invalid_argument("Dimension mismatch");
+}
 
-Matrix::Matrix() : data_(), rows_(0), cols_(0) {}
+}
+
+template <typename T>
+TypedMatrix<T>::TypedMatrix() : data_(), rows_(0), cols_(0) {}
 
-Matrix::Matrix(size_t rows, size_t cols)
-    : data_(rows * cols, 0.0), rows_(rows), cols_(cols) {}
+template <typename T>
+TypedMatrix<T>::TypedMatrix(size_t rows, size_t cols)
+    : data_(rows * cols, T(0)), rows_(rows), cols_(cols) {}
 
-Matrix::Matrix(size_t rows, size_t cols, double value)
+template <typename T>
+TypedMatrix<T>::TypedMatrix(size_t rows, size_t cols, T value)
     : data_(rows * cols, value), rows_(rows), cols_(cols) {}
 
-Matrix::Matrix(std::initializer_list<std::initializer_list<double>> list) {
+template <typename T>
+TypedMatrix<T>::TypedMatrix(std::initializer_list<std::initializer_list<T>> list) {
     rows_ = list.size();
     cols_ = 0;
     for (auto& row : list) {
         if (cols_ == 0) cols_ = row.size();
         if (row.size() != cols_) throw std::invalid_argument("Dimension mismatch");
     }
-    data_.assign(rows_ * cols_, 0.0);
+    data_.assign(rows_ * cols_, T(0));
     size_t r = 0;
     for (auto& row : list) {
         size_t c = 0;
-        for (double v : row) {
+        for (T v : row) {
             data_[r * cols_ + c] = v;
             c++;
         }
@@ -27,10 +59,20 @@ Matrix::Matrix(std::initializer_list<std::initializer_list<double>> list) {
     }
 }
 
-Matrix::Matrix(const Matrix& other)
+template <typename T>
+TypedMatrix<T>::TypedMatrix(const TypedMatrix& other)
     : data_(other.data_), rows_(other.rows_), cols_(other.cols_) {}
 
-Matrix& Matrix::operator=(const Matrix& other) {
+template <typename T>
+TypedMatrix<T>::TypedMatrix(TypedMatrix&& other) noexcept
+    : data_(std::move(other.data_)), rows_(other.rows_), cols_(other.cols_) {
+    other.data_.clear();
+    other.rows_ = 0;
+    other.cols_ = 0;
+}
+
+template <typename T>
+TypedMatrix<T>& TypedMatrix<T>::operator=(const TypedMatrix& other) {
     if (this != &other) {
         data_ = other.data_;
         rows_ = other.rows_;
@@ -39,165 +81,239 @@ Matrix& Matrix::operator=(const Matrix& other) {
     return *this;
 }
 
-double& Matrix::operator()(size_t row, size_t col) {
-    return data_[idx(row, col)];
+template <typename T>
+TypedMatrix<T>& TypedMatrix<T>::operator=(TypedMatrix&& other) noexcept {
+    if (this != &other) {
+        data_ = std::move(other.data_);
+        rows_ = other.rows_;
+        cols_ = other.cols_;
+        other.data_.clear();
+        other.rows_ = 0;
+        other.cols_ = 0;
+    }
+    return *this;
 }
 
-const double& Matrix::operator()(size_t row, size_t col) const {
+template <typename T>
+T& TypedMatrix<T>::operator()(size_t row, size_t col) {
     return data_[idx(row, col)];
 }
 
-double& Matrix::at(size_t row, size_t col) {
-    if (row >= rows_ || col >= cols_) throw std::out_of_range("Out of range");
+template <typename T>
+const T& TypedMatrix<T>::operator()(size_t row, size_t col) const {
     return data_[idx(row, col)];
 }
 
-const double& Matrix::at(size_t row, size_t col) const {
+template <typename T>
+T& TypedMatrix<T>::at(size_t row, size_t col) {
     if (row >= rows_ || col >= cols_) throw std::out_of_range("Out of range");
     return data_[idx(row, col)];
 }
 
-size_t Matrix::rows() const { return rows_; }
-size_t Matrix::cols() const { return cols_; }
-bool Matrix::isEmpty() const { return rows_ == 0 || cols_ == 0; }
-bool Matrix::isSquare() const { return rows_ == cols_; }
-
-Matrix Matrix::operator+(const Matrix& other) const {
-    if (rows_ != other.rows_ || cols_ != other.cols_) throw std::invalid_argument("Dimension mismatch");
-    Matrix r(rows_, cols_);
-    for (size_t i = 0; i < data_.size(); i++) r.data_[i] = data_[i] + other.data_[i];
-    return r;
-}
-
-Matrix Matrix::operator-(const Matrix& other) const {
-    if (rows_ != other.rows_ || cols_ != other.cols_) throw std::invalid_argument("Dimension mismatch");
-    Matrix r(rows_, cols_);
-    for (size_t i = 0; i < data_.size(); i++) r.data_[i] = data_[i] - other.data_[i];
-    return r;
+template <typename T>
+const T& TypedMatrix<T>::at(size_t row, size_t col) const {
+    if (row >= rows_ || col >= cols_) throw std::out_of_range("Out of range");
+    return data_[idx(row, col)];
 }
 
-Matrix Matrix::operator*(const Matrix& other) const {
-    if (cols_ != other.rows_) throw std::invalid_argument("Dimension mismatch");
-    Matrix r(rows_, other.cols_, 0.0);
-    for (size_t i = 0; i < rows_; i++) {
-        for (size_t k = 0; k < cols_; k++) {
-            double aik = (*this)(i, k);
-            for (size_t j = 0; j < other.cols_; j++) {
-                r(i, j) += aik * other(k, j);
-            }
-        }
+template <typename T> size_t TypedMatrix<T>::rows() const { return rows_; }
+template <typename T> size_t TypedMatrix<T>::cols() const { return cols_; }
+template <typename T> bool TypedMatrix<T>::isEmpty() const { return rows_ == 0 || cols_ == 0; }
+template <typename T> bool TypedMatrix<T>::isSquare() const { return rows_ == cols_; }
+
+template <typename T>
+TypedMatrix<T> TypedMatrix<T>::product(ConstMatrixView<T> a, ConstMatrixView<T> b) {
+    if (a.cols() != b.rows()) throw std::invalid_argument("Dimension mismatch");
+    TypedMatrix r(a.rows(), b.cols());
+    strassen::Config fast = strassen::config();
+    if (fast.enabled && std::min({a.rows(), a.cols(), b.cols()}) >= fast.threshold) {
+        strassen::multiply<T>(a, b, MatrixView<T>(r), fast.crossover);
+    } else {
+        gemm<T>(T(1), a, b, T(0), MatrixView<T>(r));
     }
     return r;
 }
 
-Matrix Matrix::operator*(double scalar) const {
-    Matrix r(rows_, cols_);
-    for (size_t i = 0; i < data_.size(); i++) r.data_[i] = data_[i] * scalar;
-    return r;
+template <typename T>
+void gemm(T alpha, const TypedMatrix<T>& a, const TypedMatrix<T>& b, T beta, TypedMatrix<T>& c) {
+    gemm<T>(alpha, ConstMatrixView<T>(a), ConstMatrixView<T>(b), beta, MatrixView<T>(c));
 }
 
-Matrix operator*(double scalar, const Matrix& m) {
-    return m * scalar;
+template <typename T>
+void gemm(T alpha, typename matrix_view::Nondeduced<ConstMatrixView<T>>::type a,
+          typename matrix_view::Nondeduced<ConstMatrixView<T>>::type b,
+          T beta, typename matrix_view::Nondeduced<MatrixView<T>>::type c) {
+    if (a.cols() != b.rows()) throw std::invalid_argument("Dimension mismatch");
+    require_shape(c, a.rows(), b.cols());
+    if (matrix_view::overlaps(ConstMatrixView<T>(c), a) || matrix_view::overlaps(ConstMatrixView<T>(c), b)) {
+        TypedMatrix<T> out(c);
+        gemm<T>(alpha, a, b, beta, MatrixView<T>(out));
+        c = out;
+        return;
+    }
+    size_t m = a.rows(), n = b.cols(), k = a.cols();
+    auto tile = [&](size_t r0, size_t r1, size_t c0, size_t c1) {
+        matrix_kernels::gemm(r1 - r0, c1 - c0, k, alpha,
+                             a.data() + r0 * a.row_stride(), a.row_stride(), a.col_stride(),
+                             b.data() + c0 * b.col_stride(), b.row_stride(), b.col_stride(),
+                             beta, c.data() + r0 * c.row_stride() + c0 * c.col_stride(),
+                             c.row_stride(), c.col_stride());
+    };
+    if (m * n * k < GEMM_PARALLEL_FLOPS) {
+        tile(0, m, 0, n);
+    } else {
+        parallel::parallel_for_2d(m, n, GEMM_TILE_ROWS, GEMM_TILE_COLS, tile);
+    }
 }
 
-Matrix Matrix::operator/(double scalar) const {
-    if (std::fabs(scalar) <= EPSILON) throw std::invalid_argument("Division by zero");
-    Matrix r(rows_, cols_);
-    for (size_t i = 0; i < data_.size(); i++) r.data_[i] = data_[i] / scalar;
-    return r;
+template <typename T>
+void add_into(TypedMatrix<T>& c, const TypedMatrix<T>& a, const TypedMatrix<T>& b) {
+    require_shape(c, a.rows(), a.cols());
+    c = a + b;
 }
 
-Matrix Matrix::operator-() const {
-    Matrix r(rows_, cols_);
-    for (size_t i = 0; i < data_.size(); i++) r.data_[i] = -data_[i];
-    return r;
+template <typename T>
+void subtract_into(TypedMatrix<T>& c, const TypedMatrix<T>& a, const TypedMatrix<T>& b) {
+    require_shape(c, a.rows(), a.cols());
+    c = a - b;
 }
 
-Matrix& Matrix::operator+=(const Matrix& other) {
-    if (rows_ != other.rows_ || cols_ != other.cols_) throw std::invalid_argument("Dimension mismatch");
-    for (size_t i = 0; i < data_.size(); i++) data_[i] += other.data_[i];
-    return *this;
+template <typename T>
+void scale_into(TypedMatrix<T>& c, T alpha, const TypedMatrix<T>& a) {
+    require_shape(c, a.rows(), a.cols());
+    c = a * alpha;
 }
 
-Matrix& Matrix::operator-=(const Matrix& other) {
-    if (rows_ != other.rows_ || cols_ != other.cols_) throw std::invalid_argument("Dimension mismatch");
-    for (size_t i = 0; i < data_.size(); i++) data_[i] -= other.data_[i];
+template <typename T>
+TypedMatrix<T>& TypedMatrix<T>::operator*=(T scalar) {
+    for_each_chunk(data_.size(), [&](size_t i0, size_t i1) {
+        for (size_t i = i0; i < i1; i++) data_[i] *= scalar;
+    });
     return *this;
 }
 
-Matrix& Matrix::operator*=(double scalar) {
-    for (double& v : data_) v *= scalar;
+template <typename T>
+TypedMatrix<T>& TypedMatrix<T>::operator/=(T scalar) {
+    if (nearly_zero(scalar)) throw std::invalid_argument("Division by zero");
+    for_each_chunk(data_.size(), [&](size_t i0, size_t i1) {
+        for (size_t i = i0; i < i1; i++) data_[i] /= scalar;
+    });
     return *this;
 }
 
-Matrix& Matrix::operator/=(double scalar) {
-    if (std::fabs(scalar) <= EPSILON) throw std::invalid_argument("Division by zero");
-    for (double& v : data_) v /= scalar;
-    return *this;
-}
-
-bool Matrix::operator==(const Matrix& other) const {
-    if (rows_ != other.rows_ || cols_ != other.cols_) return false;
-    for (size_t i = 0; i < data_.size(); i++) {
-        if (std::fabs(data_[i] - other.data_[i]) > EPSILON) return false;
+template <typename T>
+TypedMatrix<T> TypedMatrix<T>::transpose() const {
+    TypedMatrix r(cols_, rows_);
+    const T* a = data_.data();
+    T* b = r.data_.data();
+    auto tile = [&](size_t r0, size_t r1, size_t c0, size_t c1) {
+        matrix_kernels::transpose(r1 - r0, c1 - c0, a + r0 * cols_ + c0, cols_, b + c0 * rows_ + r0, rows_);
+    };
+    if (data_.size() < ELEMENTWISE_GRAIN) {
+        tile(0, rows_, 0, cols_);
+    } else {
+        parallel::parallel_for_2d(rows_, cols_, TRANSPOSE_TILE, TRANSPOSE_TILE, tile);
     }
-    return true;
-}
-
-bool Matrix::operator!=(const Matrix& other) const {
-    return !(*this == other);
+    return r;
 }
 
-Matrix Matrix::transpose() const {
-    Matrix r(cols_, rows_);
-    for (size_t i = 0; i < rows_; i++) {
-        for (size_t j = 0; j < cols_; j++) {
-            r(j, i) = (*this)(i, j);
-        }
+template <typename T>
+void TypedMatrix<T>::transpose_in_place() {
+    if (!isSquare()) {
+        *this = transpose();
+        return;
     }
-    return r;
+    size_t n = rows_;
+    T* a = data_.data();
+    if (data_.size() < ELEMENTWISE_GRAIN) {
+        matrix_kernels::transpose_square(n, a, n);
+        return;
+    }
+    // Each task owns a diagonal tile or a pair of mirrored tiles.
+    size_t tiles = (n + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE;
+    parallel::run(tiles * tiles, [&](size_t t) {
+        size_t i = t / tiles, j = t % tiles;
+        if (i > j) return;
+        size_t r0 = i * TRANSPOSE_TILE, c0 = j * TRANSPOSE_TILE;
+        size_t nr = std::min(TRANSPOSE_TILE, n - r0), nc = std::min(TRANSPOSE_TILE, n - c0);
+        if (i == j) {
+            matrix_kernels::transpose_square(nr, a + r0 * n + r0, n);
+        } else {
+            matrix_kernels::transpose_swap(nr, nc, a + r0 * n + c0, a + c0 * n + r0, n);
+        }
+    });
 }
 
-double Matrix::trace() const {
+template <typename T>
+T TypedMatrix<T>::trace() const {
     if (!isSquare()) throw std::logic_error("Trace on non-square matrix");
-    double s = 0.0;
-    for (size_t i = 0; i < rows_; i++) s += (*this)(i, i);
-    return s;
+    return reduce::sum(diagonal_view());
 }
 
-Matrix Matrix::diagonal() const {
+template <typename T>
+TypedMatrix<T> TypedMatrix<T>::diagonal() const {
     size_t n = (rows_ < cols_) ? rows_ : cols_;
-    Matrix r(n, 1);
+    TypedMatrix r(n, 1);
     for (size_t i = 0; i < n; i++) r(i, 0) = (*this)(i, i);
     return r;
 }
 
-void Matrix::fill(double value) {
-    for (double& v : data_) v = value;
+template <typename T>
+void TypedMatrix<T>::fill(T value) {
+    for (T& v : data_) v = value;
 }
 
-double Matrix::norm() const {
-    double s = 0.0;
-    for (double v : data_) s += v * v;
-    return std::sqrt(s);
+template <typename T>
+typename TypedMatrix<T>::real_type TypedMatrix<T>::norm() const {
+    return reduce::norm(*this);
 }
 
-Matrix Matrix::identity(size_t n) {
-    Matrix r(n, n, 0.0);
-    for (size_t i = 0; i < n; i++) r(i, i) = 1.0;
+template <typename T>
+T ConstMatrixView<T>::trace() const {
+    if (!isSquare()) throw std::logic_error("Trace on non-square matrix");
+    return reduce::sum(diagonal_view());
+}
+
+template <typename T>
+typename ConstMatrixView<T>::real_type ConstMatrixView<T>::norm() const {
+    return reduce::norm(*this);
+}
+
+template <typename T>
+TypedMatrix<T> TypedMatrix<T>::identity(size_t n) {
+    TypedMatrix r(n, n, T(0));
+    for (size_t i = 0; i < n; i++) r(i, i) = T(1);
     return r;
 }
 
-Matrix Matrix::zeros(size_t rows, size_t cols) {
-    return Matrix(rows, cols, 0.0);
+template <typename T>
+TypedMatrix<T> TypedMatrix<T>::zeros(size_t rows, size_t cols) {
+    return TypedMatrix(rows, cols, T(0));
 }
 
-Matrix Matrix::ones(size_t rows, size_t cols) {
-    return Matrix(rows, cols, 1.0);
+template <typename T>
+TypedMatrix<T> TypedMatrix<T>::ones(size_t rows, size_t cols) {
+    return TypedMatrix(rows, cols, T(1));
 }
 
-Matrix Matrix::diagonal(const std::vector<double>& diag) {
-    Matrix r(diag.size(), diag.size(), 0.0);
+template <typename T>
+TypedMatrix<T> TypedMatrix<T>::diagonal(const std::vector<T>& diag) {
+    TypedMatrix r(diag.size(), diag.size(), T(0));
     for (size_t i = 0; i < diag.size(); i++) r(i, i) = diag[i];
     return r;
 }
+
+#define INSTANTIATE_MATRIX(T) \
+    template class TypedMatrix<T>; \
+    template T ConstMatrixView<T>::trace() const; \
+    template typename ConstMatrixView<T>::real_type ConstMatrixView<T>::norm() const; \
+    template void gemm<T>(T, const TypedMatrix<T>&, const TypedMatrix<T>&, T, TypedMatrix<T>&); \
+    template void gemm<T>(T, ConstMatrixView<T>, ConstMatrixView<T>, T, MatrixView<T>); \
+    template void add_into<T>(TypedMatrix<T>&, const TypedMatrix<T>&, const TypedMatrix<T>&); \
+    template void subtract_into<T>(TypedMatrix<T>&, const TypedMatrix<T>&, const TypedMatrix<T>&); \
+    template void scale_into<T>(TypedMatrix<T>&, T, const TypedMatrix<T>&);
+
+INSTANTIATE_MATRIX(float)
+INSTANTIATE_MATRIX(double)
+INSTANTIATE_MATRIX(int32_t)
+INSTANTIATE_MATRIX(int64_t)
@@ -6,66 +6,422 @@
 #include <stdexcept>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "aligned_allocator.h"
+#include "matrix_expr.h"
+#include "matrix_view.h"
+#include "thread_pool.h"
 
-class Matrix {
+// Per element type constants. epsilon is the tolerance used by == and by the
+// division-by-zero check; real_type is what norm() returns.
+template <typename T>
+struct MatrixTraits;
+
+template <>
+struct MatrixTraits<double> {
+    static constexpr double epsilon = 1e-9;
+    typedef double real_type;
+};
+
+template <>
+struct MatrixTraits<float> {
+    static constexpr float epsilon = 1e-5f;
+    typedef float real_type;
+};
+
+template <>
+struct MatrixTraits<int32_t> {
+    static constexpr int32_t epsilon = 0;
+    typedef double real_type;
+};
+
+template <>
+struct MatrixTraits<int64_t> {
+    static constexpr int64_t epsilon = 0;
+    typedef double real_type;
+};
+
+// False only when a and b differ by more than the element type's epsilon, so
+// pairs whose difference is NaN, such as equal infinities, count as equal.
+template <typename T>
+bool nearly_equal(T a, T b) {
+    if (std::is_integral<T>::value) return a == b;
+    return !(std::fabs(a - b) > MatrixTraits<T>::epsilon);
+}
+
+// True when x is within the element type's epsilon of zero; NaN is not.
+template <typename T>
+bool nearly_zero(T x) {
+    if (std::is_integral<T>::value) return x == T(0);
+    return std::fabs(x) <= MatrixTraits<T>::epsilon;
+}
+
+// Dense row-major matrix of float, double, int32_t or int64_t. The member
+// definitions live in matrix.cc and are instantiated for those four types.
+template <typename T>
+class TypedMatrix : public MatrixExpr<TypedMatrix<T>> {
 private:
-    std::vector<double> data_;
+    std::vector<T, AlignedAllocator<T>> data_;
     size_t rows_;
     size_t cols_;
-    static constexpr double EPSILON = 1e-9;
 
     size_t idx(size_t row, size_t col) const {
         return row * cols_ + col;
     }
 
+    // Writes every element of a same-shaped expression into this matrix.
+    template <typename E>
+    void evaluate(const E& e);
+
+    static TypedMatrix product(ConstMatrixView<T> a, ConstMatrixView<T> b);
+
+    template <typename L, typename R>
+    friend TypedMatrix<typename L::value_type> operator*(const MatrixExpr<L>& a, const MatrixExpr<R>& b);
+
 public:
-    Matrix();
-    Matrix(size_t rows, size_t cols);
-    Matrix(size_t rows, size_t cols, double value);
-    Matrix(std::initializer_list<std::initializer_list<double>> list);
-    Matrix(const Matrix& other);
+    typedef T value_type;
+    typedef typename MatrixTraits<T>::real_type real_type;
+    static constexpr bool contiguous = true;
+
+    static constexpr T EPSILON = MatrixTraits<T>::epsilon;
+    // Element count below which elementwise work stays on the calling thread.
+    static constexpr size_t ELEMENTWISE_GRAIN = 1 << 15;
+
+    TypedMatrix();
+    TypedMatrix(size_t rows, size_t cols);
+    TypedMatrix(size_t rows, size_t cols, T value);
+    TypedMatrix(std::initializer_list<std::initializer_list<T>> list);
+    TypedMatrix(const TypedMatrix& other);
+    TypedMatrix(TypedMatrix&& other) noexcept;
 
-    Matrix& operator=(const Matrix& other);
+    template <typename E>
+    TypedMatrix(const MatrixExpr<E>& expr);
 
-    double& operator()(size_t row, size_t col);
-    const double& operator()(size_t row, size_t col) const;
+    TypedMatrix& operator=(const TypedMatrix& other);
+    TypedMatrix& operator=(TypedMatrix&& other) noexcept;
 
-    double& at(size_t row, size_t col);
-    const double& at(size_t row, size_t col) const;
+    template <typename E>
+    TypedMatrix& operator=(const MatrixExpr<E>& expr);
+
+    T& operator()(size_t row, size_t col);
+    const T& operator()(size_t row, size_t col) const;
+
+    T& at(size_t row, size_t col);
+    const T& at(size_t row, size_t col) const;
 
     size_t rows() const;
     size_t cols() const;
     bool isEmpty() const;
     bool isSquare() const;
 
-    Matrix operator+(const Matrix& other) const;
-    Matrix operator-(const Matrix& other) const;
-    Matrix operator*(const Matrix& other) const;
+    T flat(size_t i) const { return data_[i]; }
+    bool view_overlaps(ConstMatrixView<T>) const { return false; }
 
-    Matrix operator*(double scalar) const;
-    friend Matrix operator*(double scalar, const Matrix& m);
+    // Row-major element storage, aligned to 64 bytes.
+    T* data() { return data_.data(); }
+    const T* data() const { return data_.data(); }
 
-    Matrix operator/(double scalar) const;
-    Matrix operator-() const;
+    template <typename E>
+    TypedMatrix& operator+=(const MatrixExpr<E>& other);
+    template <typename E>
+    TypedMatrix& operator-=(const MatrixExpr<E>& other);
+    TypedMatrix& operator*=(T scalar);
+    TypedMatrix& operator/=(T scalar);
 
-    Matrix& operator+=(const Matrix& other);
-    Matrix& operator-=(const Matrix& other);
-    Matrix& operator*=(double scalar);
-    Matrix& operator/=(double scalar);
+    // Views share this matrix's storage; see matrix_view.h.
+    MatrixView<T> block(size_t r0, size_t c0, size_t nr, size_t nc) {
+        return MatrixView<T>(*this).block(r0, c0, nr, nc);
+    }
+    ConstMatrixView<T> block(size_t r0, size_t c0, size_t nr, size_t nc) const {
+        return ConstMatrixView<T>(*this).block(r0, c0, nr, nc);
+    }
+    MatrixView<T> row(size_t i) { return block(i, 0, 1, cols_); }
+    ConstMatrixView<T> row(size_t i) const { return block(i, 0, 1, cols_); }
+    MatrixView<T> col(size_t j) { return block(0, j, rows_, 1); }
+    ConstMatrixView<T> col(size_t j) const { return block(0, j, rows_, 1); }
+    MatrixView<T> transpose_view() { return MatrixView<T>(*this).transpose_view(); }
+    ConstMatrixView<T> transpose_view() const { return ConstMatrixView<T>(*this).transpose_view(); }
+    MatrixView<T> diagonal_view() { return MatrixView<T>(*this).diagonal_view(); }
+    ConstMatrixView<T> diagonal_view() const { return ConstMatrixView<T>(*this).diagonal_view(); }
 
-    bool operator==(const Matrix& other) const;
-    bool operator!=(const Matrix& other) const;
+    TypedMatrix transpose() const;
+    // Square matrices are transposed in their own storage without allocating;
+    // other shapes go through transpose() and swap their dimensions.
+    void transpose_in_place();
+    T trace() const;
+    TypedMatrix diagonal() const;
+    void fill(T value);
+    // Frobenius norm, safe from overflow and underflow. reduce.h has the
+    // other reductions.
+    real_type norm() const;
 
-    Matrix transpose() const;
-    double trace() const;
-    Matrix diagonal() const;
-    void fill(double value);
-    double norm() const;
+    static TypedMatrix identity(size_t n);
+    static TypedMatrix zeros(size_t rows, size_t cols);
+    static TypedMatrix ones(size_t rows, size_t cols);
+    static TypedMatrix diagonal(const std::vector<T>& diag);
 
-    static Matrix identity(size_t n);
-    static Matrix zeros(size_t rows, size_t cols);
-    static Matrix ones(size_t rows, size_t cols);
-    static Matrix diagonal(const std::vector<double>& diag);
+    // Binary file I/O; the format is described in matrix_file.h, which also
+    // has MappedMatrix for using a saved matrix without reading it in.
+    void save(const std::string& path) const;
+    static TypedMatrix load(const std::string& path);
 };
 
+typedef TypedMatrix<double> Matrix;
+
+/* In-place kernels ***********************************************************/
+
+// These write into a preallocated destination and never allocate, except
+// gemm when c is also one of its inputs. Each throws std::invalid_argument
+// if c does not already have the shape of the result.
+
+// c = alpha * a * b + beta * c
+template <typename T>
+void gemm(T alpha, const TypedMatrix<T>& a, const TypedMatrix<T>& b, T beta, TypedMatrix<T>& c);
+// The same on views; T is taken from alpha so matrices convert implicitly.
+// Overlap between c and an input is detected and handled as above.
+template <typename T>
+void gemm(T alpha, typename matrix_view::Nondeduced<ConstMatrixView<T>>::type a,
+          typename matrix_view::Nondeduced<ConstMatrixView<T>>::type b,
+          T beta, typename matrix_view::Nondeduced<MatrixView<T>>::type c);
+// c = a + b
+template <typename T>
+void add_into(TypedMatrix<T>& c, const TypedMatrix<T>& a, const TypedMatrix<T>& b);
+// c = a - b
+template <typename T>
+void subtract_into(TypedMatrix<T>& c, const TypedMatrix<T>& a, const TypedMatrix<T>& b);
+// c = alpha * a
+template <typename T>
+void scale_into(TypedMatrix<T>& c, T alpha, const TypedMatrix<T>& a);
+
+/* Elementwise operators build lazy expressions (see matrix_expr.h) ***********/
+
+template <typename L, typename R>
+matrix_expr::Binary<L, R, matrix_expr::Add> operator+(const MatrixExpr<L>& a, const MatrixExpr<R>& b) {
+    return matrix_expr::Binary<L, R, matrix_expr::Add>(a.self(), b.self());
+}
+
+template <typename L, typename R>
+matrix_expr::Binary<L, R, matrix_expr::Sub> operator-(const MatrixExpr<L>& a, const MatrixExpr<R>& b) {
+    return matrix_expr::Binary<L, R, matrix_expr::Sub>(a.self(), b.self());
+}
+
+template <typename E>
+matrix_expr::Negate<E> operator-(const MatrixExpr<E>& e) {
+    return matrix_expr::Negate<E>(e.self());
+}
+
+template <typename E>
+matrix_expr::Scalar<E, matrix_expr::Mul> operator*(const MatrixExpr<E>& e, typename E::value_type scalar) {
+    return matrix_expr::Scalar<E, matrix_expr::Mul>(e.self(), scalar);
+}
+
+template <typename E>
+matrix_expr::Scalar<E, matrix_expr::Mul> operator*(typename E::value_type scalar, const MatrixExpr<E>& e) {
+    return matrix_expr::Scalar<E, matrix_expr::Mul>(e.self(), scalar);
+}
+
+template <typename E>
+matrix_expr::Scalar<E, matrix_expr::Div> operator/(const MatrixExpr<E>& e, typename E::value_type scalar) {
+    if (nearly_zero(scalar)) throw std::invalid_argument("Division by zero");
+    return matrix_expr::Scalar<E, matrix_expr::Div>(e.self(), scalar);
+}
+
+// Operators taking an expiring matrix compute into its buffer, so
+// std::move(a) + b or (a * b) + c allocates nothing.
+template <typename T, typename R>
+TypedMatrix<T> operator+(TypedMatrix<T>&& a, const MatrixExpr<R>& b) {
+    a += b;
+    return std::move(a);
+}
+
+template <typename L, typename T>
+TypedMatrix<T> operator+(const MatrixExpr<L>& a, TypedMatrix<T>&& b) {
+    b = a + b;
+    return std::move(b);
+}
+
+template <typename T>
+TypedMatrix<T> operator+(TypedMatrix<T>&& a, TypedMatrix<T>&& b) {
+    a += b;
+    return std::move(a);
+}
+
+template <typename T, typename R>
+TypedMatrix<T> operator-(TypedMatrix<T>&& a, const MatrixExpr<R>& b) {
+    a -= b;
+    return std::move(a);
+}
+
+template <typename L, typename T>
+TypedMatrix<T> operator-(const MatrixExpr<L>& a, TypedMatrix<T>&& b) {
+    b = a - b;
+    return std::move(b);
+}
+
+template <typename T>
+TypedMatrix<T> operator-(TypedMatrix<T>&& a, TypedMatrix<T>&& b) {
+    a -= b;
+    return std::move(a);
+}
+
+template <typename T>
+TypedMatrix<T> operator-(TypedMatrix<T>&& a) {
+    a = -a;
+    return std::move(a);
+}
+
+template <typename T>
+TypedMatrix<T> operator*(TypedMatrix<T>&& a, typename TypedMatrix<T>::value_type scalar) {
+    a *= scalar;
+    return std::move(a);
+}
+
+template <typename T>
+TypedMatrix<T> operator*(typename TypedMatrix<T>::value_type scalar, TypedMatrix<T>&& a) {
+    a *= scalar;
+    return std::move(a);
+}
+
+template <typename T>
+TypedMatrix<T> operator/(TypedMatrix<T>&& a, typename TypedMatrix<T>::value_type scalar) {
+    a /= scalar;
+    return std::move(a);
+}
+
+// The matrix product is not elementwise, so operands that are expressions are
+// evaluated first and the result is an ordinary matrix. Matrices and views are
+// passed to the kernel in place through their strides.
+template <typename T>
+const TypedMatrix<T>& evaluated(const TypedMatrix<T>& m) {
+    return m;
+}
+
+template <typename T>
+const ConstMatrixView<T>& evaluated(const ConstMatrixView<T>& v) {
+    return v;
+}
+
+template <typename T>
+const MatrixView<T>& evaluated(const MatrixView<T>& v) {
+    return v;
+}
+
+template <typename E>
+TypedMatrix<typename E::value_type> evaluated(const MatrixExpr<E>& e) {
+    return TypedMatrix<typename E::value_type>(e);
+}
+
+template <typename L, typename R>
+TypedMatrix<typename L::value_type> operator*(const MatrixExpr<L>& a, const MatrixExpr<R>& b) {
+    static_assert(std::is_same<typename L::value_type, typename R::value_type>::value,
+                  "Operands must have the same element type");
+    typedef typename L::value_type T;
+    const auto& x = evaluated(a.self());
+    const auto& y = evaluated(b.self());
+    return TypedMatrix<T>::product(ConstMatrixView<T>(x), ConstMatrixView<T>(y));
+}
+
+namespace reduce {
+
+// Vectorized comparison of stored elements; see reduce.h.
+template <typename T>
+bool equal(ConstMatrixView<T> a, ConstMatrixView<T> b);
+
+}
+
+template <typename L, typename R>
+bool operator==(const MatrixExpr<L>& a, const MatrixExpr<R>& b) {
+    typedef typename L::value_type T;
+    const L& x = a.self();
+    const R& y = b.self();
+    if (x.rows() != y.rows() || x.cols() != y.cols()) return false;
+    if constexpr (std::is_convertible<const L&, ConstMatrixView<T>>::value &&
+                  std::is_convertible<const R&, ConstMatrixView<T>>::value) {
+        // Both sides are stored: matrices, views or mapped matrices.
+        return reduce::equal<T>(x, y);
+    } else if constexpr (L::contiguous && R::contiguous) {
+        size_t n = x.rows() * x.cols();
+        for (size_t i = 0; i < n; i++) {
+            if (!nearly_equal(x.flat(i), y.flat(i))) return false;
+        }
+    } else {
+        for (size_t i = 0; i < x.rows(); i++)
+            for (size_t j = 0; j < x.cols(); j++)
+                if (!nearly_equal(x(i, j), y(i, j))) return false;
+    }
+    return true;
+}
+
+template <typename L, typename R>
+bool operator!=(const MatrixExpr<L>& a, const MatrixExpr<R>& b) {
+    return !(a == b);
+}
+
+/* Expression evaluation ******************************************************/
+
+template <typename T>
+template <typename E>
+void TypedMatrix<T>::evaluate(const E& e) {
+    T* out = data_.data();
+    if constexpr (E::contiguous) {
+        parallel::parallel_for(data_.size(), ELEMENTWISE_GRAIN, [&](size_t i0, size_t i1) {
+            for (size_t i = i0; i < i1; i++) out[i] = e.flat(i);
+        });
+    } else {
+        // Some leaf is a strided view, so walk by row and column instead.
+        size_t n = cols_;
+        size_t grain = n ? (ELEMENTWISE_GRAIN + n - 1) / n : 1;
+        parallel::parallel_for(rows_, grain, [&](size_t r0, size_t r1) {
+            for (size_t i = r0; i < r1; i++)
+                for (size_t j = 0; j < n; j++) out[i * n + j] = e(i, j);
+        });
+    }
+}
+
+template <typename T>
+template <typename E>
+TypedMatrix<T>::TypedMatrix(const MatrixExpr<E>& expr)
+    : data_(expr.self().rows() * expr.self().cols()),
+      rows_(expr.self().rows()), cols_(expr.self().cols()) {
+    static_assert(std::is_same<typename E::value_type, T>::value,
+                  "Expression element type does not match the matrix");
+    evaluate(expr.self());
+}
+
+template <typename T>
+template <typename E>
+TypedMatrix<T>& TypedMatrix<T>::operator=(const MatrixExpr<E>& expr) {
+    static_assert(std::is_same<typename E::value_type, T>::value,
+                  "Expression element type does not match the matrix");
+    const E& e = expr.self();
+    // A view of this matrix may read an element that has already been
+    // overwritten, or that resizing moves, so such expressions go through a
+    // temporary.
+    if constexpr (!E::contiguous) {
+        if (e.view_overlaps(ConstMatrixView<T>(*this))) return *this = TypedMatrix(e);
+    }
+    if (rows_ != e.rows() || cols_ != e.cols()) {
+        data_.resize(e.rows() * e.cols());
+        rows_ = e.rows();
+        cols_ = e.cols();
+    }
+    evaluate(e);
+    return *this;
+}
+
+template <typename T>
+template <typename E>
+TypedMatrix<T>& TypedMatrix<T>::operator+=(const MatrixExpr<E>& other) {
+    return *this = *this + other;
+}
+
+template <typename T>
+template <typename E>
+TypedMatrix<T>& TypedMatrix<T>::operator-=(const MatrixExpr<E>& other) {
+    return *this = *this - other;
+}
+
 #endif
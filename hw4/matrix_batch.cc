@@ -0,0 +1,397 @@
+#include "matrix_batch.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "thread_pool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BATCH_X86 1
+#endif
+
+namespace {
+
+// Lanes processed together by the vectorized kernels; their working set of a
+// few planes stays in L1.
+const size_t BLOCK = 64;
+
+template <typename T>
+void require_batch(const TypedMatrixBatch<T>& m, size_t count, size_t rows, size_t cols) {
+    if (m.count() != count || m.rows() != rows || m.cols() != cols) {
+        throw std::invalid_argument("Dimension mismatch");
+    }
+}
+
+// Calls fn(l0, l1) on ranges of whole lane groups, in parallel once the batch
+// holds enough work. work is the number of operations per matrix.
+template <typename T, typename F>
+void for_each_lanes(const TypedMatrixBatch<T>& m, size_t work, F fn) {
+    const size_t w = TypedMatrixBatch<T>::LANE_ALIGN;
+    size_t groups = m.stride() / w;
+    size_t grain = std::max<size_t>(1, Matrix::ELEMENTWISE_GRAIN / (w * std::max<size_t>(work, 1)));
+    parallel::parallel_for(groups, grain, [&](size_t g0, size_t g1) { fn(g0 * w, g1 * w); });
+}
+
+/* Vectorized bodies **********************************************************/
+
+// Each body loops over lanes innermost so the compiler maps lanes onto vector
+// registers. They are always inlined into the wrappers below, which compile
+// them for a specific instruction set.
+
+template <typename T>
+__attribute__((always_inline)) inline
+void multiply_body(const T* a, const T* b, T* c, size_t stride,
+                   size_t rows, size_t inner, size_t cols, size_t l0, size_t l1) {
+    for (size_t s0 = l0; s0 < l1; s0 += BLOCK) {
+        size_t n = std::min(BLOCK, l1 - s0);
+        for (size_t i = 0; i < rows; i++) {
+            for (size_t j = 0; j < cols; j++) {
+                T acc[BLOCK];
+                const T* x = a + i * inner * stride + s0;
+                const T* y = b + j * stride + s0;
+                for (size_t l = 0; l < n; l++) acc[l] = x[l] * y[l];
+                for (size_t k = 1; k < inner; k++) {
+                    x = a + (i * inner + k) * stride + s0;
+                    y = b + (k * cols + j) * stride + s0;
+                    for (size_t l = 0; l < n; l++) acc[l] += x[l] * y[l];
+                }
+                std::copy(acc, acc + n, c + (i * cols + j) * stride + s0);
+            }
+        }
+    }
+}
+
+// Square N x N products for N <= 4, with every element of a lane's operands
+// held in registers. c must not alias a or b.
+template <typename T, int N>
+__attribute__((always_inline)) inline
+void multiply_fixed_body(const T* a, const T* b, T* c, size_t stride, size_t l0, size_t l1) {
+    for (size_t b0 = l0; b0 < l1; b0 += BLOCK) {
+        size_t n = std::min(BLOCK, l1 - b0);
+        T out[N * N][BLOCK];
+        for (size_t l = 0; l < n; l++) {
+            T x[N * N], y[N * N];
+            for (int k = 0; k < N * N; k++) {
+                x[k] = a[k * stride + b0 + l];
+                y[k] = b[k * stride + b0 + l];
+            }
+            for (int i = 0; i < N; i++)
+                for (int j = 0; j < N; j++) {
+                    T acc = x[i * N] * y[j];
+                    for (int k = 1; k < N; k++) acc += x[i * N + k] * y[k * N + j];
+                    out[i * N + j][l] = acc;
+                }
+        }
+        for (int k = 0; k < N * N; k++) std::copy(out[k], out[k] + n, c + k * stride + b0);
+    }
+}
+
+// Closed-form N x N inverses for N <= 4. Each lane reads its matrix into
+// registers and writes the inverse to a scratch block before it is copied
+// out, so the output may alias the input. Returns the number of lanes below
+// limit with a zero determinant; those lanes get a zero matrix.
+template <typename T, int N>
+__attribute__((always_inline)) inline
+size_t inverse_body(const T* a, T* c, size_t stride, size_t limit, size_t l0, size_t l1) {
+    size_t singular = 0;
+    for (size_t b0 = l0; b0 < l1; b0 += BLOCK) {
+        size_t n = std::min(BLOCK, l1 - b0);
+        T out[N * N][BLOCK];
+        for (size_t l = 0; l < n; l++) {
+            T m[N * N], r[N * N];
+            for (int k = 0; k < N * N; k++) m[k] = a[k * stride + b0 + l];
+            T det;
+            if constexpr (N == 1) {
+                r[0] = T(1);
+                det = m[0];
+            } else if constexpr (N == 2) {
+                r[0] = m[3];
+                r[1] = -m[1];
+                r[2] = -m[2];
+                r[3] = m[0];
+                det = m[0] * m[3] - m[1] * m[2];
+            } else if constexpr (N == 3) {
+                r[0] = m[4] * m[8] - m[5] * m[7];
+                r[1] = m[2] * m[7] - m[1] * m[8];
+                r[2] = m[1] * m[5] - m[2] * m[4];
+                r[3] = m[5] * m[6] - m[3] * m[8];
+                r[4] = m[0] * m[8] - m[2] * m[6];
+                r[5] = m[2] * m[3] - m[0] * m[5];
+                r[6] = m[3] * m[7] - m[4] * m[6];
+                r[7] = m[1] * m[6] - m[0] * m[7];
+                r[8] = m[0] * m[4] - m[1] * m[3];
+                det = m[0] * r[0] + m[1] * r[3] + m[2] * r[6];
+            } else {
+                // 2 x 2 minors of the top two rows (s) and the bottom two (t).
+                T s0 = m[0] * m[5] - m[4] * m[1], s1 = m[0] * m[6] - m[4] * m[2];
+                T s2 = m[0] * m[7] - m[4] * m[3], s3 = m[1] * m[6] - m[5] * m[2];
+                T s4 = m[1] * m[7] - m[5] * m[3], s5 = m[2] * m[7] - m[6] * m[3];
+                T t5 = m[10] * m[15] - m[14] * m[11], t4 = m[9] * m[15] - m[13] * m[11];
+                T t3 = m[9] * m[14] - m[13] * m[10], t2 = m[8] * m[15] - m[12] * m[11];
+                T t1 = m[8] * m[14] - m[12] * m[10], t0 = m[8] * m[13] - m[12] * m[9];
+                r[0] = m[5] * t5 - m[6] * t4 + m[7] * t3;
+                r[1] = -m[1] * t5 + m[2] * t4 - m[3] * t3;
+                r[2] = m[13] * s5 - m[14] * s4 + m[15] * s3;
+                r[3] = -m[9] * s5 + m[10] * s4 - m[11] * s3;
+                r[4] = -m[4] * t5 + m[6] * t2 - m[7] * t1;
+                r[5] = m[0] * t5 - m[2] * t2 + m[3] * t1;
+                r[6] = -m[12] * s5 + m[14] * s2 - m[15] * s1;
+                r[7] = m[8] * s5 - m[10] * s2 + m[11] * s1;
+                r[8] = m[4] * t4 - m[5] * t2 + m[7] * t0;
+                r[9] = -m[0] * t4 + m[1] * t2 - m[3] * t0;
+                r[10] = m[12] * s4 - m[13] * s2 + m[15] * s0;
+                r[11] = -m[8] * s4 + m[9] * s2 - m[11] * s0;
+                r[12] = -m[4] * t3 + m[5] * t1 - m[6] * t0;
+                r[13] = m[0] * t3 - m[1] * t1 + m[2] * t0;
+                r[14] = -m[12] * s3 + m[13] * s1 - m[14] * s0;
+                r[15] = m[8] * s3 - m[9] * s1 + m[10] * s0;
+                det = s0 * t5 - s1 * t4 + s2 * t3 + s3 * t2 - s4 * t1 + s5 * t0;
+            }
+            T inv = det == T(0) ? T(0) : T(1) / det;
+            singular += (det == T(0)) & (b0 + l < limit);
+            for (int k = 0; k < N * N; k++) out[k][l] = r[k] * inv;
+        }
+        for (int k = 0; k < N * N; k++) std::copy(out[k], out[k] + n, c + k * stride + b0);
+    }
+    return singular;
+}
+
+template <typename T>
+struct Kernels {
+    void (*multiply)(const T*, const T*, T*, size_t, size_t, size_t, size_t, size_t, size_t);
+    void (*multiply_square[4])(const T*, const T*, T*, size_t, size_t, size_t);
+    size_t (*inverse[4])(const T*, T*, size_t, size_t, size_t, size_t);
+};
+
+template <typename T>
+void multiply_default(const T* a, const T* b, T* c, size_t stride,
+                      size_t rows, size_t inner, size_t cols, size_t l0, size_t l1) {
+    multiply_body(a, b, c, stride, rows, inner, cols, l0, l1);
+}
+
+template <typename T, int N>
+void multiply_square_default(const T* a, const T* b, T* c, size_t stride, size_t l0, size_t l1) {
+    multiply_fixed_body<T, N>(a, b, c, stride, l0, l1);
+}
+
+template <typename T, int N>
+size_t inverse_default(const T* a, T* c, size_t stride, size_t limit, size_t l0, size_t l1) {
+    return inverse_body<T, N>(a, c, stride, limit, l0, l1);
+}
+
+#ifdef BATCH_X86
+
+template <typename T>
+__attribute__((target("avx2,fma")))
+void multiply_avx2(const T* a, const T* b, T* c, size_t stride,
+                   size_t rows, size_t inner, size_t cols, size_t l0, size_t l1) {
+    multiply_body(a, b, c, stride, rows, inner, cols, l0, l1);
+}
+
+template <typename T, int N>
+__attribute__((target("avx2,fma")))
+void multiply_square_avx2(const T* a, const T* b, T* c, size_t stride, size_t l0, size_t l1) {
+    multiply_fixed_body<T, N>(a, b, c, stride, l0, l1);
+}
+
+template <typename T, int N>
+__attribute__((target("avx2,fma")))
+size_t inverse_avx2(const T* a, T* c, size_t stride, size_t limit, size_t l0, size_t l1) {
+    return inverse_body<T, N>(a, c, stride, limit, l0, l1);
+}
+
+#endif
+
+// Picks the widest build of the kernels the CPU supports, once per type.
+template <typename T>
+const Kernels<T>& select_kernels() {
+    static const Kernels<T> chosen = [] {
+#ifdef BATCH_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            return Kernels<T>{multiply_avx2<T>,
+                              {multiply_square_avx2<T, 1>, multiply_square_avx2<T, 2>,
+                               multiply_square_avx2<T, 3>, multiply_square_avx2<T, 4>},
+                              {inverse_avx2<T, 1>, inverse_avx2<T, 2>, inverse_avx2<T, 3>, inverse_avx2<T, 4>}};
+        }
+#endif
+        return Kernels<T>{multiply_default<T>,
+                          {multiply_square_default<T, 1>, multiply_square_default<T, 2>,
+                           multiply_square_default<T, 3>, multiply_square_default<T, 4>},
+                          {inverse_default<T, 1>, inverse_default<T, 2>, inverse_default<T, 3>, inverse_default<T, 4>}};
+    }();
+    return chosen;
+}
+
+// Inverts the matrices in lanes [l0, l1) by Gauss-Jordan elimination on
+// [A | I]; returns how many of them are singular.
+template <typename T>
+size_t inverse_general(const TypedMatrixBatch<T>& a, TypedMatrixBatch<T>& c, size_t l0, size_t l1) {
+    size_t n = a.rows(), w = 2 * n, singular = 0;
+    std::vector<T> aug(n * w);
+    for (size_t l = l0; l < l1; l++) {
+        for (size_t i = 0; i < n; i++)
+            for (size_t j = 0; j < n; j++) {
+                aug[i * w + j] = a(l, i, j);
+                aug[i * w + n + j] = T(i == j);
+            }
+        bool ok = true;
+        for (size_t k = 0; k < n && ok; k++) {
+            size_t p = k;
+            for (size_t i = k + 1; i < n; i++)
+                if (std::fabs(aug[i * w + k]) > std::fabs(aug[p * w + k])) p = i;
+            if (aug[p * w + k] == T(0)) {
+                ok = false;
+                break;
+            }
+            if (p != k) std::swap_ranges(&aug[k * w], &aug[k * w] + w, &aug[p * w]);
+            T inv = T(1) / aug[k * w + k];
+            for (size_t j = 0; j < w; j++) aug[k * w + j] *= inv;
+            for (size_t i = 0; i < n; i++) {
+                T f = aug[i * w + k];
+                if (i == k || f == T(0)) continue;
+                for (size_t j = 0; j < w; j++) aug[i * w + j] -= f * aug[k * w + j];
+            }
+        }
+        if (!ok) {
+            singular++;
+            continue;
+        }
+        for (size_t i = 0; i < n; i++)
+            for (size_t j = 0; j < n; j++) c(l, i, j) = aug[i * w + n + j];
+    }
+    return singular;
+}
+
+}
+
+template <typename T>
+TypedMatrix<T> TypedMatrixBatch<T>::get(size_t n) const {
+    if (n >= count_) throw std::out_of_range("Out of range");
+    TypedMatrix<T> m(rows_, cols_);
+    for (size_t i = 0; i < rows_; i++)
+        for (size_t j = 0; j < cols_; j++) m(i, j) = (*this)(n, i, j);
+    return m;
+}
+
+template <typename T>
+void TypedMatrixBatch<T>::set(size_t n, const TypedMatrix<T>& m) {
+    if (n >= count_) throw std::out_of_range("Out of range");
+    if (m.rows() != rows_ || m.cols() != cols_) throw std::invalid_argument("Dimension mismatch");
+    for (size_t i = 0; i < rows_; i++)
+        for (size_t j = 0; j < cols_; j++) (*this)(n, i, j) = m(i, j);
+}
+
+template <typename T>
+TypedMatrixBatch<T> TypedMatrixBatch<T>::transpose() const {
+    TypedMatrixBatch r(count_, cols_, rows_);
+    transpose_into(r, *this);
+    return r;
+}
+
+template <typename T>
+std::vector<typename TypedMatrixBatch<T>::real_type> TypedMatrixBatch<T>::norm() const {
+    std::vector<real_type> out(count_);
+    size_t planes = rows_ * cols_;
+    for_each_lanes(*this, planes, [&](size_t l0, size_t l1) {
+        l1 = std::min(l1, count_);
+        if (l0 >= l1) return;
+        real_type* o = out.data();
+        std::fill(o + l0, o + l1, real_type(0));
+        for (size_t p = 0; p < planes; p++) {
+            const T* x = data_.data() + p * stride_;
+            for (size_t l = l0; l < l1; l++) {
+                real_type v = static_cast<real_type>(x[l]);
+                o[l] += v * v;
+            }
+        }
+        for (size_t l = l0; l < l1; l++) o[l] = std::sqrt(o[l]);
+    });
+    return out;
+}
+
+template <typename T>
+void multiply_into(TypedMatrixBatch<T>& c, const TypedMatrixBatch<T>& a, const TypedMatrixBatch<T>& b) {
+    if (a.count() != b.count() || a.cols() != b.rows()) throw std::invalid_argument("Dimension mismatch");
+    require_batch(c, a.count(), a.rows(), b.cols());
+    if (a.rows() * a.cols() * b.cols() == 0) return;
+    const Kernels<T>& k = select_kernels<T>();
+    size_t n = a.rows();
+    bool square = a.isSquare() && b.isSquare() && n <= 4;
+    for_each_lanes(a, n * a.cols() * b.cols(), [&](size_t l0, size_t l1) {
+        if (square) {
+            k.multiply_square[n - 1](a.plane(0, 0), b.plane(0, 0), c.plane(0, 0), a.stride(), l0, l1);
+            return;
+        }
+        k.multiply(a.plane(0, 0), b.plane(0, 0), c.plane(0, 0), a.stride(),
+                   a.rows(), a.cols(), b.cols(), l0, l1);
+    });
+}
+
+template <typename T>
+void add_into(TypedMatrixBatch<T>& c, const TypedMatrixBatch<T>& a, const TypedMatrixBatch<T>& b) {
+    require_batch(b, a.count(), a.rows(), a.cols());
+    require_batch(c, a.count(), a.rows(), a.cols());
+    size_t n = a.rows() * a.cols() * a.stride();
+    if (n == 0) return;
+    const T* x = a.plane(0, 0);
+    const T* y = b.plane(0, 0);
+    T* z = c.plane(0, 0);
+    parallel::parallel_for(n, Matrix::ELEMENTWISE_GRAIN, [&](size_t i0, size_t i1) {
+        for (size_t i = i0; i < i1; i++) z[i] = x[i] + y[i];
+    });
+}
+
+template <typename T>
+void subtract_into(TypedMatrixBatch<T>& c, const TypedMatrixBatch<T>& a, const TypedMatrixBatch<T>& b) {
+    require_batch(b, a.count(), a.rows(), a.cols());
+    require_batch(c, a.count(), a.rows(), a.cols());
+    size_t n = a.rows() * a.cols() * a.stride();
+    if (n == 0) return;
+    const T* x = a.plane(0, 0);
+    const T* y = b.plane(0, 0);
+    T* z = c.plane(0, 0);
+    parallel::parallel_for(n, Matrix::ELEMENTWISE_GRAIN, [&](size_t i0, size_t i1) {
+        for (size_t i = i0; i < i1; i++) z[i] = x[i] - y[i];
+    });
+}
+
+template <typename T>
+void transpose_into(TypedMatrixBatch<T>& c, const TypedMatrixBatch<T>& a) {
+    require_batch(c, a.count(), a.cols(), a.rows());
+    // Transposing every matrix only renames the planes.
+    for (size_t i = 0; i < a.rows(); i++)
+        for (size_t j = 0; j < a.cols(); j++) std::copy(a.plane(i, j), a.plane(i, j) + a.stride(), c.plane(j, i));
+}
+
+template <typename T>
+void inverse_into(TypedMatrixBatch<T>& c, const TypedMatrixBatch<T>& a) {
+    if (!a.isSquare()) throw std::invalid_argument("Matrix is not square");
+    require_batch(c, a.count(), a.rows(), a.cols());
+    size_t n = a.rows();
+    if (n == 0 || a.count() == 0) return;
+    const Kernels<T>& k = select_kernels<T>();
+    std::atomic<size_t> singular(0);
+    for_each_lanes(a, n * n * n, [&](size_t l0, size_t l1) {
+        size_t s = n <= 4 ? k.inverse[n - 1](a.plane(0, 0), c.plane(0, 0), a.stride(), a.count(), l0, l1)
+                          : inverse_general(a, c, l0, std::min(l1, a.count()));
+        singular += s;
+    });
+    if (singular.load() != 0) throw std::runtime_error("Singular matrix");
+}
+
+#define INSTANTIATE_BATCH(T) \
+    template class TypedMatrixBatch<T>; \
+    template void multiply_into<T>(TypedMatrixBatch<T>&, const TypedMatrixBatch<T>&, const TypedMatrixBatch<T>&); \
+    template void add_into<T>(TypedMatrixBatch<T>&, const TypedMatrixBatch<T>&, const TypedMatrixBatch<T>&); \
+    template void subtract_into<T>(TypedMatrixBatch<T>&, const TypedMatrixBatch<T>&, const TypedMatrixBatch<T>&); \
+    template void transpose_into<T>(TypedMatrixBatch<T>&, const TypedMatrixBatch<T>&);
+
+INSTANTIATE_BATCH(float)
+INSTANTIATE_BATCH(double)
+INSTANTIATE_BATCH(int32_t)
+INSTANTIATE_BATCH(int64_t)
+
+template void inverse_into<float>(TypedMatrixBatch<float>&, const TypedMatrixBatch<float>&);
+template void inverse_into<double>(TypedMatrixBatch<double>&, const TypedMatrixBatch<double>&);
@@ -0,0 +1,156 @@
+#ifndef MATRIX_BATCH_H
+#define MATRIX_BATCH_H
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include "aligned_allocator.h"
+#include "matrix.h"
+#include "static_matrix.h"
+
+// A batch of count() small matrices of the same rows() x cols() shape stored
+// structure-of-arrays: element (i, j) of every matrix sits in one contiguous,
+// 64-byte aligned plane, so lane n of plane (i, j) is element (i, j) of
+// matrix n. Batched operations run one matrix per vector lane and split the
+// batch across threads. The lanes of each plane are padded to a multiple of
+// LANE_ALIGN; padding lanes are zero and never affect results.
+//
+// The out-of-line operations live in matrix_batch.cc and are instantiated for
+// float, double, int32_t and int64_t (inverse for float and double only).
+template <typename T>
+class TypedMatrixBatch {
+private:
+    std::vector<T, AlignedAllocator<T>> data_;
+    size_t count_;
+    size_t rows_;
+    size_t cols_;
+    size_t stride_;
+
+public:
+    typedef T value_type;
+    typedef typename MatrixTraits<T>::real_type real_type;
+
+    static constexpr size_t LANE_ALIGN = 64 / sizeof(T);
+
+    TypedMatrixBatch() : count_(0), rows_(0), cols_(0), stride_(0) {}
+    TypedMatrixBatch(size_t count, size_t rows, size_t cols)
+        : data_(rows * cols * padded(count), T(0)), count_(count), rows_(rows), cols_(cols),
+          stride_(padded(count)) {}
+    // count copies of m.
+    TypedMatrixBatch(size_t count, const TypedMatrix<T>& m) : TypedMatrixBatch(count, m.rows(), m.cols()) {
+        for (size_t i = 0; i < rows_; i++)
+            for (size_t j = 0; j < cols_; j++) std::fill(plane(i, j), plane(i, j) + count_, m(i, j));
+    }
+
+    size_t count() const { return count_; }
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+    bool isSquare() const { return rows_ == cols_; }
+    // Distance between consecutive planes, in elements.
+    size_t stride() const { return stride_; }
+
+    T* plane(size_t i, size_t j) { return data_.data() + (i * cols_ + j) * stride_; }
+    const T* plane(size_t i, size_t j) const { return data_.data() + (i * cols_ + j) * stride_; }
+
+    // Element (i, j) of matrix n.
+    T& operator()(size_t n, size_t i, size_t j) { return plane(i, j)[n]; }
+    const T& operator()(size_t n, size_t i, size_t j) const { return plane(i, j)[n]; }
+
+    T& at(size_t n, size_t i, size_t j) {
+        if (n >= count_ || i >= rows_ || j >= cols_) throw std::out_of_range("Out of range");
+        return (*this)(n, i, j);
+    }
+    const T& at(size_t n, size_t i, size_t j) const {
+        if (n >= count_ || i >= rows_ || j >= cols_) throw std::out_of_range("Out of range");
+        return (*this)(n, i, j);
+    }
+
+    // Gather and scatter single matrices; shapes must match.
+    TypedMatrix<T> get(size_t n) const;
+    void set(size_t n, const TypedMatrix<T>& m);
+
+    template <size_t R, size_t C>
+    StaticMatrix<R, C, T> get_static(size_t n) const {
+        if (R != rows_ || C != cols_) throw std::invalid_argument("Dimension mismatch");
+        StaticMatrix<R, C, T> m;
+        for (size_t i = 0; i < R; i++)
+            for (size_t j = 0; j < C; j++) m(i, j) = (*this)(n, i, j);
+        return m;
+    }
+
+    template <size_t R, size_t C>
+    void set(size_t n, const StaticMatrix<R, C, T>& m) {
+        if (R != rows_ || C != cols_) throw std::invalid_argument("Dimension mismatch");
+        for (size_t i = 0; i < R; i++)
+            for (size_t j = 0; j < C; j++) (*this)(n, i, j) = m(i, j);
+    }
+
+    TypedMatrixBatch transpose() const;
+    // Frobenius norm of each matrix.
+    std::vector<real_type> norm() const;
+
+    static size_t padded(size_t count) { return (count + LANE_ALIGN - 1) / LANE_ALIGN * LANE_ALIGN; }
+};
+
+typedef TypedMatrixBatch<double> MatrixBatch;
+
+/* Batched kernels ************************************************************/
+
+// Like the Matrix in-place kernels these write into a preallocated c, which
+// must already have the count and shape of the result, and throw
+// std::invalid_argument otherwise. c may be one of the inputs of
+// add_into, subtract_into and inverse_into, but not of multiply_into or
+// transpose_into.
+
+// c[n] = a[n] * b[n]
+template <typename T>
+void multiply_into(TypedMatrixBatch<T>& c, const TypedMatrixBatch<T>& a, const TypedMatrixBatch<T>& b);
+// c[n] = a[n] + b[n]
+template <typename T>
+void add_into(TypedMatrixBatch<T>& c, const TypedMatrixBatch<T>& a, const TypedMatrixBatch<T>& b);
+// c[n] = a[n] - b[n]
+template <typename T>
+void subtract_into(TypedMatrixBatch<T>& c, const TypedMatrixBatch<T>& a, const TypedMatrixBatch<T>& b);
+// c[n] = a[n]^T
+template <typename T>
+void transpose_into(TypedMatrixBatch<T>& c, const TypedMatrixBatch<T>& a);
+// c[n] = a[n]^-1 for square a. Matrices up to 4 x 4 use closed-form cofactor
+// inverses vectorized across the batch; larger ones Gauss-Jordan elimination
+// with partial pivoting, one matrix at a time. Throws
+// std::runtime_error("Singular matrix") if any matrix has a zero determinant
+// (or pivot), leaving c unspecified.
+template <typename T>
+void inverse_into(TypedMatrixBatch<T>& c, const TypedMatrixBatch<T>& a);
+
+template <typename T>
+TypedMatrixBatch<T> operator*(const TypedMatrixBatch<T>& a, const TypedMatrixBatch<T>& b) {
+    TypedMatrixBatch<T> c(a.count(), a.rows(), b.cols());
+    multiply_into(c, a, b);
+    return c;
+}
+
+template <typename T>
+TypedMatrixBatch<T> operator+(const TypedMatrixBatch<T>& a, const TypedMatrixBatch<T>& b) {
+    TypedMatrixBatch<T> c(a.count(), a.rows(), a.cols());
+    add_into(c, a, b);
+    return c;
+}
+
+template <typename T>
+TypedMatrixBatch<T> operator-(const TypedMatrixBatch<T>& a, const TypedMatrixBatch<T>& b) {
+    TypedMatrixBatch<T> c(a.count(), a.rows(), a.cols());
+    subtract_into(c, a, b);
+    return c;
+}
+
+template <typename T>
+TypedMatrixBatch<T> inverse(const TypedMatrixBatch<T>& a) {
+    static_assert(std::is_floating_point<T>::value, "inverse needs a floating-point batch");
+    TypedMatrixBatch<T> c(a.count(), a.rows(), a.cols());
+    inverse_into(c, a);
+    return c;
+}
+
+#endif
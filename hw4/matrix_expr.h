@@ -0,0 +1,108 @@
+#ifndef MATRIX_EXPR_H
+#define MATRIX_EXPR_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+
+// Lazy elementwise expressions over TypedMatrix and its views. An expression
+// such as A + B * 2.0 - C builds a small tree of nodes that holds references to its
+// leaves; nothing is computed until the tree is assigned to a matrix, used to
+// construct one or passed to += / -=, which then run a single fused loop.
+//
+// Nodes hold their child nodes by value and matrix leaves by reference, so an
+// expression must not outlive the matrices it was built from. Keep results in
+// a matrix rather than in an auto variable.
+
+template <typename T>
+class TypedMatrix;
+
+template <typename T>
+class ConstMatrixView;
+
+// Base class for everything that can appear in an elementwise expression.
+// E must provide value_type, rows(), cols(), operator()(row, col), a
+// contiguous flag and view_overlaps(v), which is true when a view leaf shares
+// an element with the view v. Dense leaves never count: one is either the
+// matrix being assigned, read only at the element being written, or other
+// storage. When contiguous is true every leaf is a dense row-major matrix
+// and E also provides flat(i), the i-th element in row-major order.
+template <typename E>
+class MatrixExpr {
+public:
+    const E& self() const { return static_cast<const E&>(*this); }
+};
+
+namespace matrix_expr {
+
+template <typename E>
+struct Storage { typedef const E type; };
+
+template <typename T>
+struct Storage<TypedMatrix<T>> { typedef const TypedMatrix<T>& type; };
+
+struct Add { template <typename T> static T apply(T a, T b) { return a + b; } };
+struct Sub { template <typename T> static T apply(T a, T b) { return a - b; } };
+struct Mul { template <typename T> static T apply(T a, T b) { return a * b; } };
+struct Div { template <typename T> static T apply(T a, T b) { return a / b; } };
+
+template <typename L, typename R, typename Op>
+class Binary : public MatrixExpr<Binary<L, R, Op>> {
+    static_assert(std::is_same<typename L::value_type, typename R::value_type>::value,
+                  "Operands must have the same element type");
+public:
+    typedef typename L::value_type value_type;
+    static constexpr bool contiguous = L::contiguous && R::contiguous;
+
+    Binary(const L& l, const R& r) : l_(l), r_(r) {
+        if (l.rows() != r.rows() || l.cols() != r.cols()) {
+            throw std::invalid_argument("Dimension mismatch");
+        }
+    }
+    size_t rows() const { return l_.rows(); }
+    size_t cols() const { return l_.cols(); }
+    value_type flat(size_t i) const { return Op::apply(l_.flat(i), r_.flat(i)); }
+    value_type operator()(size_t row, size_t col) const { return Op::apply(l_(row, col), r_(row, col)); }
+    bool view_overlaps(ConstMatrixView<value_type> v) const { return l_.view_overlaps(v) || r_.view_overlaps(v); }
+private:
+    typename Storage<L>::type l_;
+    typename Storage<R>::type r_;
+};
+
+// Expression combined with a scalar on the right: e op s.
+template <typename E, typename Op>
+class Scalar : public MatrixExpr<Scalar<E, Op>> {
+public:
+    typedef typename E::value_type value_type;
+    static constexpr bool contiguous = E::contiguous;
+
+    Scalar(const E& e, value_type s) : e_(e), s_(s) {}
+    size_t rows() const { return e_.rows(); }
+    size_t cols() const { return e_.cols(); }
+    value_type flat(size_t i) const { return Op::apply(e_.flat(i), s_); }
+    value_type operator()(size_t row, size_t col) const { return Op::apply(e_(row, col), s_); }
+    bool view_overlaps(ConstMatrixView<value_type> v) const { return e_.view_overlaps(v); }
+private:
+    typename Storage<E>::type e_;
+    value_type s_;
+};
+
+template <typename E>
+class Negate : public MatrixExpr<Negate<E>> {
+public:
+    typedef typename E::value_type value_type;
+    static constexpr bool contiguous = E::contiguous;
+
+    explicit Negate(const E& e) : e_(e) {}
+    size_t rows() const { return e_.rows(); }
+    size_t cols() const { return e_.cols(); }
+    value_type flat(size_t i) const { return -e_.flat(i); }
+    value_type operator()(size_t row, size_t col) const { return -e_(row, col); }
+    bool view_overlaps(ConstMatrixView<value_type> v) const { return e_.view_overlaps(v); }
+private:
+    typename Storage<E>::type e_;
+};
+
+}
+
+#endif
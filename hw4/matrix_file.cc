@@ -0,0 +1,208 @@
+#include "matrix_file.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace matrix_file {
+
+namespace {
+
+const char MAGIC[8] = {'H', 'W', '4', 'M', 'A', 'T', 'R', 'X'};
+
+template <typename U>
+U byte_swap(U v) {
+    unsigned char b[sizeof(U)];
+    std::memcpy(b, &v, sizeof(U));
+    std::reverse(b, b + sizeof(U));
+    std::memcpy(&v, b, sizeof(U));
+    return v;
+}
+
+[[noreturn]] void fail(const std::string& path, const char* what) {
+    throw std::runtime_error(path + ": " + what);
+}
+
+// Converts a header that is not in native byte order; true if it had to.
+bool normalize(Header& h) {
+    if (h.byte_order == BYTE_ORDER_MARK) return false;
+    h.version = byte_swap(h.version);
+    h.dtype = byte_swap(h.dtype);
+    h.element_size = byte_swap(h.element_size);
+    h.byte_order = byte_swap(h.byte_order);
+    h.rows = byte_swap(h.rows);
+    h.cols = byte_swap(h.cols);
+    h.data_offset = byte_swap(h.data_offset);
+    return true;
+}
+
+// Checks a native-order header against the size of its file and returns the
+// size of the element data in bytes.
+uint64_t check(const Header& h, uint64_t file_size, const std::string& path) {
+    if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0) fail(path, "not a matrix file");
+    if (h.byte_order != BYTE_ORDER_MARK) fail(path, "unknown byte order");
+    if (h.version != VERSION) fail(path, "unsupported matrix file version");
+    if (h.element_size == 0 || h.data_offset < sizeof(Header) || h.data_offset % ALIGNMENT != 0) {
+        fail(path, "corrupt matrix file header");
+    }
+    uint64_t max = std::numeric_limits<uint64_t>::max();
+    if (h.rows != 0 && h.cols > max / h.rows / h.element_size) fail(path, "corrupt matrix file header");
+    uint64_t bytes = h.rows * h.cols * h.element_size;
+    if (file_size < h.data_offset || file_size - h.data_offset < bytes) fail(path, "truncated matrix file");
+    return bytes;
+}
+
+template <typename T>
+void require_type(const Header& h, const std::string& path) {
+    if (h.dtype != static_cast<uint32_t>(DTypeOf<T>::value) || h.element_size != sizeof(T)) {
+        fail(path, "element type mismatch");
+    }
+}
+
+}
+
+Header read_header(const std::string& path) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) fail(path, "cannot open");
+    uint64_t size = static_cast<uint64_t>(in.tellg());
+    Header h;
+    in.seekg(0);
+    if (!in.read(reinterpret_cast<char*>(&h), sizeof(h))) fail(path, "not a matrix file");
+    normalize(h);
+    check(h, size, path);
+    return h;
+}
+
+}
+
+using namespace matrix_file;
+
+template <typename T>
+void TypedMatrix<T>::save(const std::string& path) const {
+    Header h = {};
+    std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = VERSION;
+    h.dtype = static_cast<uint32_t>(DTypeOf<T>::value);
+    h.element_size = sizeof(T);
+    h.byte_order = BYTE_ORDER_MARK;
+    h.rows = rows_;
+    h.cols = cols_;
+    h.data_offset = ALIGNMENT;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) fail(path, "cannot open");
+    char pad[ALIGNMENT - sizeof(Header)] = {};
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    out.write(pad, sizeof(pad));
+    out.write(reinterpret_cast<const char*>(data_.data()), data_.size() * sizeof(T));
+    if (!out.flush()) fail(path, "write failed");
+}
+
+template <typename T>
+TypedMatrix<T> TypedMatrix<T>::load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) fail(path, "cannot open");
+    uint64_t size = static_cast<uint64_t>(in.tellg());
+    Header h;
+    in.seekg(0);
+    if (!in.read(reinterpret_cast<char*>(&h), sizeof(h))) fail(path, "not a matrix file");
+    bool swapped = normalize(h);
+    uint64_t bytes = check(h, size, path);
+    require_type<T>(h, path);
+
+    TypedMatrix r(h.rows, h.cols);
+    in.seekg(h.data_offset);
+    if (!in.read(reinterpret_cast<char*>(r.data()), bytes)) fail(path, "truncated matrix file");
+    if (swapped) {
+        for (T& v : r.data_) v = byte_swap(v);
+    }
+    return r;
+}
+
+template <typename T>
+MappedMatrix<T>::MappedMatrix(const std::string& path)
+    : map_(nullptr), map_size_(0), data_(nullptr), rows_(0), cols_(0) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) fail(path, "cannot open");
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < sizeof(Header)) {
+        ::close(fd);
+        fail(path, "not a matrix file");
+    }
+    // MAP_SHARED lets every process mapping the file share its page cache.
+    void* p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) fail(path, "mmap failed");
+    map_ = p;
+    map_size_ = st.st_size;
+
+    Header h;
+    std::memcpy(&h, map_, sizeof(h));
+    try {
+        if (h.byte_order != BYTE_ORDER_MARK && byte_swap(h.byte_order) == BYTE_ORDER_MARK) {
+            fail(path, "matrix file has foreign byte order; use load()");
+        }
+        check(h, map_size_, path);
+        require_type<T>(h, path);
+    } catch (...) {
+        release();
+        throw;
+    }
+    data_ = reinterpret_cast<const T*>(static_cast<const char*>(map_) + h.data_offset);
+    rows_ = h.rows;
+    cols_ = h.cols;
+}
+
+template <typename T>
+MappedMatrix<T>::MappedMatrix(MappedMatrix&& other) noexcept
+    : map_(other.map_), map_size_(other.map_size_), data_(other.data_),
+      rows_(other.rows_), cols_(other.cols_) {
+    other.map_ = nullptr;
+    other.map_size_ = 0;
+    other.data_ = nullptr;
+    other.rows_ = 0;
+    other.cols_ = 0;
+}
+
+template <typename T>
+MappedMatrix<T>& MappedMatrix<T>::operator=(MappedMatrix&& other) noexcept {
+    if (this != &other) {
+        release();
+        std::swap(map_, other.map_);
+        std::swap(map_size_, other.map_size_);
+        std::swap(data_, other.data_);
+        std::swap(rows_, other.rows_);
+        std::swap(cols_, other.cols_);
+    }
+    return *this;
+}
+
+template <typename T>
+MappedMatrix<T>::~MappedMatrix() {
+    release();
+}
+
+template <typename T>
+void MappedMatrix<T>::release() {
+    if (map_) ::munmap(map_, map_size_);
+    map_ = nullptr;
+    map_size_ = 0;
+    data_ = nullptr;
+    rows_ = 0;
+    cols_ = 0;
+}
+
+#define INSTANTIATE_MATRIX_FILE(T) \
+    template void TypedMatrix<T>::save(const std::string&) const; \
+    template TypedMatrix<T> TypedMatrix<T>::load(const std::string&); \
+    template class MappedMatrix<T>;
+
+INSTANTIATE_MATRIX_FILE(float)
+INSTANTIATE_MATRIX_FILE(double)
+INSTANTIATE_MATRIX_FILE(int32_t)
+INSTANTIATE_MATRIX_FILE(int64_t)
@@ -0,0 +1,125 @@
+#ifndef MATRIX_FILE_H
+#define MATRIX_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "matrix.h"
+
+// Binary matrix files, written by TypedMatrix::save(). A file is a 64-byte
+// header followed by the elements in row-major order, starting at an offset
+// that is a multiple of 64 so a mapped file can be used in place:
+//
+//     offset  size  field
+//          0     8  magic "HW4MATRX"
+//          8     4  format version (1)
+//         12     4  element type, see matrix_file::DType
+//         16     4  element size in bytes
+//         20     4  0x01020304 in the byte order of the machine that wrote it
+//         24     8  rows
+//         32     8  cols
+//         40     8  offset of the first element
+//         48    16  reserved, zero
+//
+// load() accepts files of either byte order; MappedMatrix needs the native one.
+// Malformed files and element type mismatches throw std::runtime_error.
+
+namespace matrix_file {
+
+enum class DType : uint32_t { Float32 = 1, Float64 = 2, Int32 = 3, Int64 = 4 };
+
+template <typename T> struct DTypeOf;
+template <> struct DTypeOf<float> { static constexpr DType value = DType::Float32; };
+template <> struct DTypeOf<double> { static constexpr DType value = DType::Float64; };
+template <> struct DTypeOf<int32_t> { static constexpr DType value = DType::Int32; };
+template <> struct DTypeOf<int64_t> { static constexpr DType value = DType::Int64; };
+
+const uint32_t VERSION = 1;
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+const size_t ALIGNMENT = 64;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t dtype;
+    uint32_t element_size;
+    uint32_t byte_order;
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t data_offset;
+    uint8_t reserved[16];
+};
+static_assert(sizeof(Header) == 64, "Header must be 64 bytes");
+
+// Reads and checks the header of a matrix file, converting it to native byte
+// order.
+Header read_header(const std::string& path);
+
+}
+
+// Read-only matrix backed by a memory-mapped file. Opening one reads only the
+// header; pages are brought in on first touch and shared through the page
+// cache with every other process mapping the same file. The file must hold
+// elements of type T in native byte order.
+//
+// A MappedMatrix takes part in lazy expressions and products like a matrix,
+// and view() gives a ConstMatrixView for the kernels that take views.
+template <typename T>
+class MappedMatrix : public MatrixExpr<MappedMatrix<T>> {
+private:
+    void* map_;
+    size_t map_size_;
+    const T* data_;
+    size_t rows_;
+    size_t cols_;
+
+    void release();
+
+public:
+    typedef T value_type;
+    typedef typename MatrixTraits<T>::real_type real_type;
+    static constexpr bool contiguous = true;
+
+    explicit MappedMatrix(const std::string& path);
+    MappedMatrix(MappedMatrix&& other) noexcept;
+    MappedMatrix& operator=(MappedMatrix&& other) noexcept;
+    MappedMatrix(const MappedMatrix&) = delete;
+    MappedMatrix& operator=(const MappedMatrix&) = delete;
+    ~MappedMatrix();
+
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+    bool isEmpty() const { return rows_ == 0 || cols_ == 0; }
+    const T* data() const { return data_; }
+
+    const T& operator()(size_t row, size_t col) const { return data_[row * cols_ + col]; }
+    const T& at(size_t row, size_t col) const {
+        if (row >= rows_ || col >= cols_) throw std::out_of_range("Out of range");
+        return (*this)(row, col);
+    }
+    T flat(size_t i) const { return data_[i]; }
+    bool view_overlaps(ConstMatrixView<T>) const { return false; }
+
+    ConstMatrixView<T> view() const { return ConstMatrixView<T>(data_, rows_, cols_, cols_, 1); }
+    operator ConstMatrixView<T>() const { return view(); }
+    ConstMatrixView<T> block(size_t r0, size_t c0, size_t nr, size_t nc) const {
+        return view().block(r0, c0, nr, nc);
+    }
+    ConstMatrixView<T> transpose_view() const { return view().transpose_view(); }
+};
+
+// Mapped matrices are not copyable, so expressions refer to them like they
+// do to matrices, and products read them in place.
+namespace matrix_expr {
+
+template <typename T>
+struct Storage<MappedMatrix<T>> { typedef const MappedMatrix<T>& type; };
+
+}
+
+template <typename T>
+ConstMatrixView<T> evaluated(const MappedMatrix<T>& m) {
+    return m.view();
+}
+
+#endif
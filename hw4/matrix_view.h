@@ -0,0 +1,248 @@
+#ifndef MATRIX_VIEW_H
+#define MATRIX_VIEW_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include "matrix_expr.h"
+
+// Non-owning windows onto matrix storage. A view is a pointer plus a shape and
+// a row and column stride, so blocks, single rows and columns, the diagonal
+// and the transpose of a matrix can all be addressed without copying. Views
+// take part in the lazy arithmetic of matrix_expr.h like any matrix.
+//
+// A view does not keep its matrix alive, and resizing or reassigning the
+// matrix to a different shape invalidates it.
+
+template <typename T>
+struct MatrixTraits;
+
+template <typename T>
+class ConstMatrixView;
+
+template <typename T>
+class MatrixView;
+
+namespace matrix_view {
+
+// Keeps a parameter out of template argument deduction so that arguments
+// convert to it implicitly.
+template <typename V>
+struct Nondeduced { typedef V type; };
+
+inline void check_block(size_t rows, size_t cols, size_t r0, size_t c0, size_t nr, size_t nc) {
+    if (r0 > rows || c0 > cols || nr > rows - r0 || nc > cols - c0) {
+        throw std::out_of_range("Out of range");
+    }
+}
+
+template <typename T>
+bool overlaps(ConstMatrixView<T> x, ConstMatrixView<T> y);
+
+}
+
+template <typename T>
+class ConstMatrixView : public MatrixExpr<ConstMatrixView<T>> {
+public:
+    typedef T value_type;
+    typedef typename MatrixTraits<T>::real_type real_type;
+    static constexpr bool contiguous = false;
+
+    ConstMatrixView(const T* data, size_t rows, size_t cols, size_t row_stride, size_t col_stride)
+        : data_(data), rows_(rows), cols_(cols), rs_(row_stride), cs_(col_stride) {}
+
+    ConstMatrixView(const TypedMatrix<T>& m)
+        : data_(m.data()), rows_(m.rows()), cols_(m.cols()), rs_(m.cols()), cs_(1) {}
+
+    ConstMatrixView(const MatrixView<T>& v)
+        : data_(v.data()), rows_(v.rows()), cols_(v.cols()),
+          rs_(v.row_stride()), cs_(v.col_stride()) {}
+
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+    size_t row_stride() const { return rs_; }
+    size_t col_stride() const { return cs_; }
+    const T* data() const { return data_; }
+    bool isEmpty() const { return rows_ == 0 || cols_ == 0; }
+    bool isSquare() const { return rows_ == cols_; }
+
+    const T& operator()(size_t row, size_t col) const { return data_[row * rs_ + col * cs_]; }
+
+    const T& at(size_t row, size_t col) const {
+        if (row >= rows_ || col >= cols_) throw std::out_of_range("Out of range");
+        return (*this)(row, col);
+    }
+
+    ConstMatrixView block(size_t r0, size_t c0, size_t nr, size_t nc) const {
+        matrix_view::check_block(rows_, cols_, r0, c0, nr, nc);
+        return ConstMatrixView(data_ + r0 * rs_ + c0 * cs_, nr, nc, rs_, cs_);
+    }
+    ConstMatrixView row(size_t i) const { return block(i, 0, 1, cols_); }
+    ConstMatrixView col(size_t j) const { return block(0, j, rows_, 1); }
+    ConstMatrixView transpose_view() const { return ConstMatrixView(data_, cols_, rows_, cs_, rs_); }
+    ConstMatrixView diagonal_view() const {
+        size_t n = rows_ < cols_ ? rows_ : cols_;
+        return ConstMatrixView(data_, n, 1, rs_ + cs_, cs_);
+    }
+
+    bool view_overlaps(ConstMatrixView v) const { return matrix_view::overlaps(*this, v); }
+
+    // Same as the TypedMatrix versions, computed by reduce::sum and
+    // reduce::norm, so views and matrices agree to the bit.
+    T trace() const;
+    real_type norm() const;
+
+private:
+    const T* data_;
+    size_t rows_, cols_;
+    size_t rs_, cs_;
+};
+
+template <typename T>
+class MatrixView : public MatrixExpr<MatrixView<T>> {
+public:
+    typedef T value_type;
+    typedef typename MatrixTraits<T>::real_type real_type;
+    static constexpr bool contiguous = false;
+
+    MatrixView(T* data, size_t rows, size_t cols, size_t row_stride, size_t col_stride)
+        : data_(data), rows_(rows), cols_(cols), rs_(row_stride), cs_(col_stride) {}
+
+    MatrixView(TypedMatrix<T>& m)
+        : data_(m.data()), rows_(m.rows()), cols_(m.cols()), rs_(m.cols()), cs_(1) {}
+
+    MatrixView(const MatrixView& other) = default;
+
+    // Assignment writes through to the viewed elements; shapes must match.
+    // A right-hand side that reads views overlapping this one is evaluated
+    // into a temporary first.
+    MatrixView& operator=(const MatrixView& other) {
+        return *this = static_cast<const MatrixExpr<MatrixView>&>(other);
+    }
+
+    template <typename E>
+    MatrixView& operator=(const MatrixExpr<E>& expr) {
+        if (overlapped(expr)) return assign(TypedMatrix<T>(expr.self()));
+        return assign(expr.self());
+    }
+
+    // This view is read only at the element being written, so only the
+    // other operand needs checking.
+    template <typename E>
+    MatrixView& operator+=(const MatrixExpr<E>& other) {
+        if (overlapped(other)) return assign(*this + TypedMatrix<T>(other.self()));
+        return assign(*this + other);
+    }
+
+    template <typename E>
+    MatrixView& operator-=(const MatrixExpr<E>& other) {
+        if (overlapped(other)) return assign(*this - TypedMatrix<T>(other.self()));
+        return assign(*this - other);
+    }
+
+    MatrixView& operator*=(T scalar) {
+        for (size_t i = 0; i < rows_; i++)
+            for (size_t j = 0; j < cols_; j++) (*this)(i, j) *= scalar;
+        return *this;
+    }
+
+    MatrixView& operator/=(T scalar) {
+        return assign(*this / scalar);
+    }
+
+    void fill(T value) {
+        for (size_t i = 0; i < rows_; i++)
+            for (size_t j = 0; j < cols_; j++) (*this)(i, j) = value;
+    }
+
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+    size_t row_stride() const { return rs_; }
+    size_t col_stride() const { return cs_; }
+    T* data() const { return data_; }
+    bool isEmpty() const { return rows_ == 0 || cols_ == 0; }
+    bool isSquare() const { return rows_ == cols_; }
+
+    T& operator()(size_t row, size_t col) const { return data_[row * rs_ + col * cs_]; }
+
+    T& at(size_t row, size_t col) const {
+        if (row >= rows_ || col >= cols_) throw std::out_of_range("Out of range");
+        return (*this)(row, col);
+    }
+
+    MatrixView block(size_t r0, size_t c0, size_t nr, size_t nc) const {
+        matrix_view::check_block(rows_, cols_, r0, c0, nr, nc);
+        return MatrixView(data_ + r0 * rs_ + c0 * cs_, nr, nc, rs_, cs_);
+    }
+    MatrixView row(size_t i) const { return block(i, 0, 1, cols_); }
+    MatrixView col(size_t j) const { return block(0, j, rows_, 1); }
+    MatrixView transpose_view() const { return MatrixView(data_, cols_, rows_, cs_, rs_); }
+    MatrixView diagonal_view() const {
+        size_t n = rows_ < cols_ ? rows_ : cols_;
+        return MatrixView(data_, n, 1, rs_ + cs_, cs_);
+    }
+
+    bool view_overlaps(ConstMatrixView<T> v) const { return matrix_view::overlaps(ConstMatrixView<T>(*this), v); }
+
+    T trace() const { return ConstMatrixView<T>(*this).trace(); }
+    real_type norm() const { return ConstMatrixView<T>(*this).norm(); }
+
+private:
+    T* data_;
+    size_t rows_, cols_;
+    size_t rs_, cs_;
+
+    // Whether e reads a view of elements this view writes.
+    template <typename E>
+    bool overlapped(const MatrixExpr<E>& e) const {
+        if constexpr (!E::contiguous) return e.self().view_overlaps(ConstMatrixView<T>(*this));
+        return false;
+    }
+
+    template <typename E>
+    MatrixView& assign(const MatrixExpr<E>& expr) {
+        const E& e = expr.self();
+        if (e.rows() != rows_ || e.cols() != cols_) throw std::invalid_argument("Dimension mismatch");
+        for (size_t i = 0; i < rows_; i++)
+            for (size_t j = 0; j < cols_; j++) (*this)(i, j) = e(i, j);
+        return *this;
+    }
+};
+
+namespace matrix_view {
+
+// True when two views share an element. Blocks (or transposed blocks) of the
+// same row-major matrix are compared by their row and column ranges; anything
+// else conservatively by the address ranges they span.
+template <typename T>
+bool overlaps(ConstMatrixView<T> x, ConstMatrixView<T> y) {
+    if (x.isEmpty() || y.isEmpty()) return false;
+    const T* x_end = &x(x.rows() - 1, x.cols() - 1) + 1;
+    const T* y_end = &y(y.rows() - 1, y.cols() - 1) + 1;
+    std::less<const T*> before;
+    if (!before(x.data(), y_end) || !before(y.data(), x_end)) return false;
+
+    if (x.row_stride() < x.col_stride()) x = x.transpose_view();
+    if (y.row_stride() < y.col_stride()) y = y.transpose_view();
+    size_t rs = x.row_stride();
+    if ((x.col_stride() != 1 && x.rows() > 0 && x.cols() > 1) ||
+        (y.col_stride() != 1 && y.rows() > 0 && y.cols() > 1) ||
+        y.row_stride() != rs || x.cols() > rs || y.cols() > rs) {
+        return true;
+    }
+    // Place y's first element at (row, col) relative to x's; y may wrap past
+    // the end of a row of x, which puts its right part one row further down.
+    ptrdiff_t d = y.data() - x.data();
+    ptrdiff_t srs = static_cast<ptrdiff_t>(rs);
+    ptrdiff_t row = d >= 0 ? d / srs : -((-d + srs - 1) / srs);
+    ptrdiff_t col = d - row * srs;
+    auto intersects = [](ptrdiff_t a0, ptrdiff_t a1, ptrdiff_t b0, ptrdiff_t b1) { return a0 < b1 && b0 < a1; };
+    ptrdiff_t xr = x.rows(), xc = x.cols(), yr = y.rows(), yc = y.cols();
+    if (intersects(0, xr, row, row + yr) && intersects(0, xc, col, std::min(col + yc, srs))) return true;
+    return col + yc > srs && intersects(0, xr, row + 1, row + 1 + yr) && intersects(0, xc, 0, col + yc - srs);
+}
+
+}
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef PARALLEL_ALGORITHMS_H
+#define PARALLEL_ALGORITHMS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "thread_pool.h"
+
+// Bulk algorithms over random-access ranges, such as a TypedArray's
+// [begin(), end()), run on the thread pool. They use num_threads() threads,
+// so set_num_threads() or a ScopedNumThreads picks the degree of
+// parallelism, and run serially on ranges shorter than twice grain elements.
+// Functions passed to them are called concurrently from several threads.
+
+namespace parallel_algorithms {
+
+// Number of elements of a among the first k of the stable merge of sorted
+// ranges a and b, which takes elements of a first on ties.
+template <typename Iterator, typename Compare>
+size_t co_rank(Iterator a, size_t na, Iterator b, size_t nb, size_t k, Compare& comp) {
+    size_t lo = k > nb ? k - nb : 0, hi = std::min(k, na);
+    while (lo < hi) {
+        size_t i = lo + (hi - lo) / 2;
+        if (comp(b[k - i - 1], a[i])) {
+            hi = i;
+        } else {
+            lo = i + 1;
+        }
+    }
+    return lo;
+}
+
+// Folds the non-empty range [first, last) with op in four interleaved
+// accumulators, so that four independent chains of op are in flight instead
+// of one long dependent chain.
+template <typename T, typename Iterator, typename BinaryOperation>
+T fold(Iterator first, Iterator last, BinaryOperation& op) {
+    if (last - first < 8) return std::accumulate(std::next(first), last, T(*first), op);
+    T a0(first[0]), a1(first[1]), a2(first[2]), a3(first[3]);
+    Iterator it = first + 4;
+    for (; last - it >= 4; it += 4) {
+        a0 = op(std::move(a0), it[0]);
+        a1 = op(std::move(a1), it[1]);
+        a2 = op(std::move(a2), it[2]);
+        a3 = op(std::move(a3), it[3]);
+    }
+    for (; it != last; ++it) a0 = op(std::move(a0), *it);
+    return op(op(std::move(a0), std::move(a1)), op(std::move(a2), std::move(a3)));
+}
+
+// Merges the sorted runs of width chunks of src pairwise into dst, where
+// chunk c is [n * c / chunks, n * (c + 1) / chunks). Each merged pair is cut
+// at the chunk boundaries of its output, so every chunk is one task.
+template <typename Source, typename Destination, typename Compare>
+void merge_round(Source src, Destination dst, size_t n, size_t chunks, size_t width, Compare& comp) {
+    auto bound = [&](size_t c) { return n * std::min(c, chunks) / chunks; };
+    parallel::run(chunks, [&](size_t t) {
+        size_t first = t / (2 * width) * (2 * width);
+        size_t a = bound(first), m = bound(first + width), e = bound(first + 2 * width);
+        size_t k0 = bound(t) - a, k1 = bound(t + 1) - a;
+        size_t i0 = co_rank(src + a, m - a, src + m, e - m, k0, comp);
+        size_t i1 = co_rank(src + a, m - a, src + m, e - m, k1, comp);
+        std::merge(std::make_move_iterator(src + a + i0), std::make_move_iterator(src + a + i1),
+                   std::make_move_iterator(src + m + k0 - i0), std::make_move_iterator(src + m + k1 - i1),
+                   dst + bound(t), comp);
+    });
+}
+
+}
+
+namespace parallel {
+
+// Ranges below twice this many elements are processed serially.
+constexpr size_t ALGORITHM_GRAIN = 1 << 15;
+
+// Calls fn(x) for every element x of [first, last).
+template <typename Iterator, typename Function>
+void parallel_for_each(Iterator first, Iterator last, Function fn, size_t grain = ALGORITHM_GRAIN) {
+    parallel_for(last - first, grain, [&](size_t i0, size_t i1) {
+        for (Iterator it = first + i0, e = first + i1; it != e; ++it) fn(*it);
+    });
+}
+
+// Stores op(x) for every element x of [first, last) at the same position
+// from out on, which may be first itself. Returns the end of the output.
+template <typename Iterator, typename OutputIterator, typename UnaryOperation>
+OutputIterator parallel_transform(Iterator first, Iterator last, OutputIterator out, UnaryOperation op,
+                                  size_t grain = ALGORITHM_GRAIN) {
+    parallel_for(last - first, grain, [&](size_t i0, size_t i1) {
+        OutputIterator o = out + i0;
+        for (Iterator it = first + i0, e = first + i1; it != e; ++it, ++o) *o = op(*it);
+    });
+    return out + (last - first);
+}
+
+// Folds [first, last) into init with op, which like for std::reduce must be
+// associative and commutative. The range is cut into chunks of grain
+// elements, each chunk is folded in several interleaved accumulators, which
+// is faster than std::accumulate even on one thread, and the chunk results
+// are combined with init in order. The grouping, and for floating point the
+// rounding, therefore depends only on the length and grain and never on the
+// number of threads.
+template <typename Iterator, typename T, typename BinaryOperation = std::plus<>>
+T parallel_reduce(Iterator first, Iterator last, T init, BinaryOperation op = BinaryOperation(),
+                  size_t grain = ALGORITHM_GRAIN) {
+    size_t n = last - first;
+    size_t chunks = std::max<size_t>(n / std::max<size_t>(grain, 1), 1);
+    if (n == 0) return init;
+    if (chunks == 1) return op(std::move(init), parallel_algorithms::fold<T>(first, last, op));
+    std::vector<std::optional<T>> partial(chunks);
+    run(chunks, [&](size_t c) {
+        partial[c].emplace(parallel_algorithms::fold<T>(first + n * c / chunks, first + n * (c + 1) / chunks, op));
+    });
+    for (std::optional<T>& p : partial) init = op(std::move(init), std::move(*p));
+    return init;
+}
+
+// Sorts [first, last) by comp, not stably. With several threads the range
+// is cut into one chunk per thread, the chunks are sorted in parallel and
+// then merged pairwise through a scratch copy of the range, every merge
+// split across all the threads.
+template <typename Iterator, typename Compare = std::less<>>
+void parallel_sort(Iterator first, Iterator last, Compare comp = Compare(), size_t grain = ALGORITHM_GRAIN) {
+    typedef typename std::iterator_traits<Iterator>::value_type ElementType;
+    size_t n = last - first;
+    size_t chunks = std::min(n / std::max<size_t>(grain, 1), num_threads());
+    if (chunks < 2) {
+        std::sort(first, last, comp);
+        return;
+    }
+    run(chunks, [&](size_t c) {
+        std::sort(first + n * c / chunks, first + n * (c + 1) / chunks, comp);
+    });
+    std::vector<ElementType> scratch(std::make_move_iterator(first), std::make_move_iterator(last));
+    bool in_scratch = true;
+    for (size_t width = 1; width < chunks; width *= 2) {
+        if (in_scratch) {
+            parallel_algorithms::merge_round(scratch.begin(), first, n, chunks, width, comp);
+        } else {
+            parallel_algorithms::merge_round(first, scratch.begin(), n, chunks, width, comp);
+        }
+        in_scratch = !in_scratch;
+    }
+    if (in_scratch) {
+        parallel_for(n, grain, [&](size_t i0, size_t i1) {
+            std::move(scratch.begin() + i0, scratch.begin() + i1, first + i0);
+        });
+    }
+}
+
+}
+
+#endif
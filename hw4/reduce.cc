@@ -0,0 +1,833 @@
+#include "reduce.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include "thread_pool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define REDUCE_X86 1
+#endif
+
+namespace reduce {
+
+namespace {
+
+// Elements per independently reduced chunk. It is fixed, so the partial
+// results and the order they are combined in depend only on the input shape.
+const size_t CHUNK = Matrix::ELEMENTWISE_GRAIN;
+// Runs shorter than this, and strided runs, are copied through stack buffers
+// of GATHER elements so the kernels always see long contiguous blocks.
+const size_t DIRECT = 64;
+const size_t GATHER = 512;
+// Pairwise summation adds blocks of this many elements with the blocked
+// kernel and combines the block sums as a balanced tree.
+const size_t PAIRWISE_LEAF = 1024;
+// Equality checks for a difference after every block of this many elements.
+const size_t EQUAL_BLOCK = 1024;
+
+/* Accumulator states *********************************************************/
+
+// A state keeps LANES interleaved accumulators: element i of a block goes to
+// lane i % LANES, so once the loop is vectorized each lane is one element of a
+// vector register and the additions of different lanes overlap. step() must
+// be branch free. Eight 32-byte vectors of lanes hide the latency of vector
+// additions.
+template <typename A>
+constexpr size_t lanes() {
+    return 256 / sizeof(A);
+}
+
+template <typename T>
+using Index = typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type;
+
+// Terms map an element (and its partner in the second operand) to the value
+// being accumulated.
+template <typename T, typename A>
+struct Value {
+    A operator()(T x, T) const { return A(x); }
+};
+
+template <typename T, typename A>
+struct Product {
+    A operator()(T x, T y) const { return A(x) * A(y); }
+};
+
+template <typename T, typename A>
+struct Square {
+    A operator()(T x, T) const { return A(x) * A(x); }
+};
+
+template <typename T, typename A>
+struct ScaledSquare {
+    A scale;
+    A operator()(T x, T) const {
+        A v = A(x) / scale;
+        return v * v;
+    }
+};
+
+template <typename T, typename A>
+struct Magnitude {
+    A operator()(T x, T) const {
+        A v = A(x);
+        return v < A(0) ? -v : v;
+    }
+};
+
+// Adds the lanes as a balanced tree.
+template <typename A, size_t L>
+A tree_sum(const A (&lane)[L]) {
+    A v[L];
+    std::copy(lane, lane + L, v);
+    for (size_t w = L / 2; w > 0; w /= 2)
+        for (size_t k = 0; k < w; k++) v[k] += v[k + w];
+    return v[0];
+}
+
+// Compensated (Kahan) running sum for combining lanes and chunks.
+template <typename A>
+struct Kahan {
+    A sum = A(0), err = A(0);
+    void add(A v) {
+        A y = v - err;
+        A t = sum + y;
+        err = (t - sum) - y;
+        sum = t;
+    }
+};
+
+template <typename T, typename A, typename Term>
+struct Total {
+    typedef T value_type;
+    static constexpr size_t LANES = lanes<A>();
+    A acc[LANES];
+    size_t seen = 0;
+    Term term;
+
+    explicit Total(Term t = Term()) : term(t) { std::fill(acc, acc + LANES, A(0)); }
+    __attribute__((always_inline)) void step(size_t k, size_t, T x, T y) { acc[k] += term(x, y); }
+    A result() const { return tree_sum(acc); }
+};
+
+template <typename T, typename A, typename Term>
+struct Compensated {
+    typedef T value_type;
+    static constexpr size_t LANES = lanes<A>();
+    A acc[LANES], err[LANES];
+    size_t seen = 0;
+    Term term;
+
+    explicit Compensated(Term t = Term()) : term(t) {
+        std::fill(acc, acc + LANES, A(0));
+        std::fill(err, err + LANES, A(0));
+    }
+    __attribute__((always_inline)) void step(size_t k, size_t, T x, T y) {
+        A v = term(x, y) - err[k];
+        A s = acc[k] + v;
+        err[k] = (s - acc[k]) - v;
+        acc[k] = s;
+    }
+    A result() const {
+        Kahan<A> s;
+        for (size_t k = 0; k < LANES; k++) s.add(acc[k] - err[k]);
+        return s.sum;
+    }
+};
+
+// True when v should replace cur as the running extreme: it is larger (or
+// smaller), or it is the first NaN.
+template <bool Max, typename A>
+bool better(A v, A cur) {
+    return (Max ? v > cur : v < cur) || (v != v && cur == cur);
+}
+
+template <bool Max, typename A>
+A worst() {
+    if (std::numeric_limits<A>::has_infinity) {
+        return Max ? -std::numeric_limits<A>::infinity() : std::numeric_limits<A>::infinity();
+    }
+    return Max ? std::numeric_limits<A>::lowest() : std::numeric_limits<A>::max();
+}
+
+// The lanes compare with a plain select, which compiles to vector max and
+// min instructions, and record NaNs separately in an integer mask of the
+// same width.
+template <typename T, typename A, typename Term, bool Max>
+struct Extreme {
+    typedef T value_type;
+    typedef typename std::make_signed<Index<A>>::type F;
+    static constexpr size_t LANES = lanes<A>();
+    A val[LANES];
+    F nan[LANES];
+    size_t seen = 0;
+    Term term;
+
+    Extreme() {
+        std::fill(val, val + LANES, worst<Max, A>());
+        std::fill(nan, nan + LANES, F(0));
+    }
+    __attribute__((always_inline)) void step(size_t k, size_t, T x, T y) {
+        A v = term(x, y);
+        val[k] = (Max ? v > val[k] : v < val[k]) ? v : val[k];
+        nan[k] |= F(v != v);
+    }
+    A result() const {
+        for (size_t k = 0; k < LANES; k++)
+            if (nan[k]) return std::numeric_limits<A>::quiet_NaN();
+        A r = val[0];
+        for (size_t k = 1; k < LANES; k++) r = better<Max>(val[k], r) ? val[k] : r;
+        return r;
+    }
+};
+
+// Position within a chunk of its first largest (or smallest) element. Lane k
+// starts out at position k with the worst value, which is harmless: if no
+// element beats the worst value then element 0 is the first extreme. NaNs
+// are only flagged, and the caller looks for the first one.
+template <typename T, bool Max>
+struct Arg {
+    typedef T value_type;
+    typedef Index<T> I;
+    typedef typename std::make_signed<I>::type F;
+    static constexpr size_t LANES = lanes<T>();
+    T val[LANES];
+    I idx[LANES];
+    F nan[LANES];
+    size_t seen = 0;
+
+    Arg() {
+        std::fill(val, val + LANES, worst<Max, T>());
+        std::fill(nan, nan + LANES, F(0));
+        for (size_t k = 0; k < LANES; k++) idx[k] = I(k);
+    }
+    __attribute__((always_inline)) void step(size_t k, size_t pos, T x, T) {
+        bool take = Max ? x > val[k] : x < val[k];
+        I mask = I(0) - I(take);
+        val[k] = take ? x : val[k];
+        idx[k] = (idx[k] & ~mask) | (I(pos) & mask);
+        nan[k] |= F(x != x);
+    }
+    bool has_nan() const {
+        F r = 0;
+        for (size_t k = 0; k < LANES; k++) r |= nan[k];
+        return r != 0;
+    }
+    // Best lane; ties go to the earlier position.
+    size_t best() const {
+        size_t b = 0;
+        for (size_t k = 1; k < LANES; k++) {
+            if (better<Max>(val[k], val[b]) || (val[k] == val[b] && idx[k] < idx[b])) b = k;
+        }
+        return b;
+    }
+};
+
+template <typename T>
+__attribute__((always_inline)) inline bool differs(T x, T y) {
+    if constexpr (std::is_integral<T>::value) {
+        return x != y;
+    } else {
+        return std::fabs(x - y) > MatrixTraits<T>::epsilon;
+    }
+}
+
+template <typename T>
+struct Mismatch {
+    typedef T value_type;
+    typedef typename std::make_signed<Index<T>>::type F;
+    static constexpr size_t LANES = lanes<T>();
+    F bad[LANES];
+    size_t seen = 0;
+
+    Mismatch() { std::fill(bad, bad + LANES, F(0)); }
+    __attribute__((always_inline)) void step(size_t k, size_t, T x, T y) { bad[k] |= F(differs(x, y)); }
+    bool any() const {
+        F r = 0;
+        for (size_t k = 0; k < LANES; k++) r |= bad[k];
+        return r != 0;
+    }
+};
+
+/* Kernels ********************************************************************/
+
+// Feeds n consecutive elements of x (and y) to the state. Working on a local
+// copy of the state tells the compiler the accumulators cannot alias the
+// input. Always inlined into the wrappers below, which compile it for a
+// specific instruction set.
+template <typename S>
+__attribute__((always_inline)) inline
+void fold_body(S& state, const typename S::value_type* x, const typename S::value_type* y, size_t n) {
+    S s = state;
+    const size_t L = S::LANES;
+    size_t i = 0;
+    for (; i + L <= n; i += L)
+        for (size_t k = 0; k < L; k++) s.step(k, s.seen + i + k, x[i + k], y[i + k]);
+    for (size_t k = 0; i + k < n; k++) s.step(k, s.seen + i + k, x[i + k], y[i + k]);
+    s.seen += n;
+    state = s;
+}
+
+template <typename S>
+void fold_default(S& s, const typename S::value_type* x, const typename S::value_type* y, size_t n) {
+    fold_body(s, x, y, n);
+}
+
+#ifdef REDUCE_X86
+
+// No FMA: contracting a * b + c would round differently from the default
+// build and break reproducibility across machines.
+template <typename S>
+__attribute__((target("avx2")))
+void fold_avx2(S& s, const typename S::value_type* x, const typename S::value_type* y, size_t n) {
+    fold_body(s, x, y, n);
+}
+
+#endif
+
+// Runs the widest build of the kernel the CPU supports, chosen once per state.
+template <typename S>
+void fold(S& s, const typename S::value_type* x, const typename S::value_type* y, size_t n) {
+    typedef void (*Kernel)(S&, const typename S::value_type*, const typename S::value_type*, size_t);
+    static const Kernel kernel = [] {
+#ifdef REDUCE_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return Kernel(fold_avx2<S>);
+#endif
+        return Kernel(fold_default<S>);
+    }();
+    kernel(s, x, y, n);
+}
+
+/* Traversal ******************************************************************/
+
+// A view as count runs of length elements: element e of run r is at
+// data + r * pitch + e * step.
+template <typename T>
+struct Runs {
+    const T* data;
+    size_t count, length, step, pitch;
+
+    const T* at(size_t r, size_t e) const { return data + r * pitch + e * step; }
+};
+
+bool dense(size_t rows, size_t cols, size_t rs, size_t cs) {
+    return cs == 1 && (rs == cols || rows <= 1);
+}
+
+// Whether the columns of a are its contiguous direction, as in a transposed
+// view.
+template <typename T>
+bool column_major(ConstMatrixView<T> a) {
+    return a.col_stride() != 1 && a.row_stride() == 1;
+}
+
+// Runs along the rows or the columns of a. Dense views become a single run
+// when flat is set.
+template <typename T>
+Runs<T> runs_of(ConstMatrixView<T> a, bool by_cols, bool flat) {
+    if (by_cols) {
+        if (flat && dense(a.cols(), a.rows(), a.col_stride(), a.row_stride())) {
+            return {a.data(), 1, a.rows() * a.cols(), 1, 0};
+        }
+        return {a.data(), a.cols(), a.rows(), a.row_stride(), a.col_stride()};
+    }
+    if (flat && dense(a.rows(), a.cols(), a.row_stride(), a.col_stride())) {
+        return {a.data(), 1, a.rows() * a.cols(), 1, 0};
+    }
+    return {a.data(), a.rows(), a.cols(), a.col_stride(), a.row_stride()};
+}
+
+// Splits runs into chunks of at most CHUNK elements: whole groups of short
+// runs, or equal slices of long ones.
+struct Chunks {
+    size_t runs, length, per_chunk, slices;
+
+    Chunks(size_t runs, size_t length) : runs(runs), length(length) {
+        per_chunk = length > CHUNK ? 1 : CHUNK / std::max<size_t>(length, 1);
+        slices = length > CHUNK ? (length + CHUNK - 1) / CHUNK : 1;
+    }
+    size_t count() const {
+        if (runs == 0 || length == 0) return 0;
+        return (runs + per_chunk - 1) / per_chunk * slices;
+    }
+    void range(size_t c, size_t& r0, size_t& r1, size_t& e0, size_t& e1) const {
+        r0 = c / slices * per_chunk;
+        r1 = std::min(runs, r0 + per_chunk);
+        e0 = c % slices * CHUNK;
+        e1 = std::min(length, e0 + CHUNK);
+    }
+};
+
+// Calls feed(xp, yp, n) on consecutive contiguous blocks holding elements
+// [e0, e1) of runs [r0, r1) of x, and the same positions of y, in order. y
+// may be null. Stops early when feed returns false.
+template <typename T, typename F>
+void walk(const Runs<T>& x, const Runs<T>* y, size_t r0, size_t r1, size_t e0, size_t e1, F feed) {
+    size_t n = e1 - e0;
+    if (x.step == 1 && (!y || y->step == 1) && n >= DIRECT) {
+        for (size_t r = r0; r < r1; r++) {
+            const T* xp = x.at(r, e0);
+            if (!feed(xp, y ? y->at(r, e0) : xp, n)) return;
+        }
+        return;
+    }
+    T bx[GATHER], by[GATHER];
+    size_t used = 0;
+    for (size_t r = r0; r < r1; r++) {
+        const T* xp = x.at(r, e0);
+        const T* yp = y ? y->at(r, e0) : nullptr;
+        for (size_t e = 0; e < n; e++) {
+            bx[used] = xp[e * x.step];
+            if (y) by[used] = yp[e * y->step];
+            if (++used == GATHER) {
+                if (!feed(bx, y ? by : bx, used)) return;
+                used = 0;
+            }
+        }
+    }
+    if (used) feed(bx, y ? by : bx, used);
+}
+
+// Per-chunk states in chunk order. The common single-chunk case keeps its
+// state inline, so small reductions allocate nothing.
+template <typename S>
+class Partials {
+public:
+    Partials(size_t count, const S& init) : count_(count), one_(init) {
+        if (count != 1) many_.assign(count, init);
+    }
+
+    size_t size() const { return count_; }
+    S& operator[](size_t c) { return data()[c]; }
+    const S& operator[](size_t c) const { return data()[c]; }
+    const S* begin() const { return data(); }
+    const S* end() const { return data() + count_; }
+
+private:
+    S* data() { return count_ == 1 ? &one_ : many_.data(); }
+    const S* data() const { return count_ == 1 ? &one_ : many_.data(); }
+
+    size_t count_;
+    S one_;
+    std::vector<S> many_;
+};
+
+// One state per chunk, each folded over its chunk in parallel.
+template <typename S, typename T>
+Partials<S> fold_chunks(const S& init, const Runs<T>& x, const Runs<T>* y) {
+    Chunks chunks(x.count, x.length);
+    Partials<S> partial(chunks.count(), init);
+    auto task = [&](size_t c) {
+        size_t r0, r1, e0, e1;
+        chunks.range(c, r0, r1, e0, e1);
+        S& s = partial[c];
+        walk(x, y, r0, r1, e0, e1, [&](const T* xp, const T* yp, size_t n) {
+            fold(s, xp, yp, n);
+            return true;
+        });
+    };
+    // Small inputs skip building a pool job.
+    if (partial.size() == 1) {
+        task(0);
+    } else {
+        parallel::run(partial.size(), task);
+    }
+    return partial;
+}
+
+// Streaming pairwise sum: a binary counter of partial sums in which sums of
+// equal weight are merged as soon as both exist.
+template <typename A>
+struct PairwiseStack {
+    std::vector<std::pair<A, size_t>> stack;
+
+    void push(A v) {
+        size_t level = 0;
+        while (!stack.empty() && stack.back().second == level) {
+            v = stack.back().first + v;
+            stack.pop_back();
+            level++;
+        }
+        stack.push_back({v, level});
+    }
+    A total() const {
+        A s = A(0);
+        for (size_t i = stack.size(); i-- > 0;) s = stack[i].first + s;
+        return s;
+    }
+};
+
+template <typename A>
+A pairwise(const std::vector<A>& v, size_t lo, size_t hi) {
+    if (hi - lo == 1) return v[lo];
+    size_t mid = lo + (hi - lo) / 2;
+    return pairwise(v, lo, mid) + pairwise(v, mid, hi);
+}
+
+// Sum of term(x, y) over every element in the given mode.
+template <typename T, typename Term>
+T total(const Runs<T>& x, const Runs<T>* y, Summation mode) {
+    if (std::is_integral<T>::value) mode = Summation::Blocked;
+    if (mode == Summation::Kahan) {
+        auto partial = fold_chunks(Compensated<T, T, Term>(), x, y);
+        Kahan<T> s;
+        for (const auto& p : partial) s.add(p.result());
+        return s.sum;
+    }
+    if (mode == Summation::Pairwise) {
+        Chunks chunks(x.count, x.length);
+        if (chunks.count() == 0) return T(0);
+        std::vector<T> partial(chunks.count());
+        parallel::run(partial.size(), [&](size_t c) {
+            size_t r0, r1, e0, e1;
+            chunks.range(c, r0, r1, e0, e1);
+            PairwiseStack<T> stack;
+            walk(x, y, r0, r1, e0, e1, [&](const T* xp, const T* yp, size_t n) {
+                for (size_t i = 0; i < n; i += PAIRWISE_LEAF) {
+                    Total<T, T, Term> leaf;
+                    fold(leaf, xp + i, yp + i, std::min(PAIRWISE_LEAF, n - i));
+                    stack.push(leaf.result());
+                }
+                return true;
+            });
+            partial[c] = stack.total();
+        });
+        return pairwise(partial, 0, partial.size());
+    }
+    auto partial = fold_chunks(Total<T, T, Term>(), x, y);
+    T s = T(0);
+    for (const auto& p : partial) s += p.result();
+    return s;
+}
+
+template <typename T, bool Max>
+T extreme(ConstMatrixView<T> a) {
+    if (a.isEmpty()) throw std::invalid_argument("Empty matrix");
+    Runs<T> x = runs_of(a, column_major(a), true);
+    auto partial = fold_chunks(Extreme<T, T, Value<T, T>, Max>(), x, static_cast<const Runs<T>*>(nullptr));
+    T r = partial[0].result();
+    for (size_t c = 1; c < partial.size(); c++) {
+        T v = partial[c].result();
+        if (better<Max>(v, r)) r = v;
+    }
+    return r;
+}
+
+template <typename T, bool Max>
+Position arg_extreme(ConstMatrixView<T> a) {
+    if (a.isEmpty()) throw std::invalid_argument("Empty matrix");
+    // Row-major runs, so that "first" means first in row-major order.
+    Runs<T> x = runs_of(a, false, true);
+    Chunks chunks(x.count, x.length);
+    auto partial = fold_chunks(Arg<T, Max>(), x, static_cast<const Runs<T>*>(nullptr));
+    // Chunks are in row-major order, so a later chunk wins only if strictly
+    // better, and the first chunk with a NaN decides.
+    size_t best = 0;
+    T best_val = T(0);
+    for (size_t c = 0; c < partial.size(); c++) {
+        const Arg<T, Max>& p = partial[c];
+        size_t r0, r1, e0, e1;
+        chunks.range(c, r0, r1, e0, e1);
+        size_t n = e1 - e0;
+        if (p.has_nan()) {
+            for (size_t r = r0; r < r1; r++)
+                for (size_t e = e0; e < e1; e++) {
+                    if (*x.at(r, e) != *x.at(r, e)) {
+                        best = r * x.length + e;
+                        return Position(best / a.cols(), best % a.cols());
+                    }
+                }
+        }
+        size_t k = p.best();
+        if (c > 0 && !better<Max>(p.val[k], best_val)) continue;
+        size_t pos = p.idx[k];
+        best = (r0 + pos / n) * x.length + e0 + pos % n;
+        best_val = p.val[k];
+    }
+    return Position(best / a.cols(), best % a.cols());
+}
+
+// Two-pass norm of a strided vector, scaled by its largest magnitude.
+template <typename T, typename R>
+R scaled_norm(const T* p, size_t n, size_t step) {
+    R scale = R(0);
+    for (size_t i = 0; i < n; i++) scale = std::max(scale, R(std::fabs(R(p[i * step]))));
+    if (scale == R(0) || std::isinf(scale)) return scale;
+    R s = R(0);
+    for (size_t i = 0; i < n; i++) {
+        R v = R(p[i * step]) / scale;
+        s += v * v;
+    }
+    return scale * std::sqrt(s);
+}
+
+// A sum of squares that overflowed, or is small enough that some squares may
+// have lost precision to underflow, is recomputed with scaling.
+template <typename R>
+bool unsafe(R ssq) {
+    return std::isinf(ssq) || ssq < std::numeric_limits<R>::min() / std::numeric_limits<R>::epsilon();
+}
+
+/* Per-row and per-column reductions ******************************************/
+
+// out(i) = reduction of run i, one run per output element.
+template <typename S, typename T, typename A, typename F>
+void along_runs(const Runs<T>& x, const S& init, A* out, F finish) {
+    size_t grain = std::max<size_t>(1, CHUNK / std::max<size_t>(x.length, 1));
+    parallel::parallel_for(x.count, grain, [&](size_t r0, size_t r1) {
+        for (size_t r = r0; r < r1; r++) {
+            S s = init;
+            walk(x, static_cast<const Runs<T>*>(nullptr), r, r + 1, 0, x.length,
+                 [&](const T* xp, const T* yp, size_t n) {
+                     fold(s, xp, yp, n);
+                     return true;
+                 });
+            out[r] = finish(s);
+        }
+    });
+}
+
+// out(e) = reduction over every run of element e. Op(acc, x) folds one
+// element into an accumulator that starts at init.
+template <typename T, typename A, typename Op>
+void across_runs(const Runs<T>& x, A init, A* out, Op op) {
+    size_t grain = std::max<size_t>(1, CHUNK / std::max<size_t>(x.count, 1));
+    parallel::parallel_for(x.length, grain, [&](size_t e0, size_t e1) {
+        std::fill(out + e0, out + e1, init);
+        for (size_t r = 0; r < x.count; r++) {
+            const T* p = x.at(r, 0);
+            if (x.step == 1) {
+                for (size_t e = e0; e < e1; e++) out[e] = op(out[e], p[e]);
+            } else {
+                for (size_t e = e0; e < e1; e++) out[e] = op(out[e], p[e * x.step]);
+            }
+        }
+    });
+}
+
+// Reduces every row (along = false) or column (along = true) of a into a
+// result of n elements, going along or across the contiguous direction.
+enum class Kind { Sum, Squares, Min, Max };
+
+template <typename T, typename A, Kind K>
+void axis_reduce(ConstMatrixView<T> a, bool cols, A* out) {
+    bool by_cols = column_major(a);
+    Runs<T> x = runs_of(a, by_cols, false);
+    if (cols == by_cols) {
+        // Each output element is one run.
+        if constexpr (K == Kind::Sum || K == Kind::Squares) {
+            typedef typename std::conditional<K == Kind::Sum, Value<T, A>, Square<T, A>>::type Term;
+            along_runs(x, Total<T, A, Term>(), out, [](const Total<T, A, Term>& s) { return s.result(); });
+        } else {
+            along_runs(x, Extreme<T, A, Value<T, A>, K == Kind::Max>(), out,
+                       [](const Extreme<T, A, Value<T, A>, K == Kind::Max>& s) { return s.result(); });
+        }
+    } else if constexpr (K == Kind::Sum) {
+        across_runs(x, A(0), out, [](A acc, T v) { return acc + A(v); });
+    } else if constexpr (K == Kind::Squares) {
+        across_runs(x, A(0), out, [](A acc, T v) { return acc + A(v) * A(v); });
+    } else {
+        across_runs(x, worst<K == Kind::Max, A>(), out,
+                    [](A acc, T v) {
+                        // A NaN replaces the accumulator and then stays.
+                        bool take = (K == Kind::Max ? A(v) > acc : A(v) < acc) || v != v;
+                        return take ? A(v) : acc;
+                    });
+    }
+}
+
+template <typename T, Kind K>
+TypedMatrix<T> rows_or_cols(ConstMatrixView<T> a, bool cols) {
+    size_t n = cols ? a.cols() : a.rows();
+    if ((K == Kind::Min || K == Kind::Max) && n != 0 && a.isEmpty()) {
+        throw std::invalid_argument("Empty matrix");
+    }
+    TypedMatrix<T> r = cols ? TypedMatrix<T>(1, n, T(0)) : TypedMatrix<T>(n, 1, T(0));
+    if (!a.isEmpty()) axis_reduce<T, T, K>(a, cols, r.data());
+    return r;
+}
+
+template <typename T>
+TypedMatrix<typename MatrixTraits<T>::real_type> axis_norms(ConstMatrixView<T> a, bool cols) {
+    typedef typename MatrixTraits<T>::real_type R;
+    size_t n = cols ? a.cols() : a.rows();
+    TypedMatrix<R> r = cols ? TypedMatrix<R>(1, n, R(0)) : TypedMatrix<R>(n, 1, R(0));
+    if (a.isEmpty()) return r;
+    R* out = r.data();
+    axis_reduce<T, R, Kind::Squares>(a, cols, out);
+    size_t len = cols ? a.rows() : a.cols();
+    size_t step = cols ? a.row_stride() : a.col_stride();
+    for (size_t i = 0; i < n; i++) {
+        if (unsafe(out[i])) {
+            const T* p = cols ? a.data() + i * a.col_stride() : a.data() + i * a.row_stride();
+            out[i] = scaled_norm<T, R>(p, len, step);
+        } else {
+            out[i] = std::sqrt(out[i]);
+        }
+    }
+    return r;
+}
+
+}
+
+template <typename T>
+T sum(ConstMatrixView<T> a, Summation mode) {
+    if (a.isEmpty()) return T(0);
+    Runs<T> x = runs_of(a, column_major(a), true);
+    return total<T, Value<T, T>>(x, nullptr, mode);
+}
+
+template <typename T>
+T dot(ConstMatrixView<T> a, ConstMatrixView<T> b, Summation mode) {
+    if (a.rows() != b.rows() || a.cols() != b.cols()) throw std::invalid_argument("Dimension mismatch");
+    if (a.isEmpty()) return T(0);
+    bool by_cols = column_major(a);
+    bool flat = dense(a.rows(), a.cols(), a.row_stride(), a.col_stride()) &&
+                dense(b.rows(), b.cols(), b.row_stride(), b.col_stride());
+    Runs<T> x = runs_of(a, by_cols, flat && !by_cols);
+    Runs<T> y = runs_of(b, by_cols, flat && !by_cols);
+    return total<T, Product<T, T>>(x, &y, mode);
+}
+
+template <typename T>
+typename MatrixTraits<T>::real_type norm(ConstMatrixView<T> a) {
+    typedef typename MatrixTraits<T>::real_type R;
+    if (a.isEmpty()) return R(0);
+    Runs<T> x = runs_of(a, column_major(a), true);
+    const Runs<T>* none = nullptr;
+    R ssq = R(0);
+    for (const auto& p : fold_chunks(Total<T, R, Square<T, R>>(), x, none)) ssq += p.result();
+    if (!unsafe(ssq)) return std::sqrt(ssq);
+
+    R scale = R(0);
+    for (const auto& p : fold_chunks(Extreme<T, R, Magnitude<T, R>, true>(), x, none)) {
+        scale = std::max(scale, p.result());
+    }
+    if (scale == R(0) || std::isinf(scale)) return scale;
+    Total<T, R, ScaledSquare<T, R>> init(ScaledSquare<T, R>{scale});
+    ssq = R(0);
+    for (const auto& p : fold_chunks(init, x, none)) ssq += p.result();
+    return scale * std::sqrt(ssq);
+}
+
+template <typename T>
+T min(ConstMatrixView<T> a) {
+    return extreme<T, false>(a);
+}
+
+template <typename T>
+T max(ConstMatrixView<T> a) {
+    return extreme<T, true>(a);
+}
+
+template <typename T>
+Position argmin(ConstMatrixView<T> a) {
+    return arg_extreme<T, false>(a);
+}
+
+template <typename T>
+Position argmax(ConstMatrixView<T> a) {
+    return arg_extreme<T, true>(a);
+}
+
+template <typename T>
+bool equal(ConstMatrixView<T> a, ConstMatrixView<T> b) {
+    if (a.rows() != b.rows() || a.cols() != b.cols()) return false;
+    if (a.isEmpty()) return true;
+    bool by_cols = column_major(a);
+    bool flat = dense(a.rows(), a.cols(), a.row_stride(), a.col_stride()) &&
+                dense(b.rows(), b.cols(), b.row_stride(), b.col_stride());
+    Runs<T> x = runs_of(a, by_cols, flat && !by_cols);
+    Runs<T> y = runs_of(b, by_cols, flat && !by_cols);
+    Chunks chunks(x.count, x.length);
+    std::atomic<bool> different(false);
+    auto task = [&](size_t c) {
+        if (different.load(std::memory_order_relaxed)) return;
+        size_t r0, r1, e0, e1;
+        chunks.range(c, r0, r1, e0, e1);
+        walk(x, &y, r0, r1, e0, e1, [&](const T* xp, const T* yp, size_t n) {
+            for (size_t i = 0; i < n; i += EQUAL_BLOCK) {
+                Mismatch<T> m;
+                fold(m, xp + i, yp + i, std::min(EQUAL_BLOCK, n - i));
+                if (m.any()) different.store(true, std::memory_order_relaxed);
+                if (different.load(std::memory_order_relaxed)) return false;
+            }
+            return true;
+        });
+    };
+    if (chunks.count() == 1) {
+        task(0);
+    } else {
+        parallel::run(chunks.count(), task);
+    }
+    return !different.load();
+}
+
+template <typename T>
+TypedMatrix<T> row_sums(ConstMatrixView<T> a) {
+    return rows_or_cols<T, Kind::Sum>(a, false);
+}
+
+template <typename T>
+TypedMatrix<T> col_sums(ConstMatrixView<T> a) {
+    return rows_or_cols<T, Kind::Sum>(a, true);
+}
+
+template <typename T>
+TypedMatrix<typename MatrixTraits<T>::real_type> row_norms(ConstMatrixView<T> a) {
+    return axis_norms(a, false);
+}
+
+template <typename T>
+TypedMatrix<typename MatrixTraits<T>::real_type> col_norms(ConstMatrixView<T> a) {
+    return axis_norms(a, true);
+}
+
+template <typename T>
+TypedMatrix<T> row_min(ConstMatrixView<T> a) {
+    return rows_or_cols<T, Kind::Min>(a, false);
+}
+
+template <typename T>
+TypedMatrix<T> col_min(ConstMatrixView<T> a) {
+    return rows_or_cols<T, Kind::Min>(a, true);
+}
+
+template <typename T>
+TypedMatrix<T> row_max(ConstMatrixView<T> a) {
+    return rows_or_cols<T, Kind::Max>(a, false);
+}
+
+template <typename T>
+TypedMatrix<T> col_max(ConstMatrixView<T> a) {
+    return rows_or_cols<T, Kind::Max>(a, true);
+}
+
+#define INSTANTIATE_REDUCE(T) \
+    template T sum<T>(ConstMatrixView<T>, Summation); \
+    template T dot<T>(ConstMatrixView<T>, ConstMatrixView<T>, Summation); \
+    template MatrixTraits<T>::real_type norm<T>(ConstMatrixView<T>); \
+    template T min<T>(ConstMatrixView<T>); \
+    template T max<T>(ConstMatrixView<T>); \
+    template Position argmin<T>(ConstMatrixView<T>); \
+    template Position argmax<T>(ConstMatrixView<T>); \
+    template bool equal<T>(ConstMatrixView<T>, ConstMatrixView<T>); \
+    template TypedMatrix<T> row_sums<T>(ConstMatrixView<T>); \
+    template TypedMatrix<T> col_sums<T>(ConstMatrixView<T>); \
+    template TypedMatrix<MatrixTraits<T>::real_type> row_norms<T>(ConstMatrixView<T>); \
+    template TypedMatrix<MatrixTraits<T>::real_type> col_norms<T>(ConstMatrixView<T>); \
+    template TypedMatrix<T> row_min<T>(ConstMatrixView<T>); \
+    template TypedMatrix<T> col_min<T>(ConstMatrixView<T>); \
+    template TypedMatrix<T> row_max<T>(ConstMatrixView<T>); \
+    template TypedMatrix<T> col_max<T>(ConstMatrixView<T>);
+
+INSTANTIATE_REDUCE(float)
+INSTANTIATE_REDUCE(double)
+INSTANTIATE_REDUCE(int32_t)
+INSTANTIATE_REDUCE(int64_t)
+
+}
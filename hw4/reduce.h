@@ -0,0 +1,141 @@
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#include <cstddef>
+#include <utility>
+#include "matrix.h"
+
+// Reductions over matrices and views. Every kernel keeps many independent
+// accumulators so the loops vectorize (AVX2 where the CPU has it), and splits
+// the elements into fixed-size chunks that are reduced in parallel and
+// combined in chunk order. Results therefore do not depend on the number of
+// threads or on the instruction set: the same input always gives the same
+// bits. Views are read in place through their strides.
+//
+// Out-of-line kernels take ConstMatrixView and are instantiated in reduce.cc
+// for float, double, int32_t and int64_t. The overloads taking any matrix
+// expression read matrices, views and mapped matrices in place and evaluate
+// other expressions first. Integer sums wrap around like the other integer
+// operations.
+
+namespace reduce {
+
+// How sum() and dot() add floating-point terms. Blocked sums each chunk in a
+// fixed number of interleaved accumulators, with an error that grows about
+// linearly with the chunk count. Pairwise sums recursively in halves, with
+// an error that grows with log n. Kahan carries a compensation term per
+// accumulator and is accurate to a few ulps almost independently of n, at
+// about twice the cost of Blocked when the data is in cache. Integer sums
+// are exact in every mode.
+enum class Summation { Blocked, Pairwise, Kahan };
+
+// Sum of all elements.
+template <typename T>
+T sum(ConstMatrixView<T> a, Summation mode = Summation::Blocked);
+
+// Sum of the elementwise products of two same-shaped matrices. Throws
+// std::invalid_argument on a shape mismatch.
+template <typename T>
+T dot(ConstMatrixView<T> a, ConstMatrixView<T> b, Summation mode = Summation::Blocked);
+
+// Frobenius norm. Sums of squares that overflow or may have underflowed are
+// recomputed with the elements scaled by the largest magnitude, so the result
+// is accurate whenever it is representable.
+template <typename T>
+typename MatrixTraits<T>::real_type norm(ConstMatrixView<T> a);
+
+// Smallest and largest element. A NaN anywhere makes the result NaN. Throw
+// std::invalid_argument on an empty matrix.
+template <typename T>
+T min(ConstMatrixView<T> a);
+template <typename T>
+T max(ConstMatrixView<T> a);
+
+// (row, column) of the first smallest or largest element in row-major order,
+// or of the first NaN if there is one. Throw std::invalid_argument on an
+// empty matrix.
+typedef std::pair<size_t, size_t> Position;
+
+template <typename T>
+Position argmin(ConstMatrixView<T> a);
+template <typename T>
+Position argmax(ConstMatrixView<T> a);
+
+// True when the shapes match and every pair of elements is nearly_equal().
+// Stops at the first block that differs. operator== uses this for matrices
+// and views.
+template <typename T>
+bool equal(ConstMatrixView<T> a, ConstMatrixView<T> b);
+
+// Per-row reductions give a rows x 1 matrix, per-column ones a 1 x cols
+// matrix. The min and max variants throw std::invalid_argument when the rows
+// or columns are empty.
+template <typename T>
+TypedMatrix<T> row_sums(ConstMatrixView<T> a);
+template <typename T>
+TypedMatrix<T> col_sums(ConstMatrixView<T> a);
+template <typename T>
+TypedMatrix<typename MatrixTraits<T>::real_type> row_norms(ConstMatrixView<T> a);
+template <typename T>
+TypedMatrix<typename MatrixTraits<T>::real_type> col_norms(ConstMatrixView<T> a);
+template <typename T>
+TypedMatrix<T> row_min(ConstMatrixView<T> a);
+template <typename T>
+TypedMatrix<T> col_min(ConstMatrixView<T> a);
+template <typename T>
+TypedMatrix<T> row_max(ConstMatrixView<T> a);
+template <typename T>
+TypedMatrix<T> col_max(ConstMatrixView<T> a);
+
+/* Expression overloads *******************************************************/
+
+template <typename E>
+typename E::value_type sum(const MatrixExpr<E>& a, Summation mode = Summation::Blocked) {
+    typedef typename E::value_type T;
+    const auto& x = evaluated(a.self());
+    return sum<T>(ConstMatrixView<T>(x), mode);
+}
+
+template <typename L, typename R>
+typename L::value_type dot(const MatrixExpr<L>& a, const MatrixExpr<R>& b, Summation mode = Summation::Blocked) {
+    static_assert(std::is_same<typename L::value_type, typename R::value_type>::value,
+                  "Operands must have the same element type");
+    typedef typename L::value_type T;
+    const auto& x = evaluated(a.self());
+    const auto& y = evaluated(b.self());
+    return dot<T>(ConstMatrixView<T>(x), ConstMatrixView<T>(y), mode);
+}
+
+template <typename E>
+typename MatrixTraits<typename E::value_type>::real_type norm(const MatrixExpr<E>& a) {
+    typedef typename E::value_type T;
+    const auto& x = evaluated(a.self());
+    return norm<T>(ConstMatrixView<T>(x));
+}
+
+#define REDUCE_FORWARD(R, NAME) \
+    template <typename E> \
+    R NAME(const MatrixExpr<E>& a) { \
+        typedef typename E::value_type T; \
+        const auto& x = evaluated(a.self()); \
+        return NAME<T>(ConstMatrixView<T>(x)); \
+    }
+
+REDUCE_FORWARD(typename E::value_type, min)
+REDUCE_FORWARD(typename E::value_type, max)
+REDUCE_FORWARD(Position, argmin)
+REDUCE_FORWARD(Position, argmax)
+REDUCE_FORWARD(TypedMatrix<typename E::value_type>, row_sums)
+REDUCE_FORWARD(TypedMatrix<typename E::value_type>, col_sums)
+REDUCE_FORWARD(TypedMatrix<typename MatrixTraits<typename E::value_type>::real_type>, row_norms)
+REDUCE_FORWARD(TypedMatrix<typename MatrixTraits<typename E::value_type>::real_type>, col_norms)
+REDUCE_FORWARD(TypedMatrix<typename E::value_type>, row_min)
+REDUCE_FORWARD(TypedMatrix<typename E::value_type>, col_min)
+REDUCE_FORWARD(TypedMatrix<typename E::value_type>, row_max)
+REDUCE_FORWARD(TypedMatrix<typename E::value_type>, col_max)
+
+#undef REDUCE_FORWARD
+
+}
+
+#endif
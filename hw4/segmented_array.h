@@ -0,0 +1,311 @@
+#ifndef SEGMENTED_ARRAY
+#define SEGMENTED_ARRAY
+
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include "typed_array.h"
+
+namespace segmented_array {
+
+// The largest power of two of elements that fits in 4 KiB, at least one.
+template <typename ElementType>
+constexpr int default_block_size() {
+    int n = 1;
+    while (2 * n * sizeof(ElementType) <= 4096) n *= 2;
+    return n;
+}
+
+}
+
+// TypedArray's interface over fixed-size blocks of BlockSize elements, found
+// through a TypedArray of block pointers. Element i lives at position
+// head + i of the concatenated blocks, so access is a shift, a mask and one
+// extra load. Growing at either end adds a block and never moves an element:
+// references stay valid until their element is popped, and a huge array
+// grows without a second copy of itself or an O(n) pause. Only the block
+// index is ever reallocated, and it is BlockSize times smaller.
+//
+// A block that empties is freed, except that one is kept aside so an array
+// whose end hovers around a block boundary does not allocate every time.
+template <typename ElementType, int BlockSize = segmented_array::default_block_size<ElementType>()>
+class SegmentedArray {
+    static_assert(BlockSize > 0 && (BlockSize & (BlockSize - 1)) == 0, "BlockSize must be a power of two");
+
+public:
+    SegmentedArray();
+    SegmentedArray(const SegmentedArray& other);
+    SegmentedArray(SegmentedArray&& other) noexcept;
+    SegmentedArray& operator=(const SegmentedArray& other);
+    SegmentedArray& operator=(SegmentedArray&& other) noexcept;
+    ~SegmentedArray();
+
+    ElementType &get(int index);
+    ElementType &safe_get(int index) const;
+    int size() const;
+
+    void set(int index, const ElementType& value);
+    void set(int index, ElementType&& value);
+
+    void push(const ElementType& value);
+    void push(ElementType&& value);
+    void push_front(const ElementType& value);
+    void push_front(ElementType&& value);
+    ElementType pop();
+    ElementType pop_front();
+
+    template <typename... Args> ElementType& emplace(Args&&... args);
+    template <typename... Args> ElementType& emplace_front(Args&&... args);
+
+    void clear();
+
+private:
+    TypedArray<ElementType*> blocks;
+    int head, count;
+    ElementType * spare;
+
+    ElementType* at(int index) const;
+    ElementType* new_block();
+    void free_block(ElementType* block);
+};
+
+template <typename ElementType, int BlockSize>
+SegmentedArray<ElementType, BlockSize>::SegmentedArray() : head(0), count(0), spare(nullptr) {}
+
+template <typename ElementType, int BlockSize>
+SegmentedArray<ElementType, BlockSize>::SegmentedArray(const SegmentedArray& other) : SegmentedArray() {
+    try {
+        for (int i = 0; i < other.count; i++) emplace(*other.at(i));
+    } catch (...) {
+        clear();
+        free_block(nullptr);
+        throw;
+    }
+}
+
+template <typename ElementType, int BlockSize>
+SegmentedArray<ElementType, BlockSize>::SegmentedArray(SegmentedArray&& other) noexcept
+    : blocks(std::move(other.blocks)), head(other.head), count(other.count), spare(other.spare) {
+    other.head = other.count = 0;
+    other.spare = nullptr;
+}
+
+template <typename ElementType, int BlockSize>
+SegmentedArray<ElementType, BlockSize>& SegmentedArray<ElementType, BlockSize>::operator=(const SegmentedArray& other) {
+    if (this != &other) {
+        *this = SegmentedArray(other);
+    }
+    return *this;
+}
+
+template <typename ElementType, int BlockSize>
+SegmentedArray<ElementType, BlockSize>& SegmentedArray<ElementType, BlockSize>::operator=(SegmentedArray&& other) noexcept {
+    if (this != &other) {
+        clear();
+        free_block(nullptr);
+        blocks = std::move(other.blocks);
+        head = other.head;
+        count = other.count;
+        spare = other.spare;
+        other.head = other.count = 0;
+        other.spare = nullptr;
+    }
+    return *this;
+}
+
+template <typename ElementType, int BlockSize>
+SegmentedArray<ElementType, BlockSize>::~SegmentedArray() {
+    clear();
+    free_block(nullptr);
+}
+
+template <typename ElementType, int BlockSize>
+ElementType &SegmentedArray<ElementType, BlockSize>::get(int index) {
+    if (index < 0) {
+        throw std::range_error("Out of range index in array");
+    }
+    while (index >= size()) emplace();
+    return *at(index);
+}
+
+template <typename ElementType, int BlockSize>
+ElementType &SegmentedArray<ElementType, BlockSize>::safe_get(int index) const {
+    if (index < 0 || index >= size()) {
+        throw std::range_error("Out of range index in array");
+    }
+    return *at(index);
+}
+
+template <typename ElementType, int BlockSize>
+int SegmentedArray<ElementType, BlockSize>::size() const {
+    return count;
+}
+
+template <typename ElementType, int BlockSize>
+void SegmentedArray<ElementType, BlockSize>::set(int index, const ElementType& value) {
+    if (index < 0) {
+        throw std::range_error("Negative index in array");
+    }
+    if (index < size()) {
+        *at(index) = value;
+        return;
+    }
+    while (size() < index) emplace();
+    emplace(value);
+}
+
+template <typename ElementType, int BlockSize>
+void SegmentedArray<ElementType, BlockSize>::set(int index, ElementType&& value) {
+    if (index < 0) {
+        throw std::range_error("Negative index in array");
+    }
+    if (index < size()) {
+        *at(index) = std::move(value);
+        return;
+    }
+    while (size() < index) emplace();
+    emplace(std::move(value));
+}
+
+template <typename ElementType, int BlockSize>
+ElementType* SegmentedArray<ElementType, BlockSize>::at(int index) const {
+    unsigned p = head + index;
+    return blocks.safe_get(p / BlockSize) + p % BlockSize;
+}
+
+template <typename ElementType, int BlockSize>
+ElementType* SegmentedArray<ElementType, BlockSize>::new_block() {
+    if (spare != nullptr) return std::exchange(spare, nullptr);
+    return std::allocator<ElementType>().allocate(BlockSize);
+}
+
+// Keeps block as the spare if there is none yet, otherwise frees it.
+// free_block(nullptr) frees the spare.
+template <typename ElementType, int BlockSize>
+void SegmentedArray<ElementType, BlockSize>::free_block(ElementType* block) {
+    if (block != nullptr && spare == nullptr) {
+        spare = block;
+        return;
+    }
+    ElementType* p = block != nullptr ? block : std::exchange(spare, nullptr);
+    if (p != nullptr) std::allocator<ElementType>().deallocate(p, BlockSize);
+}
+
+// Nothing moves when a block is added, so args may safely refer to elements
+// of this array.
+template <typename ElementType, int BlockSize>
+template <typename... Args>
+ElementType& SegmentedArray<ElementType, BlockSize>::emplace(Args&&... args) {
+    int p = head + count;
+    bool added = p == blocks.size() * BlockSize;
+    if (added) {
+        ElementType* block = new_block();
+        try {
+            blocks.push(block);
+        } catch (...) {
+            free_block(block);
+            throw;
+        }
+    }
+    ElementType* slot = blocks.safe_get(p / BlockSize) + p % BlockSize;
+    try {
+        ::new (static_cast<void*>(slot)) ElementType(std::forward<Args>(args)...);
+    } catch (...) {
+        if (added) free_block(blocks.pop());
+        throw;
+    }
+    count++;
+    return *slot;
+}
+
+template <typename ElementType, int BlockSize>
+template <typename... Args>
+ElementType& SegmentedArray<ElementType, BlockSize>::emplace_front(Args&&... args) {
+    bool added = head == 0;
+    if (added) {
+        ElementType* block = new_block();
+        try {
+            blocks.push_front(block);
+        } catch (...) {
+            free_block(block);
+            throw;
+        }
+        head = BlockSize;
+    }
+    ElementType* slot = blocks.safe_get((head - 1) / BlockSize) + (head - 1) % BlockSize;
+    try {
+        ::new (static_cast<void*>(slot)) ElementType(std::forward<Args>(args)...);
+    } catch (...) {
+        if (added) {
+            free_block(blocks.pop_front());
+            head = 0;
+        }
+        throw;
+    }
+    head--;
+    count++;
+    return *slot;
+}
+
+template <typename ElementType, int BlockSize>
+void SegmentedArray<ElementType, BlockSize>::push(const ElementType& value) {
+    emplace(value);
+}
+
+template <typename ElementType, int BlockSize>
+void SegmentedArray<ElementType, BlockSize>::push(ElementType&& value) {
+    emplace(std::move(value));
+}
+
+template <typename ElementType, int BlockSize>
+void SegmentedArray<ElementType, BlockSize>::push_front(const ElementType& value) {
+    emplace_front(value);
+}
+
+template <typename ElementType, int BlockSize>
+void SegmentedArray<ElementType, BlockSize>::push_front(ElementType&& value) {
+    emplace_front(std::move(value));
+}
+
+template <typename ElementType, int BlockSize>
+ElementType SegmentedArray<ElementType, BlockSize>::pop() {
+    if (size() == 0) {
+        throw std::range_error("Cannot pop from an empty array");
+    }
+    ElementType* slot = at(count - 1);
+    ElementType v = std::move(*slot);
+    std::destroy_at(slot);
+    count--;
+    if ((head + count) % BlockSize == 0 || count == 0) {
+        free_block(blocks.pop());
+        if (count == 0) head = 0;
+    }
+    return v;
+}
+
+template <typename ElementType, int BlockSize>
+ElementType SegmentedArray<ElementType, BlockSize>::pop_front() {
+    if (size() == 0) {
+        throw std::range_error("Cannot pop from an empty array");
+    }
+    ElementType* slot = at(0);
+    ElementType v = std::move(*slot);
+    std::destroy_at(slot);
+    head++;
+    count--;
+    if (head == BlockSize || count == 0) {
+        free_block(blocks.pop_front());
+        head = count == 0 ? 0 : head - BlockSize;
+    }
+    return v;
+}
+
+template <typename ElementType, int BlockSize>
+void SegmentedArray<ElementType, BlockSize>::clear() {
+    for (int i = 0; i < count; i++) std::destroy_at(at(i));
+    while (blocks.size() > 0) free_block(blocks.pop());
+    head = count = 0;
+}
+
+#endif
@@ -0,0 +1,228 @@
+#include "sparse_matrix.h"
+#include <algorithm>
+#include <stdexcept>
+#include "thread_pool.h"
+
+namespace {
+
+// Merges two matrices of the same shape row by row, keeping op(x, y) for every
+// column present in either and dropping results that are exactly zero.
+template <typename T, typename Op>
+TypedSparseMatrix<T> combine(const TypedSparseMatrix<T>& a, const TypedSparseMatrix<T>& b, Op op) {
+    if (a.rows() != b.rows() || a.cols() != b.cols()) throw std::invalid_argument("Dimension mismatch");
+    std::vector<typename TypedSparseMatrix<T>::Triplet> out;
+    out.reserve(a.nonzeros() + b.nonzeros());
+    const auto& ap = a.row_ptr();
+    const auto& bp = b.row_ptr();
+    for (size_t i = 0; i < a.rows(); i++) {
+        size_t p = ap[i], q = bp[i];
+        while (p < ap[i + 1] || q < bp[i + 1]) {
+            size_t ca = p < ap[i + 1] ? a.col_idx()[p] : a.cols();
+            size_t cb = q < bp[i + 1] ? b.col_idx()[q] : b.cols();
+            size_t c = std::min(ca, cb);
+            T x = ca == c ? a.values()[p++] : T(0);
+            T y = cb == c ? b.values()[q++] : T(0);
+            T v = op(x, y);
+            if (v != T(0)) out.push_back({i, c, v});
+        }
+    }
+    return TypedSparseMatrix<T>(a.rows(), a.cols(), out);
+}
+
+}
+
+template <typename T>
+TypedSparseMatrix<T>::TypedSparseMatrix() : rows_(0), cols_(0), row_ptr_(1, 0) {}
+
+template <typename T>
+TypedSparseMatrix<T>::TypedSparseMatrix(size_t rows, size_t cols)
+    : rows_(rows), cols_(cols), row_ptr_(rows + 1, 0) {}
+
+template <typename T>
+TypedSparseMatrix<T>::TypedSparseMatrix(size_t rows, size_t cols, const std::vector<Triplet>& entries)
+    : rows_(rows), cols_(cols), row_ptr_(rows + 1, 0) {
+    // Bucket entries by row, then sort each row by column and fold duplicates.
+    for (const Triplet& t : entries) {
+        if (t.row >= rows_ || t.col >= cols_) throw std::out_of_range("Out of range");
+        row_ptr_[t.row + 1]++;
+    }
+    for (size_t i = 0; i < rows_; i++) row_ptr_[i + 1] += row_ptr_[i];
+    std::vector<std::pair<size_t, T>> slots(entries.size());
+    std::vector<size_t> next(row_ptr_.begin(), row_ptr_.end() - 1);
+    for (const Triplet& t : entries) slots[next[t.row]++] = std::make_pair(t.col, t.value);
+
+    col_idx_.reserve(entries.size());
+    values_.reserve(entries.size());
+    size_t begin = 0;
+    for (size_t i = 0; i < rows_; i++) {
+        size_t end = row_ptr_[i + 1];
+        std::sort(slots.begin() + begin, slots.begin() + end,
+                  [](const std::pair<size_t, T>& x, const std::pair<size_t, T>& y) { return x.first < y.first; });
+        for (size_t p = begin; p < end;) {
+            size_t c = slots[p].first;
+            T v = T(0);
+            for (; p < end && slots[p].first == c; p++) v += slots[p].second;
+            if (v != T(0)) {
+                col_idx_.push_back(c);
+                values_.push_back(v);
+            }
+        }
+        begin = end;
+        row_ptr_[i + 1] = values_.size();
+    }
+}
+
+template <typename T>
+TypedSparseMatrix<T>::TypedSparseMatrix(const TypedMatrix<T>& dense)
+    : rows_(dense.rows()), cols_(dense.cols()), row_ptr_(dense.rows() + 1, 0) {
+    for (size_t i = 0; i < rows_; i++) {
+        for (size_t j = 0; j < cols_; j++) {
+            if (dense(i, j) != T(0)) {
+                col_idx_.push_back(j);
+                values_.push_back(dense(i, j));
+            }
+        }
+        row_ptr_[i + 1] = values_.size();
+    }
+}
+
+template <typename T>
+TypedMatrix<T> TypedSparseMatrix<T>::to_dense() const {
+    TypedMatrix<T> r(rows_, cols_);
+    for (size_t i = 0; i < rows_; i++)
+        for (size_t p = row_ptr_[i]; p < row_ptr_[i + 1]; p++) r(i, col_idx_[p]) = values_[p];
+    return r;
+}
+
+template <typename T>
+std::vector<typename TypedSparseMatrix<T>::Triplet> TypedSparseMatrix<T>::triplets() const {
+    std::vector<Triplet> r;
+    r.reserve(values_.size());
+    for (size_t i = 0; i < rows_; i++)
+        for (size_t p = row_ptr_[i]; p < row_ptr_[i + 1]; p++) r.push_back({i, col_idx_[p], values_[p]});
+    return r;
+}
+
+template <typename T>
+T TypedSparseMatrix<T>::operator()(size_t row, size_t col) const {
+    auto first = col_idx_.begin() + row_ptr_[row];
+    auto last = col_idx_.begin() + row_ptr_[row + 1];
+    auto it = std::lower_bound(first, last, col);
+    if (it == last || *it != col) return T(0);
+    return values_[it - col_idx_.begin()];
+}
+
+template <typename T>
+T TypedSparseMatrix<T>::at(size_t row, size_t col) const {
+    if (row >= rows_ || col >= cols_) throw std::out_of_range("Out of range");
+    return (*this)(row, col);
+}
+
+template <typename T>
+TypedSparseMatrix<T> TypedSparseMatrix<T>::transpose() const {
+    // Counting sort by column; walking rows in order leaves each output row
+    // sorted by its new column index.
+    TypedSparseMatrix r(cols_, rows_);
+    r.col_idx_.resize(values_.size());
+    r.values_.resize(values_.size());
+    for (size_t c : col_idx_) r.row_ptr_[c + 1]++;
+    for (size_t j = 0; j < cols_; j++) r.row_ptr_[j + 1] += r.row_ptr_[j];
+    std::vector<size_t> next(r.row_ptr_.begin(), r.row_ptr_.end() - 1);
+    for (size_t i = 0; i < rows_; i++) {
+        for (size_t p = row_ptr_[i]; p < row_ptr_[i + 1]; p++) {
+            size_t q = next[col_idx_[p]]++;
+            r.col_idx_[q] = i;
+            r.values_[q] = values_[p];
+        }
+    }
+    return r;
+}
+
+template <typename T>
+TypedMatrix<T> TypedSparseMatrix<T>::multiply(ConstMatrixView<T> x) const {
+    if (cols_ != x.rows()) throw std::invalid_argument("Dimension mismatch");
+    size_t n = x.cols();
+    TypedMatrix<T> r(rows_, n);
+    T* out = r.data();
+    // Rows own disjoint output rows, so chunks need no synchronization.
+    size_t work = (values_.size() + rows_) * (n ? n : 1);
+    size_t grain = work ? std::max<size_t>(1, PARALLEL_GRAIN * rows_ / work) : rows_;
+    parallel::parallel_for(rows_, grain, [&](size_t r0, size_t r1) {
+        for (size_t i = r0; i < r1; i++) {
+            T* y = out + i * n;
+            for (size_t p = row_ptr_[i]; p < row_ptr_[i + 1]; p++) {
+                T v = values_[p];
+                const T* xr = x.data() + col_idx_[p] * x.row_stride();
+                if (x.col_stride() == 1) {
+                    for (size_t j = 0; j < n; j++) y[j] += v * xr[j];
+                } else {
+                    for (size_t j = 0; j < n; j++) y[j] += v * xr[j * x.col_stride()];
+                }
+            }
+        }
+    });
+    return r;
+}
+
+template <typename T>
+TypedSparseMatrix<T>& TypedSparseMatrix<T>::operator*=(T scalar) {
+    if (scalar == T(0)) {
+        *this = TypedSparseMatrix(rows_, cols_);
+        return *this;
+    }
+    for (T& v : values_) v *= scalar;
+    return *this;
+}
+
+template <typename T>
+TypedSparseMatrix<T> operator+(const TypedSparseMatrix<T>& a, const TypedSparseMatrix<T>& b) {
+    return combine(a, b, [](T x, T y) { return x + y; });
+}
+
+template <typename T>
+TypedSparseMatrix<T> operator-(const TypedSparseMatrix<T>& a, const TypedSparseMatrix<T>& b) {
+    return combine(a, b, [](T x, T y) { return x - y; });
+}
+
+template <typename T>
+TypedSparseMatrix<T> operator-(const TypedSparseMatrix<T>& a) {
+    return a * T(-1);
+}
+
+template <typename T>
+TypedSparseMatrix<T> operator*(const TypedSparseMatrix<T>& a, typename TypedSparseMatrix<T>::value_type scalar) {
+    TypedSparseMatrix<T> r(a);
+    r *= scalar;
+    return r;
+}
+
+template <typename T>
+TypedSparseMatrix<T> operator*(typename TypedSparseMatrix<T>::value_type scalar, const TypedSparseMatrix<T>& a) {
+    return a * scalar;
+}
+
+template <typename T>
+bool operator==(const TypedSparseMatrix<T>& a, const TypedSparseMatrix<T>& b) {
+    if (a.rows() != b.rows() || a.cols() != b.cols()) return false;
+    bool equal = true;
+    // Reuse the row merge; an absent entry compares as zero.
+    combine(a, b, [&](T x, T y) {
+        if (!nearly_equal(x, y)) equal = false;
+        return T(0);
+    });
+    return equal;
+}
+
+#define INSTANTIATE_SPARSE(T) \
+    template class TypedSparseMatrix<T>; \
+    template TypedSparseMatrix<T> operator+<T>(const TypedSparseMatrix<T>&, const TypedSparseMatrix<T>&); \
+    template TypedSparseMatrix<T> operator-<T>(const TypedSparseMatrix<T>&, const TypedSparseMatrix<T>&); \
+    template TypedSparseMatrix<T> operator-<T>(const TypedSparseMatrix<T>&); \
+    template TypedSparseMatrix<T> operator*<T>(const TypedSparseMatrix<T>&, T); \
+    template TypedSparseMatrix<T> operator*<T>(T, const TypedSparseMatrix<T>&); \
+    template bool operator==<T>(const TypedSparseMatrix<T>&, const TypedSparseMatrix<T>&);
+
+INSTANTIATE_SPARSE(float)
+INSTANTIATE_SPARSE(double)
+INSTANTIATE_SPARSE(int32_t)
+INSTANTIATE_SPARSE(int64_t)
@@ -0,0 +1,90 @@
+#ifndef SPARSE_MATRIX_H
+#define SPARSE_MATRIX_H
+
+#include <cstddef>
+#include <vector>
+#include "matrix.h"
+
+// Sparse matrix in compressed sparse row (CSR) form: the nonzeros of row i
+// are values()[row_ptr()[i] .. row_ptr()[i + 1]), sorted by column, with their
+// columns in col_idx(). Storage and the cost of every operation grow with the
+// number of nonzeros, not with rows * cols. The member definitions live in
+// sparse_matrix.cc and are instantiated for float, double, int32_t and int64_t.
+template <typename T>
+class TypedSparseMatrix {
+private:
+    size_t rows_;
+    size_t cols_;
+    std::vector<size_t> row_ptr_;
+    std::vector<size_t> col_idx_;
+    std::vector<T> values_;
+
+public:
+    typedef T value_type;
+
+    // One coordinate (COO) entry, used to assemble a matrix.
+    struct Triplet {
+        size_t row;
+        size_t col;
+        T value;
+    };
+
+    // Multiply-adds per chunk of rows handed to the thread pool.
+    static constexpr size_t PARALLEL_GRAIN = 1 << 15;
+
+    TypedSparseMatrix();
+    TypedSparseMatrix(size_t rows, size_t cols);
+    // Entries may come in any order; duplicates are summed and zeros dropped.
+    TypedSparseMatrix(size_t rows, size_t cols, const std::vector<Triplet>& entries);
+    explicit TypedSparseMatrix(const TypedMatrix<T>& dense);
+
+    TypedMatrix<T> to_dense() const;
+    std::vector<Triplet> triplets() const;
+
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+    size_t nonzeros() const { return values_.size(); }
+
+    const std::vector<size_t>& row_ptr() const { return row_ptr_; }
+    const std::vector<size_t>& col_idx() const { return col_idx_; }
+    const std::vector<T>& values() const { return values_; }
+
+    // Element lookup; absent entries read as zero.
+    T operator()(size_t row, size_t col) const;
+    T at(size_t row, size_t col) const;
+
+    TypedSparseMatrix transpose() const;
+
+    // this * x for a dense (or view) x, computed in parallel over rows. With a
+    // single column this is a sparse matrix-vector product.
+    TypedMatrix<T> multiply(ConstMatrixView<T> x) const;
+
+    TypedSparseMatrix& operator*=(T scalar);
+};
+
+typedef TypedSparseMatrix<double> SparseMatrix;
+
+template <typename T>
+TypedSparseMatrix<T> operator+(const TypedSparseMatrix<T>& a, const TypedSparseMatrix<T>& b);
+template <typename T>
+TypedSparseMatrix<T> operator-(const TypedSparseMatrix<T>& a, const TypedSparseMatrix<T>& b);
+template <typename T>
+TypedSparseMatrix<T> operator-(const TypedSparseMatrix<T>& a);
+template <typename T>
+TypedSparseMatrix<T> operator*(const TypedSparseMatrix<T>& a, typename TypedSparseMatrix<T>::value_type scalar);
+template <typename T>
+TypedSparseMatrix<T> operator*(typename TypedSparseMatrix<T>::value_type scalar, const TypedSparseMatrix<T>& a);
+
+template <typename T>
+TypedMatrix<T> operator*(const TypedSparseMatrix<T>& a, const TypedMatrix<T>& b) {
+    return a.multiply(b);
+}
+
+template <typename T>
+bool operator==(const TypedSparseMatrix<T>& a, const TypedSparseMatrix<T>& b);
+template <typename T>
+bool operator!=(const TypedSparseMatrix<T>& a, const TypedSparseMatrix<T>& b) {
+    return !(a == b);
+}
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef STATIC_MATRIX_H
+#define STATIC_MATRIX_H
+
+#include <cmath>
+#include <cstddef>
+#include <initializer_list>
+#include <stdexcept>
+#include "matrix.h"
+
+// Fixed-size R x C matrix with inline row-major storage. Dimensions are part
+// of the type, so mismatched operands fail to compile and small products can
+// be fully unrolled. Most operations are constexpr. T is one of the element
+// types TypedMatrix supports.
+template <size_t R, size_t C, typename T = double>
+class StaticMatrix {
+    static_assert(R > 0 && C > 0, "StaticMatrix dimensions must be positive");
+
+private:
+    T data_[R * C];
+
+public:
+    constexpr StaticMatrix() : data_() {}
+
+    constexpr explicit StaticMatrix(T value) : data_() {
+        for (size_t i = 0; i < R * C; i++) data_[i] = value;
+    }
+
+    constexpr StaticMatrix(std::initializer_list<std::initializer_list<T>> list) : data_() {
+        if (list.size() != R) throw std::invalid_argument("Dimension mismatch");
+        size_t r = 0;
+        for (auto& row : list) {
+            if (row.size() != C) throw std::invalid_argument("Dimension mismatch");
+            size_t c = 0;
+            for (const T& v : row) data_[r * C + c++] = v;
+            r++;
+        }
+    }
+
+    explicit StaticMatrix(const TypedMatrix<T>& m) : data_() {
+        if (m.rows() != R || m.cols() != C) throw std::invalid_argument("Dimension mismatch");
+        for (size_t i = 0; i < R; i++)
+            for (size_t j = 0; j < C; j++) data_[i * C + j] = m(i, j);
+    }
+
+    operator TypedMatrix<T>() const {
+        TypedMatrix<T> m(R, C);
+        for (size_t i = 0; i < R; i++)
+            for (size_t j = 0; j < C; j++) m(i, j) = data_[i * C + j];
+        return m;
+    }
+
+    static constexpr size_t rows() { return R; }
+    static constexpr size_t cols() { return C; }
+
+    constexpr T& operator()(size_t row, size_t col) { return data_[row * C + col]; }
+    constexpr const T& operator()(size_t row, size_t col) const { return data_[row * C + col]; }
+
+    constexpr T& at(size_t row, size_t col) {
+        if (row >= R || col >= C) throw std::out_of_range("Out of range");
+        return data_[row * C + col];
+    }
+
+    constexpr const T& at(size_t row, size_t col) const {
+        if (row >= R || col >= C) throw std::out_of_range("Out of range");
+        return data_[row * C + col];
+    }
+
+    static constexpr StaticMatrix identity() {
+        static_assert(R == C, "Identity of non-square matrix");
+        StaticMatrix m;
+        for (size_t i = 0; i < R; i++) m.data_[i * C + i] = T(1);
+        return m;
+    }
+
+    constexpr StaticMatrix<C, R, T> transpose() const {
+        StaticMatrix<C, R, T> t;
+        for (size_t i = 0; i < R; i++)
+            for (size_t j = 0; j < C; j++) t(j, i) = data_[i * C + j];
+        return t;
+    }
+
+    constexpr T trace() const {
+        static_assert(R == C, "Trace on non-square matrix");
+        T s = T(0);
+        for (size_t i = 0; i < R; i++) s += data_[i * C + i];
+        return s;
+    }
+
+    T norm() const {
+        T s = T(0);
+        for (size_t i = 0; i < R * C; i++) s += data_[i] * data_[i];
+        return std::sqrt(s);
+    }
+
+    constexpr StaticMatrix& operator+=(const StaticMatrix& other) {
+        for (size_t i = 0; i < R * C; i++) data_[i] += other.data_[i];
+        return *this;
+    }
+
+    constexpr StaticMatrix& operator-=(const StaticMatrix& other) {
+        for (size_t i = 0; i < R * C; i++) data_[i] -= other.data_[i];
+        return *this;
+    }
+
+    constexpr StaticMatrix& operator*=(T scalar) {
+        for (size_t i = 0; i < R * C; i++) data_[i] *= scalar;
+        return *this;
+    }
+
+    constexpr StaticMatrix operator+(const StaticMatrix& other) const {
+        StaticMatrix r(*this);
+        return r += other;
+    }
+
+    constexpr StaticMatrix operator-(const StaticMatrix& other) const {
+        StaticMatrix r(*this);
+        return r -= other;
+    }
+
+    constexpr StaticMatrix operator-() const {
+        StaticMatrix r;
+        for (size_t i = 0; i < R * C; i++) r.data_[i] = -data_[i];
+        return r;
+    }
+
+    constexpr StaticMatrix operator*(T scalar) const {
+        StaticMatrix r(*this);
+        return r *= scalar;
+    }
+
+    friend constexpr StaticMatrix operator*(T scalar, const StaticMatrix& m) {
+        return m * scalar;
+    }
+
+    constexpr StaticMatrix operator/(T scalar) const {
+        if ((scalar < T(0) ? -scalar : scalar) <= MatrixTraits<T>::epsilon) throw std::invalid_argument("Division by zero");
+        StaticMatrix r;
+        for (size_t i = 0; i < R * C; i++) r.data_[i] = data_[i] / scalar;
+        return r;
+    }
+
+    constexpr bool operator==(const StaticMatrix& other) const {
+        for (size_t i = 0; i < R * C; i++) {
+            T d = data_[i] - other.data_[i];
+            if (d > MatrixTraits<T>::epsilon || -d > MatrixTraits<T>::epsilon) return false;
+        }
+        return true;
+    }
+
+    constexpr bool operator!=(const StaticMatrix& other) const {
+        return !(*this == other);
+    }
+};
+
+template <size_t R, size_t K1, size_t K2, size_t C, typename T>
+constexpr StaticMatrix<R, C, T> operator*(const StaticMatrix<R, K1, T>& a, const StaticMatrix<K2, C, T>& b) {
+    static_assert(K1 == K2, "Dimension mismatch");
+    StaticMatrix<R, C, T> r;
+    for (size_t i = 0; i < R; i++) {
+        for (size_t k = 0; k < K1; k++) {
+            T aik = a(i, k);
+            for (size_t j = 0; j < C; j++) r(i, j) += aik * b(k, j);
+        }
+    }
+    return r;
+}
+
+typedef StaticMatrix<2, 2> Matrix2;
+typedef StaticMatrix<3, 3> Matrix3;
+typedef StaticMatrix<4, 4> Matrix4;
+
+#endif
@@ -0,0 +1,245 @@
+#include "strassen.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include "thread_pool.h"
+
+namespace strassen {
+
+namespace {
+
+// The process-wide config is read on every operator*, so readers take no
+// lock: they retry if set_config() ran meanwhile, which it marks by making
+// config_version odd while it writes. Writers serialize on the mutex.
+std::mutex config_mutex;
+std::atomic<unsigned> config_version(0);
+std::atomic<bool> global_enabled(Config().enabled);
+std::atomic<size_t> global_threshold(Config().threshold);
+std::atomic<size_t> global_crossover(Config().crossover);
+thread_local const Config* scoped_config = nullptr;
+
+// Recursion depth for an m x k by k x n product: halve until the smallest
+// dimension is at most the crossover.
+size_t levels_for(size_t m, size_t k, size_t n, size_t crossover) {
+    size_t d = std::min(m, std::min(k, n));
+    size_t levels = 0;
+    while (d > std::max<size_t>(crossover, 1)) {
+        d = (d + 1) / 2;
+        levels++;
+    }
+    return levels;
+}
+
+size_t padded(size_t d, size_t levels) {
+    size_t unit = size_t(1) << levels;
+    return (d + unit - 1) / unit * unit;
+}
+
+// Scratch used by the recursion below one level of an m x k by k x n
+// product: an A- or C-shaped quarter X, a B-shaped quarter Y, then the
+// same for the half-size products.
+template <typename T>
+size_t recursion_size(size_t m, size_t k, size_t n, size_t levels) {
+    size_t total = 0;
+    for (; levels > 0; levels--) {
+        m /= 2;
+        k /= 2;
+        n /= 2;
+        total += Workspace<T>::rounded(m * std::max(k, n)) + Workspace<T>::rounded(k * n);
+    }
+    return total;
+}
+
+// Padded or contiguous copies of both operands and of the result.
+template <typename T>
+size_t copies_size(size_t mp, size_t kp, size_t np) {
+    return Workspace<T>::rounded(mp * kp) + Workspace<T>::rounded(kp * np) + Workspace<T>::rounded(mp * np);
+}
+
+// out = x + y or x - y over a rows x cols block; every operand is row-major
+// with unit column stride.
+template <typename T, bool Subtract>
+void combine(size_t rows, size_t cols, T* out, size_t ldo, const T* x, size_t ldx, const T* y, size_t ldy) {
+    size_t grain = cols ? (Matrix::ELEMENTWISE_GRAIN + cols - 1) / cols : 1;
+    parallel::parallel_for(rows, grain, [&](size_t r0, size_t r1) {
+        for (size_t i = r0; i < r1; i++) {
+            T* o = out + i * ldo;
+            const T* xi = x + i * ldx;
+            const T* yi = y + i * ldy;
+            for (size_t j = 0; j < cols; j++) o[j] = Subtract ? xi[j] - yi[j] : xi[j] + yi[j];
+        }
+    });
+}
+
+template <typename T>
+void add(size_t rows, size_t cols, T* out, size_t ldo, const T* x, size_t ldx, const T* y, size_t ldy) {
+    combine<T, false>(rows, cols, out, ldo, x, ldx, y, ldy);
+}
+
+template <typename T>
+void sub(size_t rows, size_t cols, T* out, size_t ldo, const T* x, size_t ldx, const T* y, size_t ldy) {
+    combine<T, true>(rows, cols, out, ldo, x, ldx, y, ldy);
+}
+
+// c = a * b for row-major blocks whose dimensions are divisible by
+// 2^levels. Uses the two-temporary schedule of Douglas et al., "GEMMW: A
+// portable level 3 BLAS Winograd variant of Strassen's matrix-matrix
+// multiply algorithm" (1994), writing the seven products into the quadrants
+// of C as it goes.
+template <typename T>
+void winograd(size_t m, size_t k, size_t n, const T* a, size_t lda, const T* b, size_t ldb,
+              T* c, size_t ldc, size_t levels, Workspace<T>& ws) {
+    if (levels == 0) {
+        gemm<T>(T(1), ConstMatrixView<T>(a, m, k, lda, 1), ConstMatrixView<T>(b, k, n, ldb, 1),
+                T(0), MatrixView<T>(c, m, n, ldc, 1));
+        return;
+    }
+    size_t m2 = m / 2, k2 = k / 2, n2 = n / 2;
+    const T *a11 = a, *a12 = a + k2, *a21 = a + m2 * lda, *a22 = a21 + k2;
+    const T *b11 = b, *b12 = b + n2, *b21 = b + k2 * ldb, *b22 = b21 + n2;
+    T *c11 = c, *c12 = c + n2, *c21 = c + m2 * ldc, *c22 = c21 + n2;
+
+    size_t mark = ws.mark();
+    T* x = ws.take(m2 * std::max(k2, n2));
+    T* y = ws.take(k2 * n2);
+    size_t ldx = k2, ldy = n2;
+    auto product = [&](const T* p, size_t ldp, const T* q, size_t ldq, T* r, size_t ldr) {
+        winograd(m2, k2, n2, p, ldp, q, ldq, r, ldr, levels - 1, ws);
+    };
+
+    sub(m2, k2, x, ldx, a11, lda, a21, lda);      // S3 = A11 - A21
+    sub(k2, n2, y, ldy, b22, ldb, b12, ldb);      // T3 = B22 - B12
+    product(x, ldx, y, ldy, c21, ldc);            // P7 = S3 T3
+    add(m2, k2, x, ldx, a21, lda, a22, lda);      // S1 = A21 + A22
+    sub(k2, n2, y, ldy, b12, ldb, b11, ldb);      // T1 = B12 - B11
+    product(x, ldx, y, ldy, c22, ldc);            // P5 = S1 T1
+    sub(m2, k2, x, ldx, x, ldx, a11, lda);        // S2 = S1 - A11
+    sub(k2, n2, y, ldy, b22, ldb, y, ldy);        // T2 = B22 - T1
+    product(x, ldx, y, ldy, c12, ldc);            // P6 = S2 T2
+    sub(m2, k2, x, ldx, a12, lda, x, ldx);        // S4 = A12 - S2
+    product(x, ldx, b22, ldb, c11, ldc);          // P3 = S4 B22
+    product(a11, lda, b11, ldb, x, n2);           // P1 = A11 B11, now C-shaped
+    add(m2, n2, c12, ldc, x, n2, c12, ldc);       // U2 = P1 + P6
+    add(m2, n2, c21, ldc, c12, ldc, c21, ldc);    // U3 = U2 + P7
+    add(m2, n2, c12, ldc, c12, ldc, c22, ldc);    // U4 = U2 + P5
+    add(m2, n2, c22, ldc, c21, ldc, c22, ldc);    // C22 = U7 = U3 + P5
+    add(m2, n2, c12, ldc, c12, ldc, c11, ldc);    // C12 = U5 = U4 + P3
+    sub(k2, n2, y, ldy, y, ldy, b21, ldb);        // T4 = T2 - B21
+    product(a22, lda, y, ldy, c11, ldc);          // P4 = A22 T4
+    sub(m2, n2, c21, ldc, c21, ldc, c11, ldc);    // C21 = U6 = U3 - P4
+    product(a12, lda, b21, ldb, c11, ldc);        // P2 = A12 B21
+    add(m2, n2, c11, ldc, x, n2, c11, ldc);       // C11 = U1 = P1 + P2
+
+    ws.release(mark);
+}
+
+// True when the address ranges spanned by two nonempty views intersect.
+template <typename T>
+bool spans_overlap(ConstMatrixView<T> x, ConstMatrixView<T> y) {
+    const T* x_end = &x(x.rows() - 1, x.cols() - 1) + 1;
+    const T* y_end = &y(y.rows() - 1, y.cols() - 1) + 1;
+    std::less<const T*> before;
+    return before(x.data(), y_end) && before(y.data(), x_end);
+}
+
+// Copies a view into a zero-padded rows x cols row-major buffer.
+template <typename T>
+void pack(ConstMatrixView<T> v, T* dst, size_t rows, size_t cols) {
+    std::fill(dst, dst + rows * cols, T(0));
+    for (size_t i = 0; i < v.rows(); i++)
+        for (size_t j = 0; j < v.cols(); j++) dst[i * cols + j] = v(i, j);
+}
+
+}
+
+void set_config(const Config& config) {
+    std::lock_guard<std::mutex> lock(config_mutex);
+    unsigned v = config_version.load(std::memory_order_relaxed);
+    config_version.store(v + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    global_enabled.store(config.enabled, std::memory_order_relaxed);
+    global_threshold.store(config.threshold, std::memory_order_relaxed);
+    global_crossover.store(config.crossover, std::memory_order_relaxed);
+    config_version.store(v + 2, std::memory_order_release);
+}
+
+Config config() {
+    if (scoped_config) return *scoped_config;
+    Config c;
+    unsigned before, after;
+    do {
+        before = config_version.load(std::memory_order_acquire);
+        c.enabled = global_enabled.load(std::memory_order_relaxed);
+        c.threshold = global_threshold.load(std::memory_order_relaxed);
+        c.crossover = global_crossover.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = config_version.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+    return c;
+}
+
+ScopedConfig::ScopedConfig(const Config& config) : previous_(scoped_config), config_(config) {
+    scoped_config = &config_;
+}
+
+ScopedConfig::~ScopedConfig() {
+    scoped_config = previous_;
+}
+
+template <typename T>
+size_t workspace_size(size_t m, size_t k, size_t n, size_t crossover) {
+    size_t levels = levels_for(m, k, n, crossover);
+    if (levels == 0) return 0;
+    size_t mp = padded(m, levels), kp = padded(k, levels), np = padded(n, levels);
+    return recursion_size<T>(mp, kp, np, levels) + copies_size<T>(mp, kp, np);
+}
+
+template <typename T>
+void multiply(typename matrix_view::Nondeduced<ConstMatrixView<T>>::type a,
+              typename matrix_view::Nondeduced<ConstMatrixView<T>>::type b,
+              MatrixView<T> c, size_t crossover) {
+    if (a.cols() != b.rows() || c.rows() != a.rows() || c.cols() != b.cols()) {
+        throw std::invalid_argument("Dimension mismatch");
+    }
+    if (crossover == 0) crossover = config().crossover;
+    size_t m = a.rows(), k = a.cols(), n = b.cols();
+    size_t levels = levels_for(m, k, n, crossover);
+    if (levels == 0 || m == 0 || k == 0 || n == 0) {
+        gemm<T>(T(1), a, b, T(0), c);
+        return;
+    }
+
+    // Unpadded operands with unit column stride are used in place. The
+    // recursion writes c before it has finished reading a and b, so an
+    // aliased c goes through copies too.
+    size_t mp = padded(m, levels), kp = padded(k, levels), np = padded(n, levels);
+    bool in_place = mp == m && kp == k && np == n &&
+                    a.col_stride() == 1 && b.col_stride() == 1 && c.col_stride() == 1 &&
+                    !spans_overlap<T>(c, a) && !spans_overlap<T>(c, b);
+    size_t capacity = recursion_size<T>(mp, kp, np, levels);
+    Workspace<T> ws(in_place ? capacity : capacity + copies_size<T>(mp, kp, np));
+    if (in_place) {
+        winograd(m, k, n, a.data(), a.row_stride(), b.data(), b.row_stride(),
+                 c.data(), c.row_stride(), levels, ws);
+        return;
+    }
+    T* ap = ws.take(mp * kp);
+    T* bp = ws.take(kp * np);
+    T* cp = ws.take(mp * np);
+    pack(a, ap, mp, kp);
+    pack(b, bp, kp, np);
+    winograd(mp, kp, np, ap, kp, bp, np, cp, np, levels, ws);
+    c = ConstMatrixView<T>(cp, m, n, np, 1);
+}
+
+#define INSTANTIATE_STRASSEN(T) \
+    template size_t workspace_size<T>(size_t, size_t, size_t, size_t); \
+    template void multiply<T>(ConstMatrixView<T>, ConstMatrixView<T>, MatrixView<T>, size_t);
+
+INSTANTIATE_STRASSEN(float)
+INSTANTIATE_STRASSEN(double)
+INSTANTIATE_STRASSEN(int32_t)
+INSTANTIATE_STRASSEN(int64_t)
+
+}
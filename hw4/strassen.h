@@ -0,0 +1,108 @@
+#ifndef STRASSEN_H
+#define STRASSEN_H
+
+#include <cstddef>
+#include <vector>
+#include "aligned_allocator.h"
+#include "matrix.h"
+
+// Strassen–Winograd matrix multiplication: 7 half-size products and 15 block
+// additions per level instead of 8 products, recursing until a block
+// dimension reaches the crossover and handing the leaves to gemm(). Dimensions
+// are zero padded up to the leaf size times a power of two.
+//
+// Floating-point results are less accurate than the classic product. With
+// n the largest dimension, n0 the leaf size and u the unit roundoff, every
+// element of the computed product C' satisfies (Higham, Accuracy and
+// Stability of Numerical Algorithms, 2nd ed., eq. 23.8)
+//
+//     |C' - C| <= [(n / n0)^log2(18) * (n0^2 + 6 n0) - 6 n] u max|A| max|B|
+//
+// to first order, against n^2 u max|A| max|B| for the classic product. In
+// practice the error is far below the bound. Integer products are exact
+// (modulo wraparound, like the classic product).
+
+namespace strassen {
+
+struct Config {
+    // operator* uses Strassen–Winograd when enabled and every dimension of the
+    // product is at least threshold.
+    bool enabled = false;
+    size_t threshold = 2048;
+    // Blocks with a dimension at or below this go to the conventional kernel.
+    size_t crossover = 512;
+};
+
+// Process-wide policy for operator*. Disabled by default.
+void set_config(const Config& config);
+
+// Policy for the calling thread: the innermost ScopedConfig on this thread if
+// there is one, the process-wide one otherwise.
+Config config();
+
+// Overrides the policy for the calling thread until it goes out of scope:
+//
+//     { strassen::ScopedConfig fast({true, 2048, 512}); c = a * b; }
+class ScopedConfig {
+public:
+    explicit ScopedConfig(const Config& config);
+    ~ScopedConfig();
+    ScopedConfig(const ScopedConfig&) = delete;
+    ScopedConfig& operator=(const ScopedConfig&) = delete;
+private:
+    const Config* previous_;
+    Config config_;
+};
+
+// Stack-ordered scratch memory of a fixed capacity, allocated once. Blocks are
+// 64-byte aligned and must be released in reverse order of allocation.
+template <typename T>
+class Workspace {
+public:
+    static constexpr size_t ALIGN = 64 / sizeof(T);
+
+    explicit Workspace(size_t capacity) : buffer_(capacity), used_(0) {}
+
+    // Throws std::length_error if the block does not fit.
+    T* take(size_t n) {
+        n = rounded(n);
+        if (n > buffer_.size() - used_) throw std::length_error("Workspace exhausted");
+        T* p = buffer_.data() + used_;
+        used_ += n;
+        return p;
+    }
+    size_t mark() const { return used_; }
+    void release(size_t mark) { used_ = mark; }
+    size_t capacity() const { return buffer_.size(); }
+
+    static size_t rounded(size_t n) { return (n + ALIGN - 1) / ALIGN * ALIGN; }
+
+private:
+    std::vector<T, AlignedAllocator<T>> buffer_;
+    size_t used_;
+};
+
+// Upper bound on the workspace elements multiply() allocates for an m x k by
+// k x n product: the recursion's temporaries, which total about a third of
+// the operands, plus padded copies of the operands and result when needed.
+template <typename T>
+size_t workspace_size(size_t m, size_t k, size_t n, size_t crossover);
+
+// c = a * b by Strassen–Winograd, with T taken from c. A crossover of zero
+// uses config().crossover. Throws std::invalid_argument on a shape mismatch.
+template <typename T>
+void multiply(typename matrix_view::Nondeduced<ConstMatrixView<T>>::type a,
+              typename matrix_view::Nondeduced<ConstMatrixView<T>>::type b,
+              MatrixView<T> c, size_t crossover = 0);
+
+template <typename T>
+TypedMatrix<T> multiply(const TypedMatrix<T>& a, const TypedMatrix<T>& b, size_t crossover = 0) {
+    if (a.cols() != b.rows()) throw std::invalid_argument("Dimension mismatch");
+    TypedMatrix<T> c(a.rows(), b.cols());
+    multiply<T>(a, b, MatrixView<T>(c), crossover);
+    return c;
+}
+
+}
+
+#endif
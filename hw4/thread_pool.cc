@@ -0,0 +1,184 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+
+namespace {
+
+std::atomic<size_t> global_threads(0);
+thread_local size_t scoped_threads = 0;
+thread_local bool inside_task = false;
+
+// hardware_concurrency() reads sysfs on every call, which costs more than a
+// small matrix operation, so ask once.
+size_t default_threads() {
+    static const size_t n = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    return n;
+}
+
+// Workers are started lazily and live until exit. One job runs at a time;
+// the submitting thread works on it too, so a job using n threads wakes n - 1
+// workers.
+class ThreadPool {
+public:
+    static ThreadPool& instance() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    void run(size_t tasks, size_t threads, const std::function<void(size_t)>& task) {
+        std::lock_guard<std::mutex> submit(submit_mutex_);
+        size_t helpers = std::min(threads, tasks) - 1;
+        start_workers(helpers);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = &task;
+            job_tasks_ = tasks;
+            next_.store(0);
+            error_ = nullptr;
+            helpers_ = helpers;
+            busy_ = helpers;
+            generation_++;
+        }
+        wake_.notify_all();
+
+        work();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return busy_ == 0; });
+        job_ = nullptr;
+        if (error_) std::rethrow_exception(error_);
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& t : threads_) t.join();
+    }
+
+private:
+    std::mutex submit_mutex_;
+    std::mutex mutex_;
+    std::condition_variable wake_, done_;
+    std::vector<std::thread> threads_;
+    const std::function<void(size_t)>* job_ = nullptr;
+    size_t job_tasks_ = 0;
+    std::atomic<size_t> next_{0};
+    std::exception_ptr error_;
+    size_t helpers_ = 0;
+    size_t busy_ = 0;
+    unsigned long generation_ = 0;
+    bool stop_ = false;
+
+    void start_workers(size_t n) {
+        while (threads_.size() < n) {
+            size_t id = threads_.size();
+            threads_.emplace_back([this, id] { worker(id); });
+        }
+    }
+
+    void work() {
+        inside_task = true;
+        size_t i;
+        while ((i = next_.fetch_add(1)) < job_tasks_) {
+            try {
+                (*job_)(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!error_) error_ = std::current_exception();
+            }
+        }
+        inside_task = false;
+    }
+
+    void worker(size_t id) {
+        unsigned long seen = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            wake_.wait(lock, [&] { return stop_ || (generation_ != seen && id < helpers_); });
+            if (stop_) return;
+            seen = generation_;
+            lock.unlock();
+            work();
+            lock.lock();
+            if (--busy_ == 0) done_.notify_one();
+        }
+    }
+};
+
+}
+
+void set_num_threads(size_t n) {
+    global_threads.store(n);
+}
+
+size_t num_threads() {
+    if (scoped_threads != 0) return scoped_threads;
+    size_t n = global_threads.load();
+    return n == 0 ? default_threads() : n;
+}
+
+ScopedNumThreads::ScopedNumThreads(size_t n) : previous_(scoped_threads) {
+    scoped_threads = n;
+}
+
+ScopedNumThreads::~ScopedNumThreads() {
+    scoped_threads = previous_;
+}
+
+void run(size_t tasks, const std::function<void(size_t)>& task) {
+    size_t threads = num_threads();
+    if (tasks <= 1 || threads <= 1 || inside_task) {
+        for (size_t i = 0; i < tasks; i++) task(i);
+        return;
+    }
+    ThreadPool::instance().run(tasks, threads, task);
+}
+
+void parallel_for(size_t count, size_t grain,
+                  const std::function<void(size_t, size_t)>& fn) {
+    if (count == 0) return;
+    grain = std::max<size_t>(grain, 1);
+    size_t threads = num_threads();
+    if (count < 2 * grain || threads <= 1 || inside_task) {
+        fn(0, count);
+        return;
+    }
+    // A few chunks per thread smooths out uneven progress between threads.
+    size_t chunks = std::min(count / grain, 4 * threads);
+    run(chunks, [&](size_t i) {
+        fn(count * i / chunks, count * (i + 1) / chunks);
+    });
+}
+
+void parallel_for_2d(size_t rows, size_t cols, size_t min_rows, size_t min_cols,
+                     const std::function<void(size_t, size_t, size_t, size_t)>& fn) {
+    if (rows == 0 || cols == 0) return;
+    size_t threads = inside_task ? 1 : num_threads();
+    size_t target = 4 * threads;
+    size_t max_rt = std::max<size_t>(rows / std::max<size_t>(min_rows, 1), 1);
+    size_t max_ct = std::max<size_t>(cols / std::max<size_t>(min_cols, 1), 1);
+    // Split rows first since tiles spanning whole rows are contiguous in memory.
+    size_t rt = std::min(max_rt, target);
+    size_t ct = std::min(max_ct, (target + rt - 1) / rt);
+    if (threads <= 1 || rt * ct == 1) {
+        fn(0, rows, 0, cols);
+        return;
+    }
+    run(rt * ct, [&](size_t t) {
+        size_t i = t / ct, j = t % ct;
+        fn(rows * i / rt, rows * (i + 1) / rt, cols * j / ct, cols * (j + 1) / ct);
+    });
+}
+
+}
@@ -0,0 +1,50 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <cstddef>
+#include <functional>
+
+namespace parallel {
+
+// Number of threads parallel operations may use. Zero restores the default,
+// which is std::thread::hardware_concurrency().
+void set_num_threads(size_t n);
+
+// Threads available to the calling thread: the innermost ScopedNumThreads on
+// this thread if there is one, the global setting otherwise.
+size_t num_threads();
+
+// Overrides the thread count for the calling thread until it goes out of
+// scope, so a single call can be run with a different degree of parallelism:
+//
+//     { parallel::ScopedNumThreads t(4); c = a * b; }
+class ScopedNumThreads {
+public:
+    explicit ScopedNumThreads(size_t n);
+    ~ScopedNumThreads();
+    ScopedNumThreads(const ScopedNumThreads&) = delete;
+    ScopedNumThreads& operator=(const ScopedNumThreads&) = delete;
+private:
+    size_t previous_;
+};
+
+// Calls task(i) for every i in [0, tasks) on the persistent pool, using at
+// most num_threads() threads including the caller. Returns once every task
+// has finished and rethrows the first exception a task threw. Calls made
+// from inside a task run serially on the calling thread.
+void run(size_t tasks, const std::function<void(size_t)>& task);
+
+// Splits [0, count) into contiguous chunks of at least grain items and calls
+// fn(begin, end) for each chunk. Runs serially when count is below 2 * grain
+// or only one thread is available.
+void parallel_for(size_t count, size_t grain,
+                  const std::function<void(size_t, size_t)>& fn);
+
+// Splits a rows x cols index space into tiles of at least min_rows x min_cols
+// and calls fn(r0, r1, c0, c1) for each tile.
+void parallel_for_2d(size_t rows, size_t cols, size_t min_rows, size_t min_cols,
+                     const std::function<void(size_t, size_t, size_t, size_t)>& fn);
+
+}
+
+#endif
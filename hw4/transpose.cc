@@ -0,0 +1,243 @@
+#include "transpose.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TRANSPOSE_X86 1
+#endif
+
+namespace matrix_kernels {
+
+namespace {
+
+// Blocks with both sides at most LEAF are transposed directly; a 32 x 32
+// source and destination of doubles take 16 KB, half of a typical L1.
+const size_t LEAF = 32;
+// Recursion splits fall on multiples of the widest register tile so that
+// leaves stay tile aligned.
+const size_t SPLIT_ALIGN = 8;
+
+size_t split(size_t n) {
+    return (n / 2 + SPLIT_ALIGN - 1) / SPLIT_ALIGN * SPLIT_ALIGN;
+}
+
+/* Register tiles *************************************************************/
+
+// A tile set transposes W x W tiles held entirely in registers. copy writes
+// the transpose of the tile at a into b and may be called with a == b; swap
+// exchanges the tile at x with the transpose of the tile at y.
+template <typename T>
+struct Tiles {
+    typedef void (*copy_fn)(const T* a, size_t lda, T* b, size_t ldb);
+    typedef void (*swap_fn)(T* x, T* y, size_t ld);
+    size_t w;
+    copy_fn copy;
+    swap_fn swap;
+};
+
+#ifdef TRANSPOSE_X86
+
+#define TRANSPOSE_AVX __attribute__((target("avx"), always_inline)) inline
+
+TRANSPOSE_AVX void transpose8(__m256 r[8]) {
+    __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]), t1 = _mm256_unpackhi_ps(r[0], r[1]);
+    __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]), t3 = _mm256_unpackhi_ps(r[2], r[3]);
+    __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]), t5 = _mm256_unpackhi_ps(r[4], r[5]);
+    __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]), t7 = _mm256_unpackhi_ps(r[6], r[7]);
+    __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+    r[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+    r[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+    r[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+    r[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+    r[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+    r[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+    r[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+    r[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+}
+
+TRANSPOSE_AVX void transpose4(__m256d r[4]) {
+    __m256d t0 = _mm256_unpacklo_pd(r[0], r[1]), t1 = _mm256_unpackhi_pd(r[0], r[1]);
+    __m256d t2 = _mm256_unpacklo_pd(r[2], r[3]), t3 = _mm256_unpackhi_pd(r[2], r[3]);
+    r[0] = _mm256_permute2f128_pd(t0, t2, 0x20);
+    r[1] = _mm256_permute2f128_pd(t1, t3, 0x20);
+    r[2] = _mm256_permute2f128_pd(t0, t2, 0x31);
+    r[3] = _mm256_permute2f128_pd(t1, t3, 0x31);
+}
+
+// The shuffles only move bits, so every 32-bit type goes through the float
+// tiles and every 64-bit type through the double tiles.
+struct Avx32 {
+    typedef __m256 vec;
+    static const size_t width = 8;
+    static TRANSPOSE_AVX vec load(const void* p) { return _mm256_loadu_ps(static_cast<const float*>(p)); }
+    static TRANSPOSE_AVX void store(void* p, vec v) { _mm256_storeu_ps(static_cast<float*>(p), v); }
+    static TRANSPOSE_AVX void transpose(vec* r) { transpose8(r); }
+};
+
+struct Avx64 {
+    typedef __m256d vec;
+    static const size_t width = 4;
+    static TRANSPOSE_AVX vec load(const void* p) { return _mm256_loadu_pd(static_cast<const double*>(p)); }
+    static TRANSPOSE_AVX void store(void* p, vec v) { _mm256_storeu_pd(static_cast<double*>(p), v); }
+    static TRANSPOSE_AVX void transpose(vec* r) { transpose4(r); }
+};
+
+template <typename V, typename T>
+__attribute__((target("avx")))
+void copy_avx(const T* a, size_t lda, T* b, size_t ldb) {
+    typename V::vec r[V::width];
+    for (size_t i = 0; i < V::width; i++) r[i] = V::load(a + i * lda);
+    V::transpose(r);
+    for (size_t i = 0; i < V::width; i++) V::store(b + i * ldb, r[i]);
+}
+
+template <typename V, typename T>
+__attribute__((target("avx")))
+void swap_avx(T* x, T* y, size_t ld) {
+    typename V::vec rx[V::width], ry[V::width];
+    for (size_t i = 0; i < V::width; i++) {
+        rx[i] = V::load(x + i * ld);
+        ry[i] = V::load(y + i * ld);
+    }
+    V::transpose(rx);
+    V::transpose(ry);
+    for (size_t i = 0; i < V::width; i++) {
+        V::store(y + i * ld, rx[i]);
+        V::store(x + i * ld, ry[i]);
+    }
+}
+
+template <typename T>
+struct AvxTiles {
+    typedef typename std::conditional<sizeof(T) == 4, Avx32, Avx64>::type V;
+    static Tiles<T> get() { return {V::width, copy_avx<V, T>, swap_avx<V, T>}; }
+};
+
+#endif
+
+// Picks the register tiles once per element type; w == 0 means none.
+template <typename T>
+const Tiles<T>& select_tiles() {
+    static_assert(sizeof(T) == 4 || sizeof(T) == 8, "Unsupported element size");
+    static const Tiles<T> chosen = [] {
+#ifdef TRANSPOSE_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx")) return AvxTiles<T>::get();
+#endif
+        return Tiles<T>{0, nullptr, nullptr};
+    }();
+    return chosen;
+}
+
+/* Leaves *********************************************************************/
+
+template <typename T>
+void copy_leaf(size_t m, size_t n, const T* a, size_t lda, T* b, size_t ldb) {
+    const Tiles<T>& t = select_tiles<T>();
+    size_t mt = 0, nt = 0;
+    if (t.w) {
+        mt = m / t.w * t.w;
+        nt = n / t.w * t.w;
+        for (size_t i = 0; i < mt; i += t.w)
+            for (size_t j = 0; j < nt; j += t.w) t.copy(a + i * lda + j, lda, b + j * ldb + i, ldb);
+    }
+    for (size_t i = 0; i < m; i++)
+        for (size_t j = i < mt ? nt : 0; j < n; j++) b[j * ldb + i] = a[i * lda + j];
+}
+
+template <typename T>
+void swap_leaf(size_t m, size_t n, T* x, T* y, size_t ld) {
+    const Tiles<T>& t = select_tiles<T>();
+    size_t mt = 0, nt = 0;
+    if (t.w) {
+        mt = m / t.w * t.w;
+        nt = n / t.w * t.w;
+        for (size_t i = 0; i < mt; i += t.w)
+            for (size_t j = 0; j < nt; j += t.w) t.swap(x + i * ld + j, y + j * ld + i, ld);
+    }
+    for (size_t i = 0; i < m; i++)
+        for (size_t j = i < mt ? nt : 0; j < n; j++) std::swap(x[i * ld + j], y[j * ld + i]);
+}
+
+template <typename T>
+void square_leaf(size_t n, T* a, size_t ld) {
+    const Tiles<T>& t = select_tiles<T>();
+    size_t nt = 0;
+    if (t.w) {
+        nt = n / t.w * t.w;
+        for (size_t i = 0; i < nt; i += t.w) {
+            t.copy(a + i * ld + i, ld, a + i * ld + i, ld);
+            for (size_t j = i + t.w; j < nt; j += t.w) t.swap(a + i * ld + j, a + j * ld + i, ld);
+        }
+    }
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = std::max(nt, i + 1); j < n; j++) std::swap(a[i * ld + j], a[j * ld + i]);
+}
+
+}
+
+template <typename T>
+void transpose(size_t m, size_t n, const T* a, size_t lda, T* b, size_t ldb) {
+    if (m <= LEAF && n <= LEAF) {
+        copy_leaf(m, n, a, lda, b, ldb);
+    } else if (m >= n) {
+        size_t h = split(m);
+        transpose(h, n, a, lda, b, ldb);
+        transpose(m - h, n, a + h * lda, lda, b + h, ldb);
+    } else {
+        size_t h = split(n);
+        transpose(m, h, a, lda, b, ldb);
+        transpose(m, n - h, a + h, lda, b + h * ldb, ldb);
+    }
+}
+
+template <typename T>
+void transpose_swap(size_t m, size_t n, T* x, T* y, size_t ld) {
+    if (m <= LEAF && n <= LEAF) {
+        swap_leaf(m, n, x, y, ld);
+    } else if (m >= n) {
+        size_t h = split(m);
+        transpose_swap(h, n, x, y, ld);
+        transpose_swap(m - h, n, x + h * ld, y + h, ld);
+    } else {
+        size_t h = split(n);
+        transpose_swap(m, h, x, y, ld);
+        transpose_swap(m, n - h, x + h, y + h * ld, ld);
+    }
+}
+
+template <typename T>
+void transpose_square(size_t n, T* a, size_t lda) {
+    if (n <= LEAF) {
+        square_leaf(n, a, lda);
+        return;
+    }
+    // [A B; C D]^T = [A^T C^T; B^T D^T]
+    size_t h = split(n);
+    transpose_square(h, a, lda);
+    transpose_square(n - h, a + h * lda + h, lda);
+    transpose_swap(h, n - h, a + h, a + h * lda, lda);
+}
+
+#define INSTANTIATE_TRANSPOSE(T) \
+    template void transpose<T>(size_t, size_t, const T*, size_t, T*, size_t); \
+    template void transpose_square<T>(size_t, T*, size_t); \
+    template void transpose_swap<T>(size_t, size_t, T*, T*, size_t);
+
+INSTANTIATE_TRANSPOSE(float)
+INSTANTIATE_TRANSPOSE(double)
+INSTANTIATE_TRANSPOSE(int32_t)
+INSTANTIATE_TRANSPOSE(int64_t)
+
+}
@@ -0,0 +1,29 @@
+#ifndef TRANSPOSE_H
+#define TRANSPOSE_H
+
+#include <cstddef>
+
+namespace matrix_kernels {
+
+// Serial transpose kernels on row-major blocks with unit column stride. They
+// recurse on the longer side until a block fits in L1 and transpose those
+// blocks in 8x8 (32-bit) or 4x4 (64-bit) register tiles when the CPU has AVX.
+// Instantiated for float, double, int32_t and int64_t.
+
+// B = A^T, where A is m x n with row stride lda and B is n x m with row
+// stride ldb. A and B must not overlap.
+template <typename T>
+void transpose(size_t m, size_t n, const T* a, size_t lda, T* b, size_t ldb);
+
+// Transposes the n x n block at a in place.
+template <typename T>
+void transpose_square(size_t n, T* a, size_t lda);
+
+// Exchanges the m x n block at x with the transpose of the n x m block at y,
+// both with row stride ld. The blocks must not overlap.
+template <typename T>
+void transpose_swap(size_t m, size_t n, T* x, T* y, size_t ld);
+
+}
+
+#endif
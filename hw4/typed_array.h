@@ -2,119 +2,343 @@
 #define TYPED_ARRAY
 
 #include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <iterator>
 #include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <new>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace typed_array {
+
+// The allocator, as an empty base when it has no state, and uninitialized
+// room for N elements inside the array object itself.
+template <typename ElementType, int N, typename Allocator>
+struct Storage : Allocator {
+    explicit Storage(const Allocator& a) : Allocator(a) {}
+    alignas(ElementType) unsigned char bytes[N * sizeof(ElementType)];
+    ElementType* inline_buffer() { return reinterpret_cast<ElementType*>(bytes); }
+};
+
+template <typename ElementType, typename Allocator>
+struct Storage<ElementType, 0, Allocator> : Allocator {
+    explicit Storage(const Allocator& a) : Allocator(a) {}
+    ElementType* inline_buffer() { return nullptr; }
+};
+
+// Moving an array whose elements are inline moves them one by one.
+template <typename ElementType, int N>
+constexpr bool nothrow_move() {
+    return N == 0 || std::is_nothrow_move_constructible<ElementType>::value;
+}
+
+// Trivially copyable elements are copied, moved and relocated as bytes
+// whenever the source is a plain range of them.
+template <typename ElementType, typename Iterator>
+struct Bitwise : std::false_type {};
+
+template <typename ElementType>
+struct Bitwise<ElementType, ElementType*> : std::is_trivially_copyable<ElementType> {};
+
+template <typename ElementType>
+struct Bitwise<ElementType, const ElementType*> : std::is_trivially_copyable<ElementType> {};
 
 template <typename ElementType>
-class TypedArray {
+struct Bitwise<ElementType, std::move_iterator<ElementType*>> : std::is_trivially_copyable<ElementType> {};
+
+template <typename ElementType>
+const ElementType* address(const ElementType* p) { return p; }
+
+template <typename ElementType>
+const ElementType* address(std::move_iterator<ElementType*> it) { return it.base(); }
+
+// Move assignment can always hand over the buffer when the allocator moves
+// with it or all allocators of its type are interchangeable.
+template <typename ElementType, int N, typename Allocator>
+constexpr bool nothrow_move_assign() {
+    typedef std::allocator_traits<Allocator> traits;
+    return nothrow_move<ElementType, N>()
+        && (traits::propagate_on_container_move_assignment::value || traits::is_always_equal::value);
+}
+
+}
+
+// Elements live in raw storage between origin and finish; slots outside that
+// range are unconstructed. With InlineCapacity N > 0 the first N slots are
+// part of the object, so an array that never holds more than N elements
+// never allocates; once it outgrows them it moves to the heap for good.
+// With N = 0 a default-constructed or moved-from array owns no storage until
+// something is added to it.
+//
+// Heap buffers come from Allocator and elements are built through it, so a
+// std::pmr allocator is handed on to nested arrays (see pmr::TypedArray).
+// Copies get select_on_container_copy_construction() of the source's
+// allocator, and assignment follows the allocator's propagate_on_container_*
+// traits like the standard containers do.
+template <typename ElementType, int InlineCapacity = 0, typename Allocator = std::allocator<ElementType>>
+class TypedArray : private typed_array::Storage<ElementType, InlineCapacity, Allocator> {
+    static_assert(std::is_same<typename Allocator::value_type, ElementType>::value,
+                  "TypedArray allocator must allocate ElementType");
 
 public:
+    typedef Allocator allocator_type;
+    typedef ElementType value_type;
+    typedef ElementType* iterator;
+    typedef const ElementType* const_iterator;
+
     TypedArray();
+    explicit TypedArray(const Allocator& allocator);
     TypedArray(const TypedArray& other);
+    TypedArray(const TypedArray& other, const Allocator& allocator);
+    TypedArray(TypedArray&& other) noexcept(typed_array::nothrow_move<ElementType, InlineCapacity>());
+    TypedArray(TypedArray&& other, const Allocator& allocator);
     TypedArray& operator=(const TypedArray& other);
+    TypedArray& operator=(TypedArray&& other)
+        noexcept(typed_array::nothrow_move_assign<ElementType, InlineCapacity, Allocator>());
     ~TypedArray();
 
+    Allocator get_allocator() const;
+
     ElementType &get(int index);
     ElementType &safe_get(int index) const;
     int size() const;
 
-    void set(int index, ElementType value);
+    // The elements are contiguous, so [data(), data() + size()) is the whole
+    // array and iterators are plain pointers. Both are invalidated by
+    // anything that changes the size.
+    ElementType* data();
+    const ElementType* data() const;
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    void set(int index, const ElementType& value);
+    void set(int index, ElementType&& value);
 
     void push(const ElementType& value);
+    void push(ElementType&& value);
     void push_front(const ElementType& value);
+    void push_front(ElementType&& value);
     ElementType pop();
     ElementType pop_front();
 
+    // Construct a new last (first) element in place from args.
+    template <typename... Args> ElementType& emplace(Args&&... args);
+    template <typename... Args> ElementType& emplace_front(Args&&... args);
+
+    // Room for n elements from the current first one on, so that pushing up
+    // to that size does not reallocate.
+    void reserve(int n);
+    // Gives back unused slots: moves the elements into the inline storage if
+    // they fit, otherwise into a heap buffer of exactly size().
+    void shrink_to_fit();
+    // Drops elements from the end or appends copies of value.
+    void resize(int n);
+    void resize(int n, const ElementType& value);
+
+    // Append or insert copies of [first, last) before element index; the
+    // range must not point into this array. Known-length ranges reallocate
+    // at most once, and plain arrays of trivially copyable elements are
+    // copied as one block.
+    template <typename Iterator> void append(Iterator first, Iterator last);
+    void append(const TypedArray& other);
+    template <typename Iterator> void insert(int index, Iterator first, Iterator last);
+
     TypedArray concat(const TypedArray& other) const;
     TypedArray& reverse();
 
     TypedArray operator+(const TypedArray& other) const;
 
 private:
-    int capacity, origin, end;
+    typedef std::allocator_traits<Allocator> traits;
+
+    int capacity, origin, finish;
     ElementType * buffer;
-    const int INITIAL_CAPACITY = 10;
+    static constexpr int INITIAL_CAPACITY = 10;
+
+    Allocator& allocator();
+    ElementType* allocate(int n);
+    void deallocate(ElementType* p, int n);
+    template <typename... Args> void construct(ElementType* p, Args&&... args);
+    void destroy(ElementType* first, ElementType* last);
+    template <typename Iterator> void construct_range(Iterator first, Iterator last, ElementType* to);
+    template <typename Iterator> void fill_from(const TypedArray& other, Iterator first);
+    void release();
+    bool is_inline() const;
+    void take(TypedArray& other);
 
     int index_to_offset(int index) const;
     int offset_to_index(int offset) const;
     bool out_of_buffer(int offset) const;
-    void extend_buffer(void);
+    void extend_buffer(int needed);
+    void reallocate(int new_capacity, int new_origin);
+    void reserve_back(int n);
+    bool slide_inline(int new_origin);
+    template <typename... Args> ElementType& emplace_at(int index, Args&&... args);
 };
 
-template <typename ElementType>
-TypedArray<ElementType>::TypedArray() {
-    buffer = new ElementType[INITIAL_CAPACITY]();
-    capacity = INITIAL_CAPACITY;
-    origin = capacity / 2;
-    end = origin;
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>::TypedArray() : TypedArray(Allocator()) {}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>::TypedArray(const Allocator& alloc)
+    : typed_array::Storage<ElementType, InlineCapacity, Allocator>(alloc),
+      capacity(InlineCapacity), origin(0), finish(0), buffer(this->inline_buffer()) {}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>::TypedArray(const TypedArray& other)
+    : TypedArray(other, traits::select_on_container_copy_construction(other.get_allocator())) {}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>::TypedArray(const TypedArray& other, const Allocator& alloc) : TypedArray(alloc) {
+    fill_from(other, other.buffer + other.origin);
 }
 
-template <typename ElementType>
-TypedArray<ElementType>::TypedArray(const TypedArray& other) : TypedArray() {
-    *this = other;
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>::TypedArray(TypedArray&& other)
+    noexcept(typed_array::nothrow_move<ElementType, InlineCapacity>()) : TypedArray(other.get_allocator()) {
+    take(other);
 }
 
-template <typename ElementType>
-TypedArray<ElementType>& TypedArray<ElementType>::operator=(const TypedArray<ElementType>& other) {
+// Memory from a different allocator cannot change hands, so then the
+// elements are moved one by one.
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>::TypedArray(TypedArray&& other, const Allocator& alloc) : TypedArray(alloc) {
+    if (allocator() == other.allocator()) {
+        take(other);
+    } else {
+        fill_from(other, std::make_move_iterator(other.buffer + other.origin));
+        other.release();
+    }
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>& TypedArray<ElementType, InlineCapacity, Allocator>::operator=(const TypedArray<ElementType, InlineCapacity, Allocator>& other) {
     if (this != &other) {
-        delete[] buffer;
-        buffer = new ElementType[other.capacity]();
-        capacity = other.capacity;
-        origin = other.origin;
-        end = origin;
-        for (int i = 0; i < other.size(); i++) {
-            set(i, other.safe_get(i));
+        constexpr bool propagate = traits::propagate_on_container_copy_assignment::value;
+        if (!propagate && other.size() <= capacity) {
+            // Reuses the buffer: no allocation, and one block copy for
+            // trivially copyable elements.
+            destroy(buffer + origin, buffer + finish);
+            origin = finish = (capacity - other.size()) / 2;
+            construct_range(other.buffer + other.origin, other.buffer + other.finish, buffer + origin);
+            finish = origin + other.size();
+            return *this;
         }
+        TypedArray copy(other, propagate ? other.get_allocator() : get_allocator());
+        release();
+        if constexpr (propagate) allocator() = copy.allocator();
+        take(copy);
     }
     return *this;
 }
 
-template <typename ElementType>
-TypedArray<ElementType>::~TypedArray() {
-    delete[] buffer;
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>& TypedArray<ElementType, InlineCapacity, Allocator>::operator=(TypedArray<ElementType, InlineCapacity, Allocator>&& other)
+    noexcept(typed_array::nothrow_move_assign<ElementType, InlineCapacity, Allocator>()) {
+    if (this != &other) {
+        release();
+        if constexpr (traits::propagate_on_container_move_assignment::value) allocator() = other.allocator();
+        if (allocator() == other.allocator()) {
+            take(other);
+        } else {
+            TypedArray moved(std::move(other), get_allocator());
+            take(moved);
+        }
+    }
+    return *this;
 }
 
-template <typename ElementType>
-ElementType &TypedArray<ElementType>::get(int index) {
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>::~TypedArray() {
+    release();
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+ElementType &TypedArray<ElementType, InlineCapacity, Allocator>::get(int index) {
     if (index < 0) {
         throw std::range_error("Out of range index in array");
     }
     if (index >= size()) {
-        ElementType x;
-        set(index, x);
+        return emplace_at(index);
     }
     return buffer[index_to_offset(index)];
 }
 
-template <typename ElementType>
-ElementType &TypedArray<ElementType>::safe_get(int index) const {
+template <typename ElementType, int InlineCapacity, typename Allocator>
+ElementType &TypedArray<ElementType, InlineCapacity, Allocator>::safe_get(int index) const {
     if (index < 0 || index >= size()) {
         throw std::range_error("Out of range index in array");
     }
     return buffer[index_to_offset(index)];
 }
 
-template <typename ElementType>
-int TypedArray<ElementType>::size() const {
-    return end - origin;
+template <typename ElementType, int InlineCapacity, typename Allocator>
+int TypedArray<ElementType, InlineCapacity, Allocator>::size() const {
+    return finish - origin;
 }
 
-template <typename ElementType>
-void TypedArray<ElementType>::set(int index, ElementType value) {
+template <typename ElementType, int InlineCapacity, typename Allocator>
+ElementType* TypedArray<ElementType, InlineCapacity, Allocator>::data() {
+    return buffer + origin;
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+const ElementType* TypedArray<ElementType, InlineCapacity, Allocator>::data() const {
+    return buffer + origin;
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+typename TypedArray<ElementType, InlineCapacity, Allocator>::iterator TypedArray<ElementType, InlineCapacity, Allocator>::begin() {
+    return buffer + origin;
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+typename TypedArray<ElementType, InlineCapacity, Allocator>::iterator TypedArray<ElementType, InlineCapacity, Allocator>::end() {
+    return buffer + finish;
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+typename TypedArray<ElementType, InlineCapacity, Allocator>::const_iterator TypedArray<ElementType, InlineCapacity, Allocator>::begin() const {
+    return buffer + origin;
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+typename TypedArray<ElementType, InlineCapacity, Allocator>::const_iterator TypedArray<ElementType, InlineCapacity, Allocator>::end() const {
+    return buffer + finish;
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::set(int index, const ElementType& value) {
     if (index < 0) {
         throw std::range_error("Negative index in array");
     }
-    while (out_of_buffer(index_to_offset(index))) {
-        extend_buffer();
+    if (index < size()) {
+        buffer[index_to_offset(index)] = value;
+    } else {
+        emplace_at(index, value);
     }
-    buffer[index_to_offset(index)] = value;
-    if (index >= size()) {
-        end = index_to_offset(index + 1);
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::set(int index, ElementType&& value) {
+    if (index < 0) {
+        throw std::range_error("Negative index in array");
+    }
+    if (index < size()) {
+        buffer[index_to_offset(index)] = std::move(value);
+    } else {
+        emplace_at(index, std::move(value));
     }
 }
 
-template <typename ElementType>
-std::ostream &operator<<(std::ostream &os, TypedArray<ElementType> &array) {
+template <typename ElementType, int InlineCapacity, typename Allocator>
+std::ostream &operator<<(std::ostream &os, TypedArray<ElementType, InlineCapacity, Allocator> &array) {
     os << '[';
     for (int i = 0; i < array.size(); i++) {
         os << array.get(i);
@@ -124,97 +348,410 @@ std::ostream &operator<<(std::ostream &os, TypedArray<ElementType> &array) {
     return os;
 }
 
-template <typename ElementType>
-int TypedArray<ElementType>::index_to_offset(int index) const {
+template <typename ElementType, int InlineCapacity, typename Allocator>
+Allocator TypedArray<ElementType, InlineCapacity, Allocator>::get_allocator() const {
+    return *this;
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+Allocator& TypedArray<ElementType, InlineCapacity, Allocator>::allocator() {
+    return *this;
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+ElementType* TypedArray<ElementType, InlineCapacity, Allocator>::allocate(int n) {
+    return traits::allocate(allocator(), n);
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::deallocate(ElementType* p, int n) {
+    if (p != nullptr) traits::deallocate(allocator(), p, n);
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename... Args>
+void TypedArray<ElementType, InlineCapacity, Allocator>::construct(ElementType* p, Args&&... args) {
+    traits::construct(allocator(), p, std::forward<Args>(args)...);
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::destroy(ElementType* first, ElementType* last) {
+    for (; first != last; ++first) traits::destroy(allocator(), first);
+}
+
+// Constructs copies of [first, last) at to; on failure the ones already built
+// are destroyed again. The destination must not overlap the source.
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename Iterator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::construct_range(Iterator first, Iterator last, ElementType* to) {
+    if constexpr (typed_array::Bitwise<ElementType, Iterator>::value) {
+        if (first != last) memcpy(to, typed_array::address(first), (last - first) * sizeof(ElementType));
+        return;
+    }
+    ElementType* start = to;
+    try {
+        for (; first != last; ++first, ++to) construct(to, *first);
+    } catch (...) {
+        destroy(start, to);
+        throw;
+    }
+}
+
+// Fills an empty inline array with other.size() elements built from first:
+// inline when they fit, otherwise in a buffer laid out like other's.
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename Iterator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::fill_from(const TypedArray& other, Iterator first) {
+    if (other.size() <= InlineCapacity) {
+        construct_range(first, first + other.size(), buffer);
+        finish = other.size();
+        return;
+    }
+    ElementType* copy = allocate(other.capacity);
+    try {
+        construct_range(first, first + other.size(), copy + other.origin);
+    } catch (...) {
+        deallocate(copy, other.capacity);
+        throw;
+    }
+    buffer = copy;
+    capacity = other.capacity;
+    origin = other.origin;
+    finish = other.finish;
+}
+
+// Destroys the elements and frees a heap buffer, leaving the array empty and
+// back on its inline storage.
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::release() {
+    destroy(buffer + origin, buffer + finish);
+    if (!is_inline()) deallocate(buffer, capacity);
+    buffer = this->inline_buffer();
+    capacity = InlineCapacity;
+    origin = finish = 0;
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+bool TypedArray<ElementType, InlineCapacity, Allocator>::is_inline() const {
+    return InlineCapacity > 0 && buffer == const_cast<TypedArray*>(this)->inline_buffer();
+}
+
+// Takes the contents of other, which is left empty: a heap buffer changes
+// owner, inline elements are moved across. Expects this array to be empty
+// and inline, and the two allocators to compare equal.
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::take(TypedArray& other) {
+    if (other.is_inline()) {
+        construct_range(std::make_move_iterator(other.buffer + other.origin),
+                        std::make_move_iterator(other.buffer + other.finish), buffer + other.origin);
+        origin = other.origin;
+        finish = other.finish;
+        other.release();
+        return;
+    }
+    capacity = other.capacity;
+    origin = other.origin;
+    finish = other.finish;
+    buffer = other.buffer;
+    other.buffer = other.inline_buffer();
+    other.capacity = InlineCapacity;
+    other.origin = other.finish = 0;
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+int TypedArray<ElementType, InlineCapacity, Allocator>::index_to_offset(int index) const {
     return index + origin;
 }
 
-template <typename ElementType>
-int TypedArray<ElementType>::offset_to_index(int offset) const {
+template <typename ElementType, int InlineCapacity, typename Allocator>
+int TypedArray<ElementType, InlineCapacity, Allocator>::offset_to_index(int offset) const {
     return offset - origin;
 }
 
-template <typename ElementType>
-bool TypedArray<ElementType>::out_of_buffer(int offset) const {
+template <typename ElementType, int InlineCapacity, typename Allocator>
+bool TypedArray<ElementType, InlineCapacity, Allocator>::out_of_buffer(int offset) const {
     return offset < 0 || offset >= capacity;
 }
 
-template <typename ElementType>
-void TypedArray<ElementType>::extend_buffer() {
-    auto temp = new ElementType[2 * capacity]();
-    int new_origin = capacity - (end - origin) / 2;
-    int new_end = new_origin + (end - origin);
+// Recentres the elements in a new buffer, which always leaves at least one
+// free slot at each end. The capacity doubles unless the heap buffer would
+// stay under half full with needed elements; recentring alone keeps a queue
+// that pushes at one end and pops at the other from growing without bound.
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::extend_buffer(int needed) {
+    int new_capacity = capacity;
+    if (is_inline() || needed >= capacity / 2) new_capacity = std::max(2 * capacity, INITIAL_CAPACITY);
+    reallocate(new_capacity, (new_capacity - size()) / 2);
+}
+
+// Moves the elements to slots new_origin on of a new buffer: the inline
+// storage if that is free and big enough, else a heap block of new_capacity.
+// The elements are moved unless that could throw and copying could not, so a
+// failed reallocation leaves the array as it was.
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::reallocate(int new_capacity, int new_origin) {
+    constexpr bool move = std::is_nothrow_move_constructible<ElementType>::value
+        || !std::is_copy_constructible<ElementType>::value;
+    bool to_inline = InlineCapacity > 0 && !is_inline() && new_capacity <= InlineCapacity;
+    if (to_inline) new_capacity = InlineCapacity;
+    ElementType* temp = to_inline ? this->inline_buffer() : new_capacity > 0 ? allocate(new_capacity) : nullptr;
+    int n = size();
 
-    for (int i = 0; i < size(); i++) {
-        temp[new_origin + i] = safe_get(i);
+    try {
+        if constexpr (move) {
+            construct_range(std::make_move_iterator(buffer + origin), std::make_move_iterator(buffer + finish),
+                            temp + new_origin);
+        } else {
+            construct_range(buffer + origin, buffer + finish, temp + new_origin);
+        }
+    } catch (...) {
+        if (!to_inline) deallocate(temp, new_capacity);
+        throw;
     }
 
-    delete[] buffer;
+    destroy(buffer + origin, buffer + finish);
+    if (!is_inline()) deallocate(buffer, capacity);
     buffer = temp;
 
-    capacity = 2 * capacity;
+    capacity = new_capacity;
     origin = new_origin;
-    end = new_end;
+    finish = new_origin + n;
 }
 
-template <typename ElementType>
-void TypedArray<ElementType>::push(const ElementType& value) {
-    set(size(), value);
+// Makes room for n elements from origin on, growing geometrically so that a
+// series of appends stays amortized O(1).
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::reserve_back(int n) {
+    if (origin + n <= capacity) return;
+    if (n <= capacity && slide_inline(0)) return;
+    reallocate(std::max({n, 2 * capacity, INITIAL_CAPACITY}), 0);
 }
 
-template <typename ElementType>
-void TypedArray<ElementType>::push_front(const ElementType& value) {
-    while (origin == 0) extend_buffer();
-    origin--;
-    buffer[origin] = value;
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::reserve(int n) {
+    if (origin + n <= capacity) return;
+    if (n <= capacity && slide_inline(0)) return;
+    reallocate(n, 0);
 }
 
-template <typename ElementType>
-ElementType TypedArray<ElementType>::pop() {
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::shrink_to_fit() {
+    if (is_inline() || capacity == size()) return;
+    reallocate(size(), 0);
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::resize(int n) {
+    if (n < 0) {
+        throw std::range_error("Negative size for array");
+    }
+    if (n <= size()) {
+        destroy(buffer + origin + n, buffer + finish);
+        finish = origin + n;
+        return;
+    }
+    reserve(n);
+    while (size() < n) {
+        construct(buffer + finish);
+        finish++;
+    }
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::resize(int n, const ElementType& value) {
+    if (n < 0) {
+        throw std::range_error("Negative size for array");
+    }
+    if (n <= size()) {
+        resize(n);
+        return;
+    }
+    if (origin + n > capacity) {
+        ElementType copy(value);
+        reserve(n);
+        resize(n, copy);
+        return;
+    }
+    while (size() < n) {
+        construct(buffer + finish, value);
+        finish++;
+    }
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename Iterator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::append(Iterator first, Iterator last) {
+    typedef typename std::iterator_traits<Iterator>::iterator_category category;
+    if constexpr (std::is_base_of<std::forward_iterator_tag, category>::value) {
+        int n = std::distance(first, last);
+        reserve_back(size() + n);
+        construct_range(first, last, buffer + finish);
+        finish += n;
+    } else {
+        for (; first != last; ++first) emplace(*first);
+    }
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::append(const TypedArray& other) {
+    int n = other.size();
+    reserve_back(size() + n);
+    // After reserving, so that appending an array to itself reads the new buffer.
+    construct_range(other.buffer + other.origin, other.buffer + other.origin + n, buffer + finish);
+    finish += n;
+}
+
+// Appends the range and rotates it into place.
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename Iterator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::insert(int index, Iterator first, Iterator last) {
+    if (index < 0 || index > size()) {
+        throw std::range_error("Out of range index in array");
+    }
+    int n = size();
+    append(first, last);
+    std::rotate(buffer + origin + index, buffer + origin + n, buffer + finish);
+}
+
+// Moves the elements of an inline buffer so that the first one lands at
+// new_origin, which makes room at one end without leaving the object.
+// Returns false and does nothing for a heap buffer, or when moving an
+// element could throw.
+template <typename ElementType, int InlineCapacity, typename Allocator>
+bool TypedArray<ElementType, InlineCapacity, Allocator>::slide_inline(int new_origin) {
+    if constexpr (!std::is_nothrow_move_constructible<ElementType>::value) {
+        return false;
+    } else {
+        if (!is_inline()) return false;
+        if (new_origin < origin) {
+            int k = std::min(origin - new_origin, size());
+            construct_range(std::make_move_iterator(buffer + origin),
+                            std::make_move_iterator(buffer + origin + k), buffer + new_origin);
+            std::move(buffer + origin + k, buffer + finish, buffer + new_origin + k);
+            destroy(buffer + finish - k, buffer + finish);
+        } else if (new_origin > origin) {
+            int d = new_origin - origin;
+            int k = std::min(d, size());
+            construct_range(std::make_move_iterator(buffer + finish - k),
+                            std::make_move_iterator(buffer + finish), buffer + finish - k + d);
+            std::move_backward(buffer + origin, buffer + finish - k, buffer + finish - k + d);
+            destroy(buffer + origin, buffer + origin + k);
+        }
+        finish += new_origin - origin;
+        origin = new_origin;
+        return true;
+    }
+}
+
+// Appends default-constructed elements up to index and constructs element
+// index from args. The arguments may refer to elements of this array, so
+// when the buffer has to grow the new element is built before it moves.
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename... Args>
+ElementType& TypedArray<ElementType, InlineCapacity, Allocator>::emplace_at(int index, Args&&... args) {
+    assert(index >= size());
+    if (out_of_buffer(index_to_offset(index))) {
+        ElementType value(std::forward<Args>(args)...);
+        if (index >= capacity || !slide_inline(0)) {
+            while (out_of_buffer(index_to_offset(index))) extend_buffer(index + 1);
+        }
+        return emplace_at(index, std::move(value));
+    }
+    while (size() < index) {
+        construct(buffer + finish);
+        finish++;
+    }
+    construct(buffer + finish, std::forward<Args>(args)...);
+    return buffer[finish++];
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename... Args>
+ElementType& TypedArray<ElementType, InlineCapacity, Allocator>::emplace(Args&&... args) {
+    return emplace_at(size(), std::forward<Args>(args)...);
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename... Args>
+ElementType& TypedArray<ElementType, InlineCapacity, Allocator>::emplace_front(Args&&... args) {
+    if (origin == 0) {
+        ElementType value(std::forward<Args>(args)...);
+        if (size() == capacity || !slide_inline(capacity - size())) extend_buffer(size() + 1);
+        return emplace_front(std::move(value));
+    }
+    construct(buffer + origin - 1, std::forward<Args>(args)...);
+    return buffer[--origin];
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::push(const ElementType& value) {
+    emplace(value);
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::push(ElementType&& value) {
+    emplace(std::move(value));
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::push_front(const ElementType& value) {
+    emplace_front(value);
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::push_front(ElementType&& value) {
+    emplace_front(std::move(value));
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+ElementType TypedArray<ElementType, InlineCapacity, Allocator>::pop() {
     if (size() == 0) {
         throw std::range_error("Cannot pop from an empty array");
     }
-    ElementType v = buffer[end - 1];
-    buffer[end - 1] = ElementType();
-    end--;
+    ElementType v = std::move(buffer[finish - 1]);
+    destroy(buffer + finish - 1, buffer + finish);
+    finish--;
     return v;
 }
 
-template <typename ElementType>
-ElementType TypedArray<ElementType>::pop_front() {
+template <typename ElementType, int InlineCapacity, typename Allocator>
+ElementType TypedArray<ElementType, InlineCapacity, Allocator>::pop_front() {
     if (size() == 0) {
         throw std::range_error("Cannot pop from an empty array");
     }
-    ElementType v = buffer[origin];
-    buffer[origin] = ElementType();
+    ElementType v = std::move(buffer[origin]);
+    destroy(buffer + origin, buffer + origin + 1);
     origin++;
     return v;
 }
 
-template <typename ElementType>
-TypedArray<ElementType> TypedArray<ElementType>::concat(const TypedArray<ElementType>& other) const {
-    TypedArray<ElementType> r;
-    int n = size();
-    int m = other.size();
-    for (int i = 0; i < n; i++) r.set(i, safe_get(i));
-    for (int j = 0; j < m; j++) r.set(n + j, other.safe_get(j));
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator> TypedArray<ElementType, InlineCapacity, Allocator>::concat(const TypedArray<ElementType, InlineCapacity, Allocator>& other) const {
+    TypedArray<ElementType, InlineCapacity, Allocator> r(traits::select_on_container_copy_construction(get_allocator()));
+    r.reserve(size() + other.size());
+    r.append(*this);
+    r.append(other);
     return r;
 }
 
-template <typename ElementType>
-TypedArray<ElementType>& TypedArray<ElementType>::reverse() {
-    int n = size();
-    for (int i = 0; i < n / 2; i++) {
-        ElementType tmp = safe_get(i);
-        buffer[index_to_offset(i)] = safe_get(n - 1 - i);
-        buffer[index_to_offset(n - 1 - i)] = tmp;
-    }
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>& TypedArray<ElementType, InlineCapacity, Allocator>::reverse() {
+    std::reverse(buffer + origin, buffer + finish);
     return *this;
 }
 
-template <typename ElementType>
-TypedArray<ElementType> TypedArray<ElementType>::operator+(const TypedArray<ElementType>& other) const {
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator> TypedArray<ElementType, InlineCapacity, Allocator>::operator+(const TypedArray<ElementType, InlineCapacity, Allocator>& other) const {
     return concat(other);
 }
 
+namespace pmr {
+
+// A TypedArray whose storage, and that of any pmr arrays nested in it, comes
+// from a std::pmr::memory_resource such as a monotonic arena.
+template <typename ElementType, int InlineCapacity = 0>
+using TypedArray = ::TypedArray<ElementType, InlineCapacity, std::pmr::polymorphic_allocator<ElementType>>;
+
+}
+
 #endif
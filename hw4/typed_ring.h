@@ -0,0 +1,310 @@
+#ifndef TYPED_RING
+#define TYPED_RING
+
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// Double-ended queue with the element interface of TypedArray, stored as a
+// circular buffer: index i lives in slot (origin + i) mod capacity, and the
+// capacity is a power of two so the wrap is a mask. Pushing and popping at
+// either end is O(1) and reuses freed slots, so a queue whose size stays
+// bounded never reallocates.
+//
+// A default-constructed ring doubles when it fills up. A ring made by
+// bounded(n) allocates once and never grows: pushing onto a full ring
+// overwrites the element at the opposite end, i.e. push drops the first
+// element and push_front drops the last.
+//
+// Unlike TypedArray, get() does not extend the ring: get and safe_get both
+// throw for an index outside [0, size()), and set only replaces elements.
+template <typename ElementType>
+class TypedRing {
+
+public:
+    TypedRing();
+    static TypedRing bounded(int max_size);
+    TypedRing(const TypedRing& other);
+    TypedRing(TypedRing&& other) noexcept;
+    TypedRing& operator=(const TypedRing& other);
+    TypedRing& operator=(TypedRing&& other) noexcept;
+    ~TypedRing();
+
+    ElementType &get(int index);
+    ElementType &safe_get(int index) const;
+    int size() const;
+    int capacity() const;
+    bool is_bounded() const;
+
+    void set(int index, const ElementType& value);
+    void set(int index, ElementType&& value);
+
+    void push(const ElementType& value);
+    void push(ElementType&& value);
+    void push_front(const ElementType& value);
+    void push_front(ElementType&& value);
+    ElementType pop();
+    ElementType pop_front();
+
+    template <typename... Args> ElementType& emplace(Args&&... args);
+    template <typename... Args> ElementType& emplace_front(Args&&... args);
+
+    void clear();
+
+private:
+    ElementType * buffer;
+    int slots, origin, count;
+    int max_size;   // 0 for a growing ring
+    static constexpr int INITIAL_CAPACITY = 16;
+
+    int slot(int index) const;
+    void release();
+    void extend_buffer(void);
+};
+
+template <typename ElementType>
+TypedRing<ElementType>::TypedRing() : buffer(nullptr), slots(0), origin(0), count(0), max_size(0) {}
+
+template <typename ElementType>
+TypedRing<ElementType> TypedRing<ElementType>::bounded(int max_size) {
+    if (max_size <= 0) {
+        throw std::invalid_argument("Ring capacity must be positive");
+    }
+    TypedRing r;
+    int n = 1;
+    while (n < max_size) n *= 2;
+    r.buffer = std::allocator<ElementType>().allocate(n);
+    r.slots = n;
+    r.max_size = max_size;
+    return r;
+}
+
+template <typename ElementType>
+TypedRing<ElementType>::TypedRing(const TypedRing& other) : TypedRing() {
+    if (other.buffer == nullptr) return;
+    buffer = std::allocator<ElementType>().allocate(other.slots);
+    slots = other.slots;
+    max_size = other.max_size;
+    try {
+        for (; count < other.count; count++) {
+            ::new (static_cast<void*>(buffer + count)) ElementType(other.safe_get(count));
+        }
+    } catch (...) {
+        release();
+        throw;
+    }
+}
+
+template <typename ElementType>
+TypedRing<ElementType>::TypedRing(TypedRing&& other) noexcept
+    : buffer(other.buffer), slots(other.slots), origin(other.origin), count(other.count), max_size(other.max_size) {
+    other.buffer = nullptr;
+    other.slots = other.origin = other.count = other.max_size = 0;
+}
+
+template <typename ElementType>
+TypedRing<ElementType>& TypedRing<ElementType>::operator=(const TypedRing& other) {
+    if (this != &other) {
+        *this = TypedRing(other);
+    }
+    return *this;
+}
+
+template <typename ElementType>
+TypedRing<ElementType>& TypedRing<ElementType>::operator=(TypedRing&& other) noexcept {
+    if (this != &other) {
+        release();
+        buffer = other.buffer;
+        slots = other.slots;
+        origin = other.origin;
+        count = other.count;
+        max_size = other.max_size;
+        other.buffer = nullptr;
+        other.slots = other.origin = other.count = other.max_size = 0;
+    }
+    return *this;
+}
+
+template <typename ElementType>
+TypedRing<ElementType>::~TypedRing() {
+    release();
+}
+
+template <typename ElementType>
+ElementType &TypedRing<ElementType>::get(int index) {
+    return safe_get(index);
+}
+
+template <typename ElementType>
+ElementType &TypedRing<ElementType>::safe_get(int index) const {
+    if (index < 0 || index >= count) {
+        throw std::range_error("Out of range index in array");
+    }
+    return buffer[slot(index)];
+}
+
+template <typename ElementType>
+int TypedRing<ElementType>::size() const {
+    return count;
+}
+
+template <typename ElementType>
+int TypedRing<ElementType>::capacity() const {
+    return max_size > 0 ? max_size : slots;
+}
+
+template <typename ElementType>
+bool TypedRing<ElementType>::is_bounded() const {
+    return max_size > 0;
+}
+
+template <typename ElementType>
+void TypedRing<ElementType>::set(int index, const ElementType& value) {
+    safe_get(index) = value;
+}
+
+template <typename ElementType>
+void TypedRing<ElementType>::set(int index, ElementType&& value) {
+    safe_get(index) = std::move(value);
+}
+
+template <typename ElementType>
+int TypedRing<ElementType>::slot(int index) const {
+    return (origin + index) & (slots - 1);
+}
+
+// Destroys the elements and frees the buffer, leaving an empty growing ring.
+template <typename ElementType>
+void TypedRing<ElementType>::release() {
+    clear();
+    if (buffer != nullptr) std::allocator<ElementType>().deallocate(buffer, slots);
+    buffer = nullptr;
+    slots = max_size = 0;
+}
+
+// Doubles the capacity and unwraps the elements to start at slot 0. They are
+// moved unless that could throw and copying could not.
+template <typename ElementType>
+void TypedRing<ElementType>::extend_buffer() {
+    constexpr bool move = std::is_nothrow_move_constructible<ElementType>::value
+        || !std::is_copy_constructible<ElementType>::value;
+    int new_slots = slots > 0 ? 2 * slots : INITIAL_CAPACITY;
+    ElementType* temp = std::allocator<ElementType>().allocate(new_slots);
+    int moved = 0;
+    try {
+        for (; moved < count; moved++) {
+            ElementType& e = buffer[slot(moved)];
+            if constexpr (move) {
+                ::new (static_cast<void*>(temp + moved)) ElementType(std::move(e));
+            } else {
+                ::new (static_cast<void*>(temp + moved)) ElementType(e);
+            }
+        }
+    } catch (...) {
+        std::destroy(temp, temp + moved);
+        std::allocator<ElementType>().deallocate(temp, new_slots);
+        throw;
+    }
+    int n = count;
+    clear();
+    if (buffer != nullptr) std::allocator<ElementType>().deallocate(buffer, slots);
+    buffer = temp;
+    slots = new_slots;
+    origin = 0;
+    count = n;
+}
+
+// When the ring is full the new element is built first, since the arguments
+// may refer to an element that is about to move or be dropped.
+template <typename ElementType>
+template <typename... Args>
+ElementType& TypedRing<ElementType>::emplace(Args&&... args) {
+    if (count == capacity()) {
+        ElementType value(std::forward<Args>(args)...);
+        if (max_size > 0) {
+            std::destroy_at(buffer + origin);
+            origin = slot(1);
+            count--;
+        } else {
+            extend_buffer();
+        }
+        return emplace(std::move(value));
+    }
+    ElementType* p = ::new (static_cast<void*>(buffer + slot(count))) ElementType(std::forward<Args>(args)...);
+    count++;
+    return *p;
+}
+
+template <typename ElementType>
+template <typename... Args>
+ElementType& TypedRing<ElementType>::emplace_front(Args&&... args) {
+    if (count == capacity()) {
+        ElementType value(std::forward<Args>(args)...);
+        if (max_size > 0) {
+            std::destroy_at(buffer + slot(count - 1));
+            count--;
+        } else {
+            extend_buffer();
+        }
+        return emplace_front(std::move(value));
+    }
+    int s = slot(slots - 1);
+    ElementType* p = ::new (static_cast<void*>(buffer + s)) ElementType(std::forward<Args>(args)...);
+    origin = s;
+    count++;
+    return *p;
+}
+
+template <typename ElementType>
+void TypedRing<ElementType>::push(const ElementType& value) {
+    emplace(value);
+}
+
+template <typename ElementType>
+void TypedRing<ElementType>::push(ElementType&& value) {
+    emplace(std::move(value));
+}
+
+template <typename ElementType>
+void TypedRing<ElementType>::push_front(const ElementType& value) {
+    emplace_front(value);
+}
+
+template <typename ElementType>
+void TypedRing<ElementType>::push_front(ElementType&& value) {
+    emplace_front(std::move(value));
+}
+
+template <typename ElementType>
+ElementType TypedRing<ElementType>::pop() {
+    if (count == 0) {
+        throw std::range_error("Cannot pop from an empty array");
+    }
+    int s = slot(count - 1);
+    ElementType v = std::move(buffer[s]);
+    std::destroy_at(buffer + s);
+    count--;
+    return v;
+}
+
+template <typename ElementType>
+ElementType TypedRing<ElementType>::pop_front() {
+    if (count == 0) {
+        throw std::range_error("Cannot pop from an empty array");
+    }
+    ElementType v = std::move(buffer[origin]);
+    std::destroy_at(buffer + origin);
+    origin = slot(1);
+    count--;
+    return v;
+}
+
+template <typename ElementType>
+void TypedRing<ElementType>::clear() {
+    for (int i = 0; i < count; i++) std::destroy_at(buffer + slot(i));
+    origin = count = 0;
+}
+
+#endif
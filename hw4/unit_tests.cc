@@ -1,9 +1,35 @@
 #include <math.h>
 #include <float.h>
+#include <stdint.h>
 #include <stdexcept>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 #include "typed_array.h"
+#include "typed_ring.h"
+#include "parallel_algorithms.h"
+#include "segmented_array.h"
+#include "concurrent_typed_array.h"
 #include "point.h"
 #include "matrix.h"
+#include "matrix_batch.h"
+#include "factorization.h"
+#include "matrix_file.h"
+#include "reduce.h"
+#include "sparse_matrix.h"
+#include "static_matrix.h"
+#include "strassen.h"
+#include "thread_pool.h"
 #include "gtest/gtest.h"
 
 namespace {
@@ -105,6 +131,430 @@ TEST(TypedArray, ConcatPlusReverse) {
     EXPECT_EQ(d.safe_get(5), 1);
 }
 
+// Counts its copies; Noexcept selects whether growth may move it.
+template <bool Noexcept>
+struct Tracked {
+    static int copies;
+    int value;
+    Tracked(int v = 0) : value(v) {}
+    Tracked(const Tracked& o) : value(o.value) { copies++; }
+    Tracked(Tracked&& o) noexcept(Noexcept) : value(o.value) {}
+    Tracked& operator=(const Tracked& o) { value = o.value; copies++; return *this; }
+    Tracked& operator=(Tracked&& o) noexcept(Noexcept) { value = o.value; return *this; }
+};
+template <bool Noexcept> int Tracked<Noexcept>::copies = 0;
+
+TEST(TypedArray, MovesOnGrowAndEmplace) {
+    Tracked<true>::copies = Tracked<false>::copies = 0;
+    TypedArray<Tracked<true>> a;
+    TypedArray<Tracked<false>> b;
+    for (int i = 0; i < 100; i++) {
+        a.emplace(i);
+        a.push(Tracked<true>(i));
+        b.push(Tracked<false>(i));
+        a.emplace_front(-i);
+    }
+    EXPECT_EQ(a.size(), 300);
+    EXPECT_EQ(a.safe_get(0).value, -99);
+    EXPECT_EQ(a.safe_get(299).value, 99);
+    EXPECT_EQ(a.pop().value, 99);
+    EXPECT_EQ(Tracked<true>::copies, 0);
+    // A move that may throw is not used for growth.
+    EXPECT_GT(Tracked<false>::copies, 0);
+
+    // Growing the outer array moves the inner ones instead of copying them.
+    TypedArray<TypedArray<double>> m;
+    m.get(0).set(7, 1.5);
+    double* inner = &m.get(0).get(7);
+    for (int i = 1; i < 100; i++) m.emplace();
+    EXPECT_EQ(&m.get(0).get(7), inner);
+    EXPECT_EQ(m.get(0).get(6), 0.0);
+
+    // Pushing an element of the array onto itself survives the reallocation.
+    TypedArray<TypedArray<double>> self;
+    self.get(0).push(2.0);
+    for (int i = 0; i < 40; i++) self.push(self.safe_get(0));
+    EXPECT_EQ(self.safe_get(40).safe_get(0), 2.0);
+
+    TypedArray<TypedArray<double>> moved(std::move(m));
+    EXPECT_EQ(moved.size(), 100);
+    EXPECT_EQ(m.size(), 0);
+    m = std::move(moved);
+    EXPECT_EQ(&m.get(0).get(7), inner);
+
+    TypedArray<std::unique_ptr<int>> owners;
+    owners.emplace(new int(3));
+    owners.push_front(std::unique_ptr<int>(new int(4)));
+    EXPECT_EQ(*owners.pop(), 3);
+    EXPECT_EQ(*owners.pop_front(), 4);
+}
+
+template <typename Array, typename Element>
+bool stored_inline(const Array& a, const Element& e) {
+    const char* p = reinterpret_cast<const char*>(&e);
+    return p >= reinterpret_cast<const char*>(&a) && p < reinterpret_cast<const char*>(&a + 1);
+}
+
+TEST(TypedArray, InlineCapacity) {
+    TypedArray<double, 4> a;
+    a.push(2);
+    a.push(3);
+    a.push_front(1);
+    a.push_front(0);
+    EXPECT_EQ(a.size(), 4);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(a.safe_get(i), i);
+        EXPECT_TRUE(stored_inline(a, a.safe_get(i)));
+    }
+    EXPECT_EQ(a.pop_front(), 0);
+    a.push(4);
+    EXPECT_TRUE(stored_inline(a, a.safe_get(3)));
+
+    TypedArray<double, 4> b = a;
+    EXPECT_TRUE(stored_inline(b, b.safe_get(0)));
+    a.push(5);
+    EXPECT_FALSE(stored_inline(a, a.safe_get(0)));
+    for (int i = 0; i < 5; i++) EXPECT_EQ(a.safe_get(i), i + 1);
+    EXPECT_EQ(b.size(), 4);
+    EXPECT_EQ(b.safe_get(3), 4);
+    a.set(9, 9);
+    EXPECT_EQ(a.safe_get(7), 0);
+
+    // Rows of a matrix-like array stay inside the outer array's buffer.
+    TypedArray<TypedArray<double, 3>> m;
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++) m.get(i).set(j, 3*i + j);
+    for (int i = 0; i < 3; i++) {
+        EXPECT_TRUE(stored_inline(m.safe_get(i), m.safe_get(i).safe_get(2)));
+        EXPECT_EQ(m.safe_get(i).safe_get(2), 3*i + 2);
+    }
+
+    TypedArray<std::unique_ptr<int>, 2> owners;
+    owners.emplace(new int(1));
+    TypedArray<std::unique_ptr<int>, 2> moved(std::move(owners));
+    EXPECT_EQ(owners.size(), 0);
+    EXPECT_TRUE(stored_inline(moved, moved.safe_get(0)));
+    moved.emplace_front(new int(0));
+    moved.emplace(new int(2));
+    owners = std::move(moved);
+    EXPECT_EQ(*owners.pop(), 2);
+    EXPECT_EQ(*owners.pop(), 1);
+    EXPECT_EQ(*owners.pop(), 0);
+}
+
+// Counts the blocks it has handed out and not yet taken back.
+template <typename T>
+struct CountingAllocator {
+    typedef T value_type;
+    int* live;
+    explicit CountingAllocator(int* live) : live(live) {}
+    template <typename U> CountingAllocator(const CountingAllocator<U>& o) : live(o.live) {}
+    T* allocate(size_t n) { ++*live; return std::allocator<T>().allocate(n); }
+    void deallocate(T* p, size_t n) { --*live; std::allocator<T>().deallocate(p, n); }
+    bool operator==(const CountingAllocator& o) const { return live == o.live; }
+    bool operator!=(const CountingAllocator& o) const { return live != o.live; }
+};
+
+TEST(TypedArray, Allocators) {
+    int live = 0, other = 0;
+    {
+        TypedArray<int, 0, CountingAllocator<int>> a{CountingAllocator<int>(&live)};
+        for (int i = 0; i < 100; i++) a.push(i);
+        EXPECT_EQ(live, 1);
+        TypedArray<int, 0, CountingAllocator<int>> b = a;
+        EXPECT_EQ(live, 2);
+        TypedArray<int, 0, CountingAllocator<int>> c{CountingAllocator<int>(&other)};
+        c = std::move(b);
+        EXPECT_EQ(c.get_allocator().live, &other);
+        EXPECT_EQ(c.safe_get(99), 99);
+        EXPECT_EQ(live, 1);
+        EXPECT_EQ(other, 1);
+    }
+    EXPECT_EQ(live, 0);
+    EXPECT_EQ(other, 0);
+
+    // With no upstream, any allocation outside the arena throws.
+    alignas(std::max_align_t) static char bytes[1 << 15];
+    std::pmr::monotonic_buffer_resource arena(bytes, sizeof(bytes), std::pmr::null_memory_resource());
+    pmr::TypedArray<pmr::TypedArray<double>> m(&arena);
+    for (int i = 0; i < 20; i++)
+        for (int j = 0; j < 20; j++) m.get(i).set(j, i * j);
+    EXPECT_EQ(m.safe_get(3).get_allocator().resource(), &arena);
+    EXPECT_EQ(m.safe_get(19).safe_get(19), 361);
+    pmr::TypedArray<double> outside;
+    outside.push(1);
+    m.push(outside);
+    EXPECT_EQ(m.safe_get(20).get_allocator().resource(), &arena);
+    EXPECT_EQ(outside.get_allocator().resource(), std::pmr::get_default_resource());
+    EXPECT_EQ(m.safe_get(20).safe_get(0), 1);
+}
+
+TEST(TypedArray, BulkOperations) {
+    TypedArray<int> a;
+    a.reserve(1000);
+    a.push(0);
+    int* first = &a.get(0);
+    for (int i = 1; i < 1000; i++) a.push(i);
+    EXPECT_EQ(&a.get(0), first);
+
+    std::vector<int> v{-3, -2, -1};
+    TypedArray<int> b;
+    b.append(v.begin(), v.end());
+    b.append(a);
+    b.append(b);
+    EXPECT_EQ(b.size(), 2006);
+    EXPECT_EQ(b.safe_get(1002), 999);
+    EXPECT_EQ(b.safe_get(1003), -3);
+    EXPECT_EQ(b.safe_get(2005), 999);
+
+    int mid[] = {7, 8};
+    b.insert(1, mid, mid + 2);
+    b.insert(0, v.begin(), v.begin() + 1);
+    b.insert(b.size(), mid, mid + 1);
+    EXPECT_EQ(b.size(), 2010);
+    EXPECT_EQ(b.safe_get(0), -3);
+    EXPECT_EQ(b.safe_get(1), -3);
+    EXPECT_EQ(b.safe_get(2), 7);
+    EXPECT_EQ(b.safe_get(3), 8);
+    EXPECT_EQ(b.safe_get(4), -2);
+    EXPECT_EQ(b.safe_get(2009), 7);
+    EXPECT_THROW(b.insert(-1, mid, mid + 1), std::range_error);
+
+    std::istringstream words("4 5 6");
+    TypedArray<int> c;
+    c.append(std::istream_iterator<int>(words), std::istream_iterator<int>());
+    EXPECT_EQ(c.size(), 3);
+    EXPECT_EQ(c.safe_get(2), 6);
+
+    TypedArray<int> d = a + a;
+    EXPECT_EQ(d.size(), 2000);
+    EXPECT_EQ(d.safe_get(1000), 0);
+    EXPECT_EQ(d.safe_get(1999), 999);
+    d = c;
+    EXPECT_EQ(d.size(), 3);
+    EXPECT_EQ(d.safe_get(0), 4);
+
+    d.resize(5, 9);
+    d.resize(6);
+    EXPECT_EQ(d.safe_get(4), 9);
+    EXPECT_EQ(d.safe_get(5), 0);
+    d.resize(2);
+    EXPECT_EQ(d.size(), 2);
+    EXPECT_THROW(d.resize(-1), std::range_error);
+
+    TypedArray<std::string, 4> s;
+    for (int i = 0; i < 10; i++) s.push(std::to_string(i));
+    std::string more[] = {"x", "y"};
+    s.insert(5, more, more + 2);
+    EXPECT_EQ(s.safe_get(5), "x");
+    EXPECT_EQ(s.safe_get(7), "5");
+    s.resize(3);
+    s.shrink_to_fit();
+    EXPECT_TRUE(stored_inline(s, s.safe_get(0)));
+    EXPECT_EQ(s.safe_get(2), "2");
+}
+
+TEST(TypedRing, QueueAtBothEnds) {
+    TypedRing<int> q;
+    for (int i = 0; i < 10; i++) q.push(i);
+    int capacity = q.capacity();
+    // A FIFO of steady size wraps around instead of growing.
+    for (int i = 10; i < 1000; i++) {
+        EXPECT_EQ(q.pop_front(), i - 10);
+        q.push(i);
+    }
+    EXPECT_EQ(q.capacity(), capacity);
+    EXPECT_EQ(q.size(), 10);
+    EXPECT_EQ(q.safe_get(0), 990);
+    EXPECT_EQ(q.safe_get(9), 999);
+
+    // Growth keeps the order of a wrapped ring.
+    for (int i = 1; i <= 20; i++) q.push_front(990 - i);
+    EXPECT_GT(q.capacity(), capacity);
+    for (int i = 0; i < q.size(); i++) EXPECT_EQ(q.safe_get(i), 970 + i);
+    EXPECT_EQ(q.pop(), 999);
+    q.set(0, -1);
+    EXPECT_EQ(q.pop_front(), -1);
+    EXPECT_THROW(q.get(q.size()), std::range_error);
+
+    TypedRing<int> last = TypedRing<int>::bounded(3);
+    for (int i = 0; i < 5; i++) last.push(i);
+    EXPECT_EQ(last.size(), 3);
+    EXPECT_EQ(last.capacity(), 3);
+    EXPECT_EQ(last.safe_get(0), 2);
+    EXPECT_EQ(last.safe_get(2), 4);
+    last.push_front(1);
+    EXPECT_EQ(last.safe_get(0), 1);
+    EXPECT_EQ(last.safe_get(2), 3);
+    TypedRing<int> copy = last;
+    EXPECT_TRUE(copy.is_bounded());
+    EXPECT_EQ(copy.pop(), 3);
+    EXPECT_EQ(last.size(), 3);
+    EXPECT_THROW(TypedRing<int>::bounded(0), std::invalid_argument);
+
+    TypedRing<std::unique_ptr<int>> owners = TypedRing<std::unique_ptr<int>>::bounded(2);
+    for (int i = 0; i < 4; i++) owners.emplace(new int(i));
+    TypedRing<std::unique_ptr<int>> moved = std::move(owners);
+    EXPECT_EQ(*moved.pop_front(), 2);
+    EXPECT_EQ(*moved.pop_front(), 3);
+    EXPECT_EQ(owners.size(), 0);
+}
+
+TEST(SegmentedArray, StableReferencesAcrossGrowth) {
+    SegmentedArray<int, 4> a;
+    a.push(0);
+    int* zero = &a.get(0);
+    for (int i = 1; i <= 100; i++) {
+        a.push(i);
+        a.push_front(-i);
+    }
+    EXPECT_EQ(&a.get(100), zero);
+    EXPECT_EQ(*zero, 0);
+    EXPECT_EQ(a.size(), 201);
+    EXPECT_EQ(a.safe_get(0), -100);
+    EXPECT_EQ(a.safe_get(200), 100);
+
+    // Random operations at both ends against std::deque.
+    std::deque<int> expected(a.size());
+    for (int i = 0; i < a.size(); i++) expected[i] = a.safe_get(i);
+    unsigned seed = 1;
+    for (int step = 0; step < 5000; step++) {
+        seed = seed * 1103515245 + 12345;
+        switch ((seed >> 16) % 4) {
+        case 0: a.push(step); expected.push_back(step); break;
+        case 1: a.push_front(step); expected.push_front(step); break;
+        case 2: if (a.size() > 0) { EXPECT_EQ(a.pop(), expected.back()); expected.pop_back(); } break;
+        case 3: if (a.size() > 0) { EXPECT_EQ(a.pop_front(), expected.front()); expected.pop_front(); } break;
+        }
+    }
+    ASSERT_EQ(a.size(), int(expected.size()));
+    for (int i = 0; i < a.size(); i++) EXPECT_EQ(a.safe_get(i), expected[i]);
+
+    while (a.size() > 0) a.pop_front();
+    a.set(5, 7);
+    EXPECT_EQ(a.size(), 6);
+    EXPECT_EQ(a.get(4), 0);
+    EXPECT_THROW(a.safe_get(6), std::range_error);
+
+    SegmentedArray<TypedArray<double>> m;
+    m.get(2).push(1.5);
+    SegmentedArray<TypedArray<double>> copy = m;
+    m.get(2).set(0, 2.5);
+    EXPECT_EQ(copy.get(2).get(0), 1.5);
+    SegmentedArray<TypedArray<double>> moved = std::move(m);
+    EXPECT_EQ(moved.get(2).get(0), 2.5);
+    EXPECT_EQ(m.size(), 0);
+    // An element of the array can be pushed onto it.
+    for (int i = 0; i < 600; i++) moved.push(moved.safe_get(2));
+    EXPECT_EQ(moved.safe_get(602).safe_get(0), 2.5);
+}
+
+TEST(TypedArray, IteratorsAndParallelAlgorithms) {
+    TypedArray<int, 4> a;
+    for (int i = 0; i < 6; i++) a.push_front(i);
+    EXPECT_EQ(a.end() - a.begin(), a.size());
+    EXPECT_EQ(a.data(), &a.get(0));
+    std::sort(a.begin(), a.end());
+    int next = 0;
+    for (int x : a) EXPECT_EQ(x, next++);
+    const TypedArray<int, 4>& c = a;
+    EXPECT_EQ(std::accumulate(c.begin(), c.end(), 0), 15);
+
+    // Small grains push ranges this size through the threaded paths, which
+    // must agree with the serial ones.
+    TypedArray<long> b;
+    unsigned seed = 7;
+    for (int i = 0; i < 10007; i++) {
+        seed = seed * 1103515245 + 12345;
+        b.push((seed >> 8) % 1000);
+    }
+    std::vector<long> expected(b.begin(), b.end());
+    std::sort(expected.begin(), expected.end());
+    long total = std::accumulate(expected.begin(), expected.end(), 0L);
+    for (size_t threads : {1, 3, 4}) {
+        parallel::ScopedNumThreads t(threads);
+        TypedArray<long> s = b;
+        parallel::parallel_sort(s.begin(), s.end(), std::less<>(), 100);
+        EXPECT_TRUE(std::equal(s.begin(), s.end(), expected.begin()));
+        parallel::parallel_sort(s.begin(), s.end(), std::greater<>(), 100);
+        EXPECT_TRUE(std::is_sorted(s.begin(), s.end(), std::greater<>()));
+        EXPECT_EQ(parallel::parallel_reduce(s.begin(), s.end(), 5L, std::plus<>(), 100), total + 5);
+
+        TypedArray<double> d;
+        d.resize(s.size());
+        EXPECT_EQ(parallel::parallel_transform(s.begin(), s.end(), d.begin(), [](long x) { return x / 2.0; }, 100),
+                  d.end());
+        parallel::parallel_for_each(d.begin(), d.end(), [](double& x) { x *= 2; }, 100);
+        EXPECT_TRUE(std::equal(d.begin(), d.end(), s.begin()));
+    }
+
+    TypedArray<std::string> words;
+    for (int i = 0; i < 300; i++) words.push(std::to_string(i * 7919 % 300));
+    parallel::ScopedNumThreads t(4);
+    parallel::parallel_sort(words.begin(), words.end(), std::less<>(), 10);
+    EXPECT_TRUE(std::is_sorted(words.begin(), words.end()));
+    EXPECT_EQ(words.safe_get(0), "0");
+}
+
+TEST(ConcurrentTypedArray, ConcurrentProducersAndReader) {
+    ConcurrentTypedArray<std::string> a;
+    a.push("first");
+    const std::string* first = &a.safe_get(0);
+    EXPECT_THROW(a.safe_get(1), std::range_error);
+
+    // Four producers push and append while a reader checks that the
+    // committed prefix is always fully constructed.
+    const int per_thread = 5000;
+    std::atomic<bool> done(false);
+    std::thread reader([&] {
+        int seen = 0;
+        while (!done.load()) {
+            int n = 0;
+            for (const std::string& s : a) {
+                EXPECT_FALSE(s.empty());
+                n++;
+            }
+            EXPECT_GE(n, seen);
+            seen = n;
+        }
+    });
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 4; t++) {
+        producers.emplace_back([&a, t] {
+            for (int i = 0; i < per_thread; i += 10) {
+                for (int j = 0; j < 5; j++) a.push(std::to_string(t * per_thread + i + j));
+                std::string batch[5];
+                for (int j = 0; j < 5; j++) batch[j] = std::to_string(t * per_thread + i + 5 + j);
+                a.append(batch, batch + 5);
+            }
+        });
+    }
+    for (std::thread& p : producers) p.join();
+    done = true;
+    reader.join();
+
+    ASSERT_EQ(a.size(), 4 * per_thread + 1);
+    EXPECT_EQ(&a.safe_get(0), first);
+    std::vector<int> values;
+    for (auto it = a.begin() + 1; it != a.end(); ++it) values.push_back(std::stoi(*it));
+    std::sort(values.begin(), values.end());
+    for (int i = 0; i < 4 * per_thread; i++) EXPECT_EQ(values[i], i);
+    EXPECT_EQ(a.end() - a.begin(), a.size());
+    EXPECT_EQ(a.begin()[1].empty(), false);
+
+    // An append that throws part way publishes the elements before the throw.
+    ConcurrentTypedArray<std::vector<int>> sized;
+    long lengths[] = {1, 2, -1, 3};
+    EXPECT_THROW(sized.append(lengths, lengths + 4), std::length_error);
+    ASSERT_EQ(sized.size(), 2);
+    EXPECT_EQ(sized.safe_get(1).size(), 2u);
+
+    // The last index the array accepts lies in the last segment of the table.
+    EXPECT_EQ(concurrent_typed_array::locate(concurrent_typed_array::MAX_SIZE - 1),
+              std::make_pair(concurrent_typed_array::MAX_SEGMENTS - 1,
+                             (concurrent_typed_array::FIRST_SEGMENT << (concurrent_typed_array::MAX_SEGMENTS - 1)) - 1));
+}
+
 TEST(Matrix, ConstructorsAndAccess) {
     Matrix a;
     EXPECT_TRUE(a.isEmpty());
@@ -176,6 +626,721 @@ TEST(Matrix, Multiply) {
     EXPECT_THROW(b * a, std::invalid_argument);
 }
 
+TEST(Matrix, MultiplyBlockedMatchesNaive) {
+    // Sizes chosen to leave partial register tiles and partial cache blocks.
+    const size_t m = 131, k = 300, n = 77;
+    Matrix a(m, k), b(k, n);
+    for (size_t i = 0; i < m; i++)
+        for (size_t j = 0; j < k; j++) a(i,j) = std::sin(0.1 * i + 0.3 * j);
+    for (size_t i = 0; i < k; i++)
+        for (size_t j = 0; j < n; j++) b(i,j) = std::cos(0.2 * i - 0.7 * j);
+
+    Matrix expected(m, n, 0.0);
+    for (size_t i = 0; i < m; i++)
+        for (size_t p = 0; p < k; p++)
+            for (size_t j = 0; j < n; j++) expected(i,j) += a(i,p) * b(p,j);
+
+    EXPECT_TRUE(a * b == expected);
+}
+
+TEST(Matrix, ParallelMatchesSerial) {
+    const size_t n = 300;
+    Matrix a(n, n), b(n, n);
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < n; j++) {
+            a(i,j) = std::sin(0.01 * i * j);
+            b(i,j) = std::cos(0.02 * i + j);
+        }
+
+    Matrix prod, sum, scaled, t;
+    double nrm;
+    {
+        parallel::ScopedNumThreads serial(1);
+        EXPECT_EQ(parallel::num_threads(), 1u);
+        prod = a * b;
+        sum = a + b;
+        scaled = a * 3.0;
+        t = a.transpose();
+        nrm = a.norm();
+    }
+    parallel::ScopedNumThreads four(4);
+    EXPECT_EQ(parallel::num_threads(), 4u);
+    EXPECT_TRUE(a * b == prod);
+    EXPECT_TRUE(a + b == sum);
+    EXPECT_TRUE(a * 3.0 == scaled);
+    EXPECT_TRUE(a.transpose() == t);
+    EXPECT_DOUBLE_EQ(a.norm(), nrm);
+}
+
+TEST(Matrix, FusedExpressions) {
+    Matrix a{{1,2},{3,4}};
+    Matrix b{{5,6},{7,8}};
+    Matrix c{{1,1},{1,1}};
+
+    Matrix r = a + b * 2.0 - c;
+    EXPECT_TRUE(r == Matrix({{10,13},{16,19}}));
+
+    r += -a / 2.0;
+    EXPECT_DOUBLE_EQ(r(0,0), 9.5);
+    EXPECT_DOUBLE_EQ(r(1,1), 17.0);
+
+    a = a + a * 2.0;
+    EXPECT_DOUBLE_EQ(a(1,0), 9.0);
+
+    Matrix p = (c + c) * b;
+    EXPECT_DOUBLE_EQ(p(0,0), 24.0);
+    EXPECT_DOUBLE_EQ(p(1,1), 28.0);
+    EXPECT_TRUE(c * 2.0 != c);
+
+    EXPECT_THROW(r = a + b - Matrix(3,3), std::invalid_argument);
+    EXPECT_THROW(r = (a + b) / 0.0, std::invalid_argument);
+}
+
+TEST(Matrix, MoveSemanticsAndAlignment) {
+    Matrix a(5, 7, 2.0);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(a.data()) % 64, 0u);
+
+    const double* buffer = a.data();
+    Matrix b = std::move(a);
+    EXPECT_EQ(b.data(), buffer);
+    EXPECT_TRUE(a.isEmpty());
+
+    Matrix c(5, 7, 1.0);
+    Matrix d = std::move(b) + c;
+    EXPECT_EQ(d.data(), buffer);
+    EXPECT_DOUBLE_EQ(d(4,6), 3.0);
+
+    Matrix e = std::move(d) * 2.0;
+    EXPECT_EQ(e.data(), buffer);
+    EXPECT_DOUBLE_EQ(e(0,0), 6.0);
+
+    c = std::move(e);
+    EXPECT_EQ(c.data(), buffer);
+}
+
+TEST(Matrix, InPlaceKernels) {
+    Matrix a{{1,2},{3,4}};
+    Matrix b{{5,6},{7,8}};
+    Matrix c(2, 2, 1.0);
+    const double* buffer = c.data();
+
+    gemm(2.0, a, b, 1.0, c);
+    EXPECT_TRUE(c == Matrix({{39,45},{87,101}}));
+    gemm(1.0, a, b, 0.0, c);
+    EXPECT_TRUE(c == a * b);
+
+    add_into(c, a, b);
+    EXPECT_TRUE(c == a + b);
+    subtract_into(c, a, b);
+    EXPECT_TRUE(c == a - b);
+    scale_into(c, 3.0, a);
+    EXPECT_TRUE(c == a * 3.0);
+    EXPECT_EQ(c.data(), buffer);
+
+    gemm(1.0, a, a, 0.0, a);
+    EXPECT_TRUE(a == Matrix({{7,10},{15,22}}));
+
+    Matrix wrong(3, 3);
+    EXPECT_THROW(gemm(1.0, a, b, 0.0, wrong), std::invalid_argument);
+    EXPECT_THROW(add_into(wrong, a, b), std::invalid_argument);
+}
+
+TEST(Matrix, Views) {
+    Matrix a{{1,2,3},{4,5,6},{7,8,9}};
+    const Matrix& ca = a;
+
+    EXPECT_TRUE(Matrix(a.block(1, 1, 2, 2)) == Matrix({{5,6},{8,9}}));
+    EXPECT_TRUE(Matrix(ca.row(2)) == Matrix({{7,8,9}}));
+    EXPECT_TRUE(Matrix(ca.col(0)) == Matrix({{1},{4},{7}}));
+    EXPECT_TRUE(Matrix(ca.diagonal_view()) == a.diagonal());
+    EXPECT_TRUE(Matrix(ca.transpose_view()) == a.transpose());
+    EXPECT_TRUE(a.transpose_view().block(0, 1, 2, 2) == Matrix({{4,7},{5,8}}));
+    EXPECT_DOUBLE_EQ(a.block(0, 0, 2, 2).trace(), 6.0);
+    EXPECT_DOUBLE_EQ(ca.row(0).norm(), std::sqrt(14.0));
+    EXPECT_THROW(a.block(2, 2, 2, 1), std::out_of_range);
+
+    // Views reduce with the same kernels as matrices, scaling included.
+    Matrix huge(2, 2, 1e200);
+    EXPECT_DOUBLE_EQ(huge.block(0, 0, 2, 2).norm(), 2e200);
+    EXPECT_EQ(huge.block(0, 0, 2, 2).norm(), huge.norm());
+    EXPECT_EQ(ca.transpose_view().trace(), a.trace());
+
+    // Arithmetic mixes views and matrices and writes through to a.
+    Matrix sum = a.row(0) + a.row(1) * 2.0;
+    EXPECT_TRUE(sum == Matrix({{9,12,15}}));
+    a.col(2) += a.col(0);
+    EXPECT_TRUE(ca.col(2) == Matrix({{4},{10},{16}}));
+    a.diagonal_view().fill(0.0);
+    EXPECT_DOUBLE_EQ(a.trace(), 0.0);
+    EXPECT_THROW(a.row(0) = a.col(0), std::invalid_argument);
+
+    // Products read views through their strides without copying.
+    Matrix big(40, 50);
+    for (size_t i = 0; i < big.rows(); i++)
+        for (size_t j = 0; j < big.cols(); j++) big(i, j) = double((i * 7 + j * 3) % 11) - 5.0;
+    Matrix left(big.block(3, 5, 20, 30));
+    Matrix right(big.transpose_view().block(2, 1, 30, 25));
+    EXPECT_TRUE(big.block(3, 5, 20, 30) * big.transpose_view().block(2, 1, 30, 25) == left * right);
+
+    Matrix c = Matrix::zeros(20, 25);
+    gemm(1.0, big.block(3, 5, 20, 30), right, 0.0, c.transpose_view().transpose_view());
+    EXPECT_TRUE(c == left * right);
+
+    // Overlapping output and input go through a temporary.
+    Matrix square(big.block(0, 0, 10, 10));
+    Matrix expected = square * square;
+    gemm(1.0, big.block(0, 0, 10, 10), big.block(0, 0, 10, 10), 0.0, big.block(5, 5, 10, 10));
+    EXPECT_TRUE(big.block(5, 5, 10, 10) == expected);
+}
+
+TEST(Matrix, AssignFromOverlappingView) {
+    Matrix b{{1,2},{3,4}};
+    b += b.transpose_view();
+    EXPECT_TRUE(b == Matrix({{2,5},{5,8}}));
+
+    b = Matrix({{1,2},{3,4}});
+    b = b.transpose_view() * 1.0;
+    EXPECT_TRUE(b == Matrix({{1,3},{2,4}}));
+
+    Matrix a{{1,2,3},{4,5,6}};
+    a = a.transpose_view() - a.transpose_view() * 2.0;
+    EXPECT_TRUE(a == Matrix({{-1,-4},{-2,-5},{-3,-6}}));
+
+    // Views written from overlapping views.
+    Matrix c{{1,2,3},{4,5,6},{7,8,9}};
+    c.block(1, 1, 2, 2) = c.block(0, 0, 2, 2);
+    EXPECT_TRUE(c == Matrix({{1,2,3},{4,1,2},{7,4,5}}));
+    Matrix d{{1,2},{4,5}};
+    MatrixView<double> v = d.block(0, 0, 2, 2);
+    v += v.transpose_view();
+    EXPECT_TRUE(d == Matrix({{2,6},{6,10}}));
+
+    // Large enough that evaluation is split across threads.
+    parallel::ScopedNumThreads threads(4);
+    Matrix big(300, 300), expected(300, 300);
+    for (size_t i = 0; i < big.rows(); i++)
+        for (size_t j = 0; j < big.cols(); j++) big(i, j) = double(i * 300 + j);
+    for (size_t i = 0; i < big.rows(); i++)
+        for (size_t j = 0; j < big.cols(); j++) expected(i, j) = big(i, j) + big(j, i);
+    big -= -big.transpose_view();
+    EXPECT_TRUE(big == expected);
+}
+
+template <typename T>
+void check_typed_multiply() {
+    const size_t m = 70, k = 130, n = 45;
+    TypedMatrix<T> a(m, k), b(k, n), expected(m, n);
+    for (size_t i = 0; i < m; i++)
+        for (size_t j = 0; j < k; j++) a(i,j) = T((i * 7 + j * 3) % 11) - T(5);
+    for (size_t i = 0; i < k; i++)
+        for (size_t j = 0; j < n; j++) b(i,j) = T((i * 5 + j) % 7) - T(3);
+    for (size_t i = 0; i < m; i++)
+        for (size_t p = 0; p < k; p++)
+            for (size_t j = 0; j < n; j++) expected(i,j) += a(i,p) * b(p,j);
+    EXPECT_TRUE(a * b == expected);
+}
+
+TEST(Matrix, ElementTypes) {
+    check_typed_multiply<float>();
+    check_typed_multiply<double>();
+    check_typed_multiply<int32_t>();
+    check_typed_multiply<int64_t>();
+
+    TypedMatrix<int32_t> i{{7,8},{9,10}};
+    TypedMatrix<int32_t> q = i / 2 + i * 3 - TypedMatrix<int32_t>::ones(2,2);
+    EXPECT_EQ(q(0,0), 23);
+    EXPECT_EQ(q(1,1), 34);
+    EXPECT_THROW(i / 0, std::invalid_argument);
+    EXPECT_DOUBLE_EQ((TypedMatrix<int64_t>{{3,4}}.norm()), 5.0);
+
+    TypedMatrix<float> f{{1.0f, 2.0f}};
+    EXPECT_TRUE(f * 2.0f == TypedMatrix<float>({{2.0f, 4.0f}}));
+    EXPECT_FLOAT_EQ(f.transpose()(1,0), 2.0f);
+    EXPECT_EQ(Matrix::EPSILON, MatrixTraits<double>::epsilon);
+}
+
+TEST(StaticMatrix, CompileTimeArithmetic) {
+    constexpr Matrix2 a{{1,2},{3,4}};
+    constexpr Matrix2 b = a * Matrix2::identity();
+    static_assert(b(1,0) == 3.0, "identity product");
+    static_assert(a.transpose()(0,1) == 3.0, "transpose");
+    static_assert(a.trace() == 5.0, "trace");
+
+    constexpr StaticMatrix<2,3> c{{1,2,3},{4,5,6}};
+    constexpr StaticMatrix<3,2> d{{7,8},{9,10},{11,12}};
+    constexpr StaticMatrix<2,2> e = c * d;
+    static_assert(e(0,0) == 58.0 && e(1,1) == 154.0, "product");
+
+    EXPECT_TRUE(a + a == a * 2.0);
+    EXPECT_TRUE(-a == a - a * 2.0);
+    EXPECT_DOUBLE_EQ((a / 2.0)(1,1), 2.0);
+    EXPECT_THROW(a / 0.0, std::invalid_argument);
+    EXPECT_THROW(a.at(2,0), std::out_of_range);
+}
+
+TEST(StaticMatrix, ConvertsToAndFromMatrix) {
+    Matrix m{{1,2,3},{4,5,6}};
+    StaticMatrix<2,3> s(m);
+    EXPECT_DOUBLE_EQ(s(1,2), 6.0);
+
+    Matrix back = s.transpose();
+    EXPECT_EQ(back.rows(), 3u);
+    EXPECT_TRUE(back == m.transpose());
+
+    EXPECT_THROW(Matrix3 bad(m), std::invalid_argument);
+}
+
+TEST(SparseMatrix, AssemblyAndConversion) {
+    SparseMatrix s(3, 4, {{2, 1, 5.0}, {0, 3, 1.0}, {0, 0, 2.0}, {2, 1, -1.0}, {1, 2, 0.0}});
+    EXPECT_EQ(s.rows(), 3u);
+    EXPECT_EQ(s.cols(), 4u);
+    EXPECT_EQ(s.nonzeros(), 3u);
+    EXPECT_DOUBLE_EQ(s(2, 1), 4.0);
+    EXPECT_DOUBLE_EQ(s(1, 2), 0.0);
+    EXPECT_THROW(s.at(3, 0), std::out_of_range);
+    EXPECT_THROW(SparseMatrix(2, 2, {{2, 0, 1.0}}), std::out_of_range);
+
+    Matrix dense{{2,0,0,1},{0,0,0,0},{0,4,0,0}};
+    EXPECT_TRUE(s.to_dense() == dense);
+    EXPECT_TRUE(SparseMatrix(dense) == s);
+    EXPECT_EQ(s.triplets().size(), 3u);
+    EXPECT_TRUE(s.transpose().to_dense() == dense.transpose());
+}
+
+TEST(SparseMatrix, ArithmeticMatchesDense) {
+    const size_t m = 300, k = 200;
+    std::vector<SparseMatrix::Triplet> entries;
+    for (size_t i = 0; i < m; i++) {
+        for (size_t t = 0; t < 3; t++) entries.push_back({i, (i * 37 + t * 61) % k, double(t + 1)});
+    }
+    SparseMatrix a(m, k, entries);
+    SparseMatrix b = a.transpose().transpose() * 2.0;
+    Matrix da = a.to_dense();
+    Matrix x(k, 9);
+    for (size_t i = 0; i < k; i++)
+        for (size_t j = 0; j < 9; j++) x(i, j) = double((i + 2 * j) % 5) - 2.0;
+
+    EXPECT_TRUE(a * x == da * x);
+    EXPECT_TRUE(a.multiply(x.col(4)) == da * x.col(4));
+    EXPECT_TRUE(a.multiply(x.transpose_view().transpose_view()) == da * x);
+    EXPECT_TRUE((a + b).to_dense() == da * 3.0);
+    EXPECT_EQ((b - a * 2.0).nonzeros(), 0u);
+    EXPECT_TRUE((-a).to_dense() == -da);
+    {
+        parallel::ScopedNumThreads serial(1);
+        EXPECT_TRUE(a * x == da * x);
+    }
+
+    EXPECT_THROW(a * Matrix(m, 2), std::invalid_argument);
+    EXPECT_THROW(a + a.transpose(), std::invalid_argument);
+}
+
+// Well-conditioned test matrix: diagonally dominant and, when symmetric is
+// set, symmetric positive definite.
+template <typename T>
+TypedMatrix<T> test_system(size_t n, bool symmetric) {
+    TypedMatrix<T> a(n, n);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++) {
+            size_t h = symmetric ? (i * j + i + j) : (i * 31 + j * 17);
+            a(i, j) = T(h % 13) / T(13) - T(0.5);
+        }
+        a(i, i) = T(n);
+    }
+    return a;
+}
+
+TEST(Factorization, LU) {
+    Matrix a{{0,2,1},{1,1,0},{3,0,1}};
+    LU<double> lu(a);
+    EXPECT_NEAR(lu.determinant(), -5.0, 1e-12);
+    EXPECT_TRUE(a * lu.inverse() == Matrix::identity(3));
+    Matrix b{{3},{2},{4}};
+    EXPECT_TRUE(a * lu.solve(b) == b);
+
+    Matrix big = test_system<double>(200, false);
+    Matrix rhs(200, 3, 1.0);
+    EXPECT_TRUE(big * LU<double>(big).solve(rhs) == rhs);
+
+    Matrix singular{{1,2},{2,4}};
+    EXPECT_TRUE(LU<double>(singular).isSingular());
+    EXPECT_DOUBLE_EQ(LU<double>(singular).determinant(), 0.0);
+    EXPECT_THROW(LU<double>(singular).solve(Matrix(2, 1)), std::runtime_error);
+    EXPECT_THROW(LU<double>(Matrix(2, 3)), std::invalid_argument);
+    EXPECT_THROW(lu.solve(Matrix(2, 1)), std::invalid_argument);
+}
+
+TEST(Factorization, Cholesky) {
+    Matrix a{{4,2,2},{2,5,3},{2,3,6}};
+    Cholesky<double> c(a);
+    EXPECT_TRUE(c.lower() * c.lower().transpose() == a);
+    EXPECT_DOUBLE_EQ(c.lower()(0, 1), 0.0);
+    EXPECT_NEAR(c.determinant(), LU<double>(a).determinant(), 1e-9);
+    EXPECT_TRUE(a * c.inverse() == Matrix::identity(3));
+
+    TypedMatrix<float> big = test_system<float>(150, true);
+    TypedMatrix<float> rhs(150, 2, 1.0f);
+    TypedMatrix<float> x = Cholesky<float>(big).solve(rhs);
+    EXPECT_LT((big * x - rhs).norm(), 1e-3f);
+
+    EXPECT_THROW(Cholesky<double>(Matrix({{1,2},{2,1}})), std::invalid_argument);
+}
+
+TEST(Factorization, QR) {
+    Matrix a = test_system<double>(150, false);
+    QR<double> qr(a);
+    Matrix q = qr.Q();
+    EXPECT_TRUE(q.transpose() * q == Matrix::identity(150));
+    EXPECT_TRUE(q * qr.R() == a);
+    EXPECT_NEAR(QR<double>(Matrix({{0,2,1},{1,1,0},{3,0,1}})).determinant(), -5.0, 1e-12);
+    EXPECT_TRUE(a * qr.inverse() == Matrix::identity(150));
+
+    // Least squares: the line through (0,1), (1,3), (2,5), (3,7) is y = 2x + 1.
+    Matrix design{{1,0},{1,1},{1,2},{1,3}};
+    Matrix y{{1},{3},{5},{7}};
+    EXPECT_TRUE(QR<double>(design).solve(y) == Matrix({{1},{2}}));
+    EXPECT_THROW(QR<double>(Matrix(2, 3)), std::invalid_argument);
+    EXPECT_THROW(QR<double>(design).determinant(), std::invalid_argument);
+}
+
+template <typename T>
+void check_transpose(size_t rows, size_t cols) {
+    TypedMatrix<T> a(rows, cols);
+    for (size_t i = 0; i < rows; i++)
+        for (size_t j = 0; j < cols; j++) a(i, j) = T(i * 1000 + j);
+    TypedMatrix<T> t = a.transpose();
+    ASSERT_EQ(t.rows(), cols);
+    ASSERT_EQ(t.cols(), rows);
+    EXPECT_TRUE(t == a.transpose_view());
+    a.transpose_in_place();
+    EXPECT_TRUE(a == t);
+}
+
+TEST(Matrix, TiledTransposeAndInPlace) {
+    check_transpose<double>(67, 131);
+    check_transpose<double>(300, 300);
+    check_transpose<float>(131, 67);
+    check_transpose<float>(259, 259);
+    check_transpose<int32_t>(37, 37);
+    check_transpose<int64_t>(5, 9);
+    check_transpose<double>(0, 4);
+
+    Matrix a = test_system<double>(500, false);
+    Matrix t = a.transpose();
+    const double* storage = a.data();
+    {
+        parallel::ScopedNumThreads four(4);
+        a.transpose_in_place();
+    }
+    EXPECT_EQ(a.data(), storage);
+    EXPECT_TRUE(a == t);
+}
+
+TEST(MatrixFile, SaveLoadAndMap) {
+    std::string path = testing::TempDir() + "hw4_matrix_file_test.mat";
+    Matrix a = test_system<double>(37, false);
+    a.save(path);
+    EXPECT_TRUE(Matrix::load(path) == a);
+    EXPECT_EQ(matrix_file::read_header(path).rows, 37u);
+
+    {
+        MappedMatrix<double> m(path);
+        EXPECT_EQ(m.rows(), 37u);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(m.data()) % matrix_file::ALIGNMENT, 0u);
+        EXPECT_TRUE(m == a);
+        EXPECT_TRUE(m * a == a * a);
+        EXPECT_TRUE(Matrix(m + a * 2.0) == a * 3.0);
+        MappedMatrix<double> moved(std::move(m));
+        EXPECT_TRUE(m.isEmpty());
+        EXPECT_DOUBLE_EQ(moved.block(1, 2, 3, 3)(0, 0), a(1, 2));
+    }
+    EXPECT_THROW(TypedMatrix<float>::load(path), std::runtime_error);
+    EXPECT_THROW(MappedMatrix<int64_t>{path}, std::runtime_error);
+
+    TypedMatrix<int32_t> i{{1, -2}, {3, 4}};
+    i.save(path);
+    EXPECT_TRUE(TypedMatrix<int32_t>::load(path) == i);
+
+    // A file written on a machine of the other byte order still loads.
+    {
+        std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+        std::vector<char> bytes((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        auto flip = [&](size_t offset, size_t size) { std::reverse(&bytes[offset], &bytes[offset + size]); };
+        for (size_t off = 8; off < 24; off += 4) flip(off, 4);
+        for (size_t off = 24; off < 48; off += 8) flip(off, 8);
+        for (size_t off = 64; off < bytes.size(); off += 4) flip(off, 4);
+        f.seekp(0);
+        f.write(bytes.data(), bytes.size());
+    }
+    EXPECT_TRUE(TypedMatrix<int32_t>::load(path) == i);
+    EXPECT_THROW(MappedMatrix<int32_t>{path}, std::runtime_error);
+
+    std::ofstream(path, std::ios::trunc) << "1 2\n3 4\n";
+    EXPECT_THROW(Matrix::load(path), std::runtime_error);
+    EXPECT_THROW(MappedMatrix<double>{path}, std::runtime_error);
+    std::remove(path.c_str());
+    EXPECT_THROW(Matrix::load(path), std::runtime_error);
+}
+
+TEST(Strassen, MatchesClassicProduct) {
+    // Small crossovers exercise several levels and padding on small inputs.
+    Matrix a = test_system<double>(100, false);
+    Matrix b = test_system<double>(100, true);
+    Matrix classic = a * b;
+    EXPECT_LT(Matrix(strassen::multiply(a, b, 8) - classic).norm(), 1e-9 * classic.norm());
+
+    Matrix tall(75, 40), wide(40, 61);
+    for (size_t i = 0; i < 75; i++)
+        for (size_t j = 0; j < 40; j++) tall(i, j) = std::sin(0.1 * i + j);
+    for (size_t i = 0; i < 40; i++)
+        for (size_t j = 0; j < 61; j++) wide(i, j) = std::cos(0.3 * i - j);
+    EXPECT_TRUE(strassen::multiply(tall, wide, 7) == tall * wide);
+
+    // (tall wide)^T = wide^T tall^T, with every operand strided.
+    Matrix view_out(75, 61);
+    strassen::multiply<double>(wide.transpose_view(), tall.transpose_view(), view_out.transpose_view(), 5);
+    EXPECT_TRUE(view_out == tall * wide);
+
+    TypedMatrix<int64_t> ia(64, 64), ib(64, 64);
+    for (size_t i = 0; i < 64; i++)
+        for (size_t j = 0; j < 64; j++) {
+            ia(i, j) = int64_t(i * 7 + j) % 19 - 9;
+            ib(i, j) = int64_t(i + j * 5) % 23 - 11;
+        }
+    EXPECT_TRUE(strassen::multiply(ia, ib, 4) == ia * ib);
+
+    EXPECT_THROW(strassen::multiply(tall, tall, 8), std::invalid_argument);
+    EXPECT_GT(strassen::workspace_size<double>(100, 100, 100, 8), 0u);
+    EXPECT_EQ(strassen::workspace_size<double>(100, 100, 100, 100), 0u);
+}
+
+TEST(Strassen, PolicySelectsAlgorithm) {
+    Matrix a = test_system<double>(70, false);
+    Matrix classic = a * a;
+    EXPECT_FALSE(strassen::config().enabled);
+    {
+        strassen::ScopedConfig fast({true, 64, 16});
+        EXPECT_TRUE(strassen::config().enabled);
+        Matrix c = a * a;
+        EXPECT_LT(Matrix(c - classic).norm(), 1e-9 * classic.norm());
+        EXPECT_TRUE(a.block(0, 0, 70, 63) * a.block(0, 0, 63, 70) == Matrix(a.block(0, 0, 70, 63)) * Matrix(a.block(0, 0, 63, 70)));
+    }
+    EXPECT_FALSE(strassen::config().enabled);
+
+    strassen::set_config({true, 100, 25});
+    strassen::Config global = strassen::config();
+    EXPECT_TRUE(global.enabled);
+    EXPECT_EQ(global.threshold, 100u);
+    EXPECT_EQ(global.crossover, 25u);
+    strassen::set_config(strassen::Config());
+    EXPECT_FALSE(strassen::config().enabled);
+
+    strassen::Workspace<double> ws(100);
+    size_t mark = ws.mark();
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(ws.take(3)) % 64, 0u);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(ws.take(3)) % 64, 0u);
+    EXPECT_THROW(ws.take(100), std::length_error);
+    ws.release(mark);
+    EXPECT_NO_THROW(ws.take(96));
+}
+
+// Fills matrix n of a batch with a well-conditioned pattern that differs per n.
+template <typename T>
+void fill_batch(TypedMatrixBatch<T>& b) {
+    for (size_t n = 0; n < b.count(); n++)
+        for (size_t i = 0; i < b.rows(); i++)
+            for (size_t j = 0; j < b.cols(); j++)
+                b(n, i, j) = T((n * 7 + i * 3 + j * 5) % 11) - T(5) + (i == j ? T(12) : T(0));
+}
+
+TEST(MatrixBatch, MatchesPerMatrixResults) {
+    MatrixBatch a(1000, 3, 4), b(1000, 4, 2);
+    fill_batch(a);
+    fill_batch(b);
+    MatrixBatch c = a * b;
+    MatrixBatch t = a.transpose();
+    MatrixBatch sum = a + a;
+    std::vector<double> norms = a.norm();
+    ASSERT_EQ(c.rows(), 3u);
+    ASSERT_EQ(c.cols(), 2u);
+    for (size_t n : {size_t(0), size_t(1), size_t(517), size_t(999)}) {
+        EXPECT_TRUE(c.get(n) == a.get(n) * b.get(n));
+        EXPECT_TRUE(t.get(n) == a.get(n).transpose());
+        EXPECT_TRUE(sum.get(n) == a.get(n) * 2.0);
+        EXPECT_DOUBLE_EQ(norms[n], a.get(n).norm());
+    }
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(a.plane(1, 2)) % 64, 0u);
+    EXPECT_THROW(b * a, std::invalid_argument);
+    EXPECT_THROW(a + b, std::invalid_argument);
+    EXPECT_THROW(a.at(1000, 0, 0), std::out_of_range);
+
+    TypedMatrixBatch<int32_t> ia(37, 2, 2);
+    fill_batch(ia);
+    TypedMatrixBatch<int32_t> ic = ia * ia - ia;
+    EXPECT_TRUE(ic.get(36) == ia.get(36) * ia.get(36) - ia.get(36));
+}
+
+TEST(MatrixBatch, Inverse) {
+    for (size_t size = 1; size <= 6; size++) {
+        MatrixBatch a(203, size, size);
+        fill_batch(a);
+        MatrixBatch inv = inverse(a);
+        MatrixBatch id = a * inv;
+        for (size_t n = 0; n < a.count(); n += 29) {
+            EXPECT_TRUE(id.get(n) == Matrix::identity(size)) << size << "x" << size << " #" << n;
+        }
+    }
+
+    TypedMatrixBatch<float> f(20, 4, 4);
+    fill_batch(f);
+    f.set(7, StaticMatrix<4, 4, float>{{1, 2, 0, 0}, {0, 1, 0, 3}, {4, 0, 1, 0}, {0, 0, 2, 1}});
+    EXPECT_FLOAT_EQ((f.get_static<4, 4>(7)(3, 2)), 2.0f);
+    TypedMatrixBatch<float> before = f;
+    inverse_into(f, f);
+    inverse_into(f, f);
+    for (size_t n = 0; n < f.count(); n++) {
+        for (size_t i = 0; i < 4; i++)
+            for (size_t j = 0; j < 4; j++) EXPECT_NEAR(f(n, i, j), before(n, i, j), 1e-4f);
+    }
+
+    MatrixBatch s(3, 3, 3);
+    fill_batch(s);
+    s.set(1, Matrix3({{1, 2, 3}, {2, 4, 6}, {0, 1, 1}}));
+    EXPECT_THROW(inverse(s), std::runtime_error);
+    EXPECT_THROW(inverse(MatrixBatch(2, 2, 3)), std::invalid_argument);
+}
+
+template <typename T>
+void check_reductions(size_t rows, size_t cols) {
+    TypedMatrix<T> a(rows, cols), b(rows, cols);
+    for (size_t i = 0; i < rows; i++)
+        for (size_t j = 0; j < cols; j++) {
+            a(i, j) = T((i * 31 + j * 17) % 23) - T(11);
+            b(i, j) = T((i * 7 + j * 13) % 5);
+        }
+    a(rows / 2, cols - 1) = T(40);
+    a(rows - 1, 0) = T(40);
+    a(rows / 3, cols / 2) = T(-50);
+
+    T s = 0, d = 0;
+    double ssq = 0;
+    TypedMatrix<T> rs(rows, 1, T(0)), cs(1, cols, T(0)), rmax(rows, 1, T(-100)), cmin(1, cols, T(100));
+    for (size_t i = 0; i < rows; i++)
+        for (size_t j = 0; j < cols; j++) {
+            s += a(i, j);
+            d += a(i, j) * b(i, j);
+            ssq += double(a(i, j)) * double(a(i, j));
+            rs(i, 0) += a(i, j);
+            cs(0, j) += a(i, j);
+            rmax(i, 0) = std::max(rmax(i, 0), a(i, j));
+            cmin(0, j) = std::min(cmin(0, j), a(i, j));
+        }
+    for (reduce::Summation mode : {reduce::Summation::Blocked, reduce::Summation::Pairwise, reduce::Summation::Kahan}) {
+        EXPECT_EQ(reduce::sum(a, mode), s);
+        EXPECT_EQ(reduce::dot(a, b, mode), d);
+    }
+    EXPECT_NEAR(double(a.norm()), std::sqrt(ssq), 1e-5 * std::sqrt(ssq));
+    EXPECT_EQ(reduce::min(a), T(-50));
+    EXPECT_EQ(reduce::max(a), T(40));
+    EXPECT_EQ(reduce::argmin(a), reduce::Position(rows / 3, cols / 2));
+    EXPECT_EQ(reduce::argmax(a), reduce::Position(rows / 2, cols - 1));
+    EXPECT_TRUE(reduce::row_sums(a) == rs);
+    EXPECT_TRUE(reduce::col_sums(a) == cs);
+    EXPECT_TRUE(reduce::row_max(a) == rmax);
+    EXPECT_TRUE(reduce::col_min(a) == cmin);
+
+    // Transposed and strided views give the transposed answers.
+    ConstMatrixView<T> t = a.transpose_view();
+    EXPECT_EQ(reduce::sum(t), s);
+    EXPECT_EQ(reduce::dot(t, ConstMatrixView<T>(b).transpose_view()), d);
+    EXPECT_EQ(reduce::argmax(t), reduce::Position(0, rows - 1));
+    EXPECT_TRUE(reduce::col_sums(t) == TypedMatrix<T>(rs.transpose()));
+    EXPECT_TRUE(reduce::row_min(t) == TypedMatrix<T>(cmin.transpose()));
+    ConstMatrixView<T> blk = a.block(1, 1, rows - 2, cols - 2);
+    EXPECT_EQ(reduce::sum(blk), reduce::sum(TypedMatrix<T>(blk)));
+    EXPECT_TRUE(reduce::col_norms(blk) == reduce::col_norms(TypedMatrix<T>(blk)));
+}
+
+TEST(Reduce, MatchesScalarLoops) {
+    check_reductions<double>(300, 517);
+    check_reductions<double>(3, 100003);
+    check_reductions<float>(129, 65);
+    check_reductions<int32_t>(700, 101);
+    check_reductions<int64_t>(5, 7);
+
+    Matrix a(400, 300);
+    for (size_t i = 0; i < a.rows(); i++)
+        for (size_t j = 0; j < a.cols(); j++) a(i, j) = std::sin(double(i * a.cols() + j));
+    double serial;
+    {
+        parallel::ScopedNumThreads one(1);
+        serial = reduce::sum(a);
+    }
+    {
+        parallel::ScopedNumThreads four(4);
+        EXPECT_EQ(reduce::sum(a), serial);
+        EXPECT_EQ(reduce::argmax(a), reduce::argmax(a.transpose_view().transpose_view()));
+    }
+    EXPECT_DOUBLE_EQ(reduce::sum(a + a), 2 * serial);
+    EXPECT_DOUBLE_EQ(Matrix::identity(5).trace(), 5.0);
+    EXPECT_TRUE(reduce::row_norms(Matrix{{3, 4}, {0, 0}}) == Matrix({{5}, {0}}));
+    EXPECT_THROW(reduce::max(Matrix()), std::invalid_argument);
+    EXPECT_THROW(reduce::row_min(Matrix(3, 0)), std::invalid_argument);
+    EXPECT_THROW(reduce::dot(a, a.transpose_view()), std::invalid_argument);
+    EXPECT_DOUBLE_EQ(reduce::sum(Matrix()), 0.0);
+}
+
+TEST(Reduce, RobustNormAndSummation) {
+    Matrix big(10, 10, 1e200), tiny(10, 10, 1e-200);
+    EXPECT_NEAR(big.norm() / 1e201, 1.0, 1e-12);
+    EXPECT_NEAR(tiny.norm() / 1e-199, 1.0, 1e-12);
+    EXPECT_NEAR(reduce::col_norms(big)(0, 3) / (std::sqrt(10.0) * 1e200), 1.0, 1e-12);
+    EXPECT_DOUBLE_EQ(Matrix(2, 2, 0.0).norm(), 0.0);
+    TypedMatrix<float> fbig(3, 3, 1e30f);
+    EXPECT_NEAR(fbig.norm() / 3e30f, 1.0f, 1e-5f);
+
+    // 1 followed by many terms that vanish next to it one at a time.
+    Matrix v(1, 1 << 20, 1e-16);
+    v(0, 0) = 1.0;
+    double exact = 1.0 + (v.cols() - 1) * 1e-16;
+    EXPECT_NEAR(reduce::sum(v, reduce::Summation::Kahan), exact, 1e-15);
+    EXPECT_NEAR(reduce::sum(v, reduce::Summation::Pairwise), exact, 1e-14);
+
+    Matrix n{{1, 2}, {NAN, 4}};
+    EXPECT_TRUE(std::isnan(reduce::max(n)));
+    EXPECT_TRUE(std::isnan(reduce::min(n)));
+    EXPECT_EQ(reduce::argmax(n), reduce::Position(1, 0));
+    EXPECT_TRUE(std::isnan(n.norm()));
+}
+
+TEST(Reduce, Equality) {
+    Matrix a(300, 200), b;
+    for (size_t i = 0; i < a.rows(); i++)
+        for (size_t j = 0; j < a.cols(); j++) a(i, j) = double(i) - double(j);
+    b = a;
+    EXPECT_TRUE(a == b);
+    b(299, 199) += 1e-12;
+    EXPECT_TRUE(a == b);
+    b(150, 7) += 1e-3;
+    EXPECT_FALSE(a == b);
+    EXPECT_TRUE(a.transpose_view() == a.transpose());
+    EXPECT_TRUE(a.block(0, 0, 2, 2) == a.block(1, 1, 2, 2));
+    EXPECT_FALSE(a.block(0, 0, 2, 2) == a.block(0, 1, 2, 2));
+    EXPECT_FALSE(a == Matrix(300, 201));
+    // As in the original Matrix ==, elements whose difference is NaN match.
+    Matrix n{{NAN}};
+    EXPECT_TRUE(n == n);
+    Matrix inf{{INFINITY, 1}, {2, -INFINITY}};
+    EXPECT_TRUE(inf == Matrix(inf));
+    EXPECT_TRUE(inf.transpose_view() == inf.transpose());
+    EXPECT_FALSE(inf == Matrix({{1, 1}, {2, -INFINITY}}));
+    EXPECT_THROW(inf / 0.0, std::invalid_argument);
+    EXPECT_NO_THROW(inf / double(NAN));
+    TypedMatrix<int32_t> i{{1, 2}, {3, 4}};
+    EXPECT_TRUE(i == TypedMatrix<int32_t>({{1, 2}, {3, 4}}));
+    EXPECT_TRUE(i != TypedMatrix<int32_t>({{1, 2}, {3, 5}}));
+}
+
 TEST(Matrix, TransposeTraceDiagonalNormFillFactories) {
     Matrix a{{1,2},{3,4}};
     Matrix t = a.transpose();
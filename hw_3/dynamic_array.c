@@ -1,4 +1,6 @@
 #include "dynamic_array.h"
+#include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -44,40 +46,123 @@ static void extend_buffer ( DynamicArray * da ) {
     return;
 }
 
-/* registry for "num_arrays" and "destroy_all" ********************************/
-
-static DynamicArray ** __all_arrays = NULL;
-static int __all_arrays_count = 0;
-static int __all_arrays_capacity = 0;
+/* slab allocator and registry for "num_arrays" and "destroy_all" ***********/
+
+/* Array structs live in slots carved out of slabs of DYNAMIC_ARRAY_SLAB_SIZE.
+   A destroyed array's slot goes on a free list and is handed to the next
+   DynamicArray_new, so the number of slots is bounded by the largest number
+   of arrays alive at once rather than by how many were ever created. The
+   struct is the first member of its slot, so a handle is also a pointer to
+   its slot, and it stays readable (with a NULL buffer) until it is reused.
+
+   Every live slot is on the doubly linked list of the scope it was created
+   in, scope 0 being the global one, so destroying an array and ending a
+   scope take time proportional to the arrays they destroy. A slot keeps the
+   buffer of an array destroyed at its initial capacity, so creating and
+   destroying small arrays does not touch the heap in steady state. */
+
+typedef struct __Slot {
+    DynamicArray array;
+    struct __Slot * prev,   /* neighbours in its scope's list when live, */
+                  * next;   /* the next free slot when free */
+    int scope;
+    double * spare;         /* a zeroed buffer of the initial capacity */
+} __Slot;
+
+typedef struct __Slab {
+    struct __Slab * next;
+    __Slot slots[DYNAMIC_ARRAY_SLAB_SIZE];
+} __Slab;
+
+static __Slab * __slabs = NULL;
+static __Slot * __free_slots = NULL;
+static __Slot ** __scopes = NULL;   /* head of each open scope's list */
+static int __scope_depth = 0;
+static int __scopes_capacity = 0;
+static int __arrays_constructed = 0;
+
+static void __grow_scopes(void) {
+    int new_cap = (__scopes_capacity == 0) ? 4 : (__scopes_capacity * 2);
+    __Slot ** tmp = (__Slot **) realloc(__scopes, sizeof(__Slot *) * new_cap);
+    assert(tmp != NULL);
+    for ( int i = __scopes_capacity; i < new_cap; i++ ) {
+        tmp[i] = NULL;
+    }
+    __scopes = tmp;
+    __scopes_capacity = new_cap;
+}
+
+static __Slot * __take_slot(void) {
+    if ( __free_slots == NULL ) {
+        __Slab * slab = (__Slab *) calloc(1, sizeof(__Slab));
+        assert(slab != NULL);
+        slab->next = __slabs;
+        __slabs = slab;
+        for ( int i = DYNAMIC_ARRAY_SLAB_SIZE - 1; i >= 0; i-- ) {
+            slab->slots[i].next = __free_slots;
+            __free_slots = &slab->slots[i];
+        }
+    }
+    if ( __scopes_capacity == 0 ) {
+        __grow_scopes();
+    }
+    __Slot * slot = __free_slots;
+    __free_slots = slot->next;
+    slot->scope = __scope_depth;
+    slot->prev = NULL;
+    slot->next = __scopes[__scope_depth];
+    if ( slot->next != NULL ) {
+        slot->next->prev = slot;
+    }
+    __scopes[__scope_depth] = slot;
+    return slot;
+}
 
-static void __register_array(DynamicArray *da) {
-    if (__all_arrays_count >= __all_arrays_capacity) {
-        int new_cap = (__all_arrays_capacity == 0) ? 16 : (__all_arrays_capacity * 2);
-        DynamicArray **tmp = (DynamicArray **)realloc(__all_arrays, sizeof(DynamicArray*) * new_cap);
-        assert(tmp != NULL);
-        __all_arrays = tmp;
-        __all_arrays_capacity = new_cap;
+static void __release_slot(__Slot * slot) {
+    if ( slot->prev != NULL ) {
+        slot->prev->next = slot->next;
+    } else {
+        __scopes[slot->scope] = slot->next;
+    }
+    if ( slot->next != NULL ) {
+        slot->next->prev = slot->prev;
     }
-    __all_arrays[__all_arrays_count++] = da;
+    slot->next = __free_slots;
+    __free_slots = slot;
 }
 
 /* public functions **********************************************************/
 
 DynamicArray * DynamicArray_new(void) {
-    DynamicArray * da = (DynamicArray *) malloc(sizeof(DynamicArray));
-    assert(da != NULL);
+    __Slot * slot = __take_slot();
+    DynamicArray * da = &slot->array;
     da->capacity = DYNAMIC_ARRAY_INITIAL_CAPACITY;
-    da->buffer = (double *) calloc ( da->capacity, sizeof(double) );
-    assert(da->buffer != NULL);
+    if ( slot->spare != NULL ) {
+        da->buffer = slot->spare;
+        slot->spare = NULL;
+    } else {
+        da->buffer = (double *) calloc ( da->capacity, sizeof(double) );
+        assert(da->buffer != NULL);
+    }
     da->origin = da->capacity / 2;
     da->end = da->origin;
-    __register_array(da);
+    __arrays_constructed++;
     return da;
 }
 
 void DynamicArray_destroy(DynamicArray * da) {
-    free(da->buffer);
+    if ( da->buffer == NULL ) {
+        return;
+    }
+    __Slot * slot = (__Slot *) da;
+    if ( da->capacity == DYNAMIC_ARRAY_INITIAL_CAPACITY && slot->spare == NULL ) {
+        memset(da->buffer, 0, sizeof(double) * da->capacity);
+        slot->spare = da->buffer;
+    } else {
+        free(da->buffer);
+    }
     da->buffer = NULL;
+    __release_slot(slot);
     return;
 }
 
@@ -86,29 +171,124 @@ int DynamicArray_size(const DynamicArray * da) {
     return da->end - da->origin;
 }
 
-char * DynamicArray_to_string(const DynamicArray * da) {
+/* Longest element text: "%.5lf" of -DBL_MAX has 309 integer digits. */
+#define __MAX_ELEMENT_TEXT 320
+#define __WRITE_CHUNK 4096
+
+static const char __DIGIT_PAIRS[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/* Writes x the way snprintf "%.5lf" does, or "0" for zero, to out and
+   returns the length. Values below 1e9 in magnitude are scaled to an
+   integer number of 1e-5 units and printed two digits at a time. The scaled
+   product is within 1/64 of the exact one, so it rounds the same way unless
+   it lies that close to a half unit, which is left to snprintf. */
+static int __format_double(char * out, double x) {
+    if ( x == 0 ) {
+        out[0] = '0';
+        return 1;
+    }
+    double t = fabs(x) * 100000.0;
+    double whole = floor(t);
+    if ( !(fabs(x) < 1e9) || fabs(t - whole - 0.5) < 1.0 / 32 ) {
+        return snprintf(out, __MAX_ELEMENT_TEXT, "%.5lf", x);
+    }
+    int64_t q = (int64_t) whole + (t - whole > 0.5);
+    uint32_t integer = (uint32_t) (q / 100000),
+             fraction = (uint32_t) (q % 100000);
+    int len = 0;
+    if ( x < 0 ) {
+        out[len++] = '-';
+    }
+    for ( uint64_t power = 10; integer >= power; power *= 10 ) {
+        len++;
+    }
+    char * p = out + ++len;
+    while ( integer >= 100 ) {
+        p -= 2;
+        memcpy(p, __DIGIT_PAIRS + 2 * (integer % 100), 2);
+        integer /= 100;
+    }
+    if ( integer >= 10 ) {
+        memcpy(p - 2, __DIGIT_PAIRS + 2 * integer, 2);
+    } else {
+        p[-1] = (char) ('0' + integer);
+    }
+    out[len++] = '.';
+    out[len] = (char) ('0' + fraction / 10000);
+    memcpy(out + len + 1, __DIGIT_PAIRS + 2 * (fraction % 10000 / 100), 2);
+    memcpy(out + len + 3, __DIGIT_PAIRS + 2 * (fraction % 100), 2);
+    return len + 5;
+}
+
+int DynamicArray_write_with(const DynamicArray * da,
+                            int (*write)(const char *, size_t, void *), void * context) {
     assert(da->buffer != NULL);
-    char * str = (char *) calloc (20,DynamicArray_size(da)),
-         temp[20];
-    int j = 1;
-    str[0] = '[';
-    for ( int i=0; i < DynamicArray_size(da); i++ ) {
-        if ( DynamicArray_get(da,i) == 0 ) {
-            snprintf ( temp, 20, "0" );
-        } else {
-            snprintf ( temp, 20, "%.5lf", DynamicArray_get(da,i) );
+    char chunk[__WRITE_CHUNK];
+    const double * x = da->buffer + da->origin;
+    int n = DynamicArray_size(da),
+        len = 0,
+        status;
+    chunk[len++] = '[';
+    for ( int i = 0; i < n; i++ ) {
+        if ( len > __WRITE_CHUNK - __MAX_ELEMENT_TEXT - 2 ) {
+            if ( (status = write(chunk, len, context)) != 0 ) {
+                return status;
+            }
+            len = 0;
         }
-        if ( i < DynamicArray_size(da) - 1 ) {
-            sprintf( str + j, "%s,", temp);
-            j += (int)strlen(temp) + 1;
-        } else {
-            sprintf( str + j, "%s", temp);
-            j += (int)strlen(temp);
+        len += __format_double(chunk + len, x[i]);
+        if ( i < n - 1 ) {
+            chunk[len++] = ',';
         }
+    }
+    chunk[len++] = ']';
+    return write(chunk, len, context);
+}
+
+static int __write_file(const char * text, size_t length, void * f) {
+    return fwrite(text, 1, length, (FILE *) f) == length ? 0 : -1;
+}
 
+int DynamicArray_write(FILE * f, const DynamicArray * da) {
+    return DynamicArray_write_with(da, __write_file, f);
+}
+
+/* A string that doubles its capacity as text is appended. */
+typedef struct {
+    char * text;
+    size_t length,
+           capacity;
+} __StringBuilder;
+
+static int __append_string(const char * text, size_t length, void * sb) {
+    __StringBuilder * b = (__StringBuilder *) sb;
+    if ( b->length + length + 1 > b->capacity ) {
+        while ( b->length + length + 1 > b->capacity ) {
+            b->capacity *= 2;
+        }
+        b->text = (char *) realloc(b->text, b->capacity);
+        assert(b->text != NULL);
     }
-    str[j] = ']';
-    return str;
+    memcpy(b->text + b->length, text, length);
+    b->length += length;
+    return 0;
+}
+
+char * DynamicArray_to_string(const DynamicArray * da) {
+    assert(da->buffer != NULL);
+    __StringBuilder b;
+    b.length = 0;
+    b.capacity = 12 * (size_t) DynamicArray_size(da) + 3;
+    b.text = (char *) malloc(b.capacity);
+    assert(b.text != NULL);
+    DynamicArray_write_with(da, __append_string, &b);
+    b.text[b.length] = '\0';
+    return b.text;
 }
 
 void DynamicArray_print_debug_info(const DynamicArray * da) {
@@ -339,14 +519,83 @@ int DynamicArray_is_valid(const DynamicArray * da) {
 }
 
 int DynamicArray_num_arrays() {
-    return __all_arrays_count;
+    return __arrays_constructed;
 }
 
 void DynamicArray_destroy_all() {
-    for (int i = 0; i < __all_arrays_count; i++) {
-        DynamicArray *da = __all_arrays[i];
-        if (da != NULL && da->buffer != NULL) {
+    for ( int d = 0; d < __scopes_capacity; d++ ) {
+        while ( __scopes[d] != NULL ) {
+            DynamicArray_destroy(&__scopes[d]->array);
+        }
+    }
+    while ( __slabs != NULL ) {
+        __Slab * slab = __slabs;
+        __slabs = slab->next;
+        for ( int i = 0; i < DYNAMIC_ARRAY_SLAB_SIZE; i++ ) {
+            free(slab->slots[i].spare);
+        }
+        free(slab);
+    }
+    free(__scopes);
+    __free_slots = NULL;
+    __scopes = NULL;
+    __scope_depth = 0;
+    __scopes_capacity = 0;
+}
+
+void DynamicArray_begin_scope(void) {
+    if ( __scope_depth + 1 >= __scopes_capacity ) {
+        __grow_scopes();
+    }
+    __scope_depth++;
+}
+
+void DynamicArray_end_scope(void) {
+    assert(__scope_depth > 0);
+    while ( __scopes[__scope_depth] != NULL ) {
+        DynamicArray_destroy(&__scopes[__scope_depth]->array);
+    }
+    __scope_depth--;
+}
+
+/* Serialization *************************************************************/
+
+static const char __DUMP_MAGIC[4] = { 'D', 'A', 'R', '1' };
+
+int DynamicArray_dump(FILE * f, const DynamicArray * da) {
+    assert(da->buffer != NULL);
+    int32_t n = DynamicArray_size(da);
+    if ( fwrite(__DUMP_MAGIC, 1, 4, f) != 4 || fwrite(&n, sizeof(n), 1, f) != 1 ) {
+        return -1;
+    }
+    return fwrite(da->buffer + da->origin, sizeof(double), n, f) == (size_t) n ? 0 : -1;
+}
+
+DynamicArray * DynamicArray_load(FILE * f) {
+    char magic[4];
+    int32_t n;
+    if ( fread(magic, 1, 4, f) != 4 || memcmp(magic, __DUMP_MAGIC, 4) != 0
+         || fread(&n, sizeof(n), 1, f) != 1 || n < 0 || n > INT32_MAX / 2 ) {
+        return NULL;
+    }
+    DynamicArray * da = DynamicArray_new();
+    if ( n > da->capacity ) {
+        double * buffer = (double *) calloc ( 2 * (size_t) n, sizeof(double) );
+        if ( buffer == NULL ) {
             DynamicArray_destroy(da);
+            return NULL;
         }
+        free(da->buffer);
+        da->buffer = buffer;
+        da->capacity = 2 * n;
+        da->origin = n / 2;
+    } else {
+        da->origin = (da->capacity - n) / 2;
+    }
+    if ( fread(da->buffer + da->origin, sizeof(double), n, f) != (size_t) n ) {
+        DynamicArray_destroy(da);
+        return NULL;
     }
+    da->end = da->origin + n;
+    return da;
 }
@@ -1,7 +1,11 @@
 #ifndef _DYNAMIC_ARRAY
 #define _DYNAMIC_ARRAY
 
+#include <stddef.h>
+#include <stdio.h>
+
 #define DYNAMIC_ARRAY_INITIAL_CAPACITY 10
+#define DYNAMIC_ARRAY_SLAB_SIZE 64
 
 typedef struct {
     int capacity,
@@ -26,6 +30,31 @@ int DynamicArray_size(const DynamicArray *);
 char * DynamicArray_to_string(const DynamicArray *);
 void DynamicArray_print_debug_info(const DynamicArray *);
 
+/*! Writes the array to f in the format of DynamicArray_to_string, without
+ *  building the whole string. Returns 0 on success and -1 if a write failed.
+ */
+int DynamicArray_write(FILE * f, const DynamicArray * da);
+
+/*! Formats the array like DynamicArray_to_string and passes the text to
+ *  write(chunk, length, context) in consecutive pieces of at most a few
+ *  kilobytes. Stops as soon as write returns nonzero and returns that value,
+ *  otherwise returns 0.
+ */
+int DynamicArray_write_with(const DynamicArray * da,
+                            int (*write)(const char *, size_t, void *), void * context);
+
+/* Serialization *************************************************************/
+
+/*! Writes the size and the exact bits of the elements to f in the byte order
+ *  of this machine. Returns 0 on success and -1 if a write failed.
+ */
+int DynamicArray_dump(FILE * f, const DynamicArray * da);
+
+/*! Reads an array written by DynamicArray_dump. Returns a new array, or NULL
+ *  if f does not hold a complete dump.
+ */
+DynamicArray * DynamicArray_load(FILE * f);
+
 /* Operations ****************************************************************/
 
 void DynamicArray_push(DynamicArray *, double);
@@ -82,10 +111,22 @@ int DynamicArray_is_valid(const DynamicArray * da);
  */
 int DynamicArray_num_arrays();
 
-/*! Destroys all arrays that have been constructed so far.
+/*! Destroys all arrays that have been constructed so far, closes any open
+ *  scopes and frees all memory held for arrays. Every handle, including
+ *  those of arrays destroyed earlier, becomes invalid.
  */
 void DynamicArray_destroy_all();
 
+/*! Opens a scope. Arrays created until the matching DynamicArray_end_scope
+ *  belong to it and may still be destroyed one by one. Scopes nest.
+ */
+void DynamicArray_begin_scope(void);
+
+/*! Destroys the arrays of the innermost open scope that are still alive,
+ *  and closes it.
+ */
+void DynamicArray_end_scope(void);
+
 DynamicArray * DynamicArray_subarray(DynamicArray *, int, int);
 
 #endif
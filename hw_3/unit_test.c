@@ -126,4 +126,100 @@ namespace {
         DynamicArray_destroy(y);                    
     }         
 
+    TEST(DynamicArray, FormattingAndSerialization) {
+        DynamicArray * da = DynamicArray_new();
+        char * str = DynamicArray_to_string(da);
+        ASSERT_STREQ(str, "[]");
+        free(str);
+
+        /* Every element must print exactly as "%.5lf" does, including
+           values near rounding ties and too wide for the fast path. */
+        double special[] = { 0.000005, -0.000005, 0.000015, 2.5e-6, 1.234565, 999999999.999995,
+                             1e9, -1e300, 1e-300, -0.0, 123456.7, 0.1 + 0.2 };
+        char expected[400];
+        for ( int i = 0; i < 20000; i++ ) {
+            double x = i < 12 ? special[i]
+                              : (rand() - RAND_MAX / 2) * pow(10.0, rand() % 16 - 8) / RAND_MAX;
+            DynamicArray_set(da, 0, x);
+            if ( x == 0 ) {
+                snprintf(expected, sizeof(expected), "[0]");
+            } else {
+                snprintf(expected, sizeof(expected), "[%.5lf]", x);
+            }
+            str = DynamicArray_to_string(da);
+            ASSERT_STREQ(str, expected);
+            free(str);
+        }
+
+        DynamicArray * r = DynamicArray_range(-2000, 2000, 0.37);
+        FILE * f = tmpfile();
+        ASSERT_EQ(DynamicArray_write(f, r), 0);
+        long length = ftell(f);
+        rewind(f);
+        str = DynamicArray_to_string(r);
+        ASSERT_EQ(length, (long) strlen(str));
+        char * written = (char *) calloc(length + 1, 1);
+        ASSERT_EQ(fread(written, 1, length, f), (size_t) length);
+        ASSERT_STREQ(written, str);
+        free(written);
+        free(str);
+
+        rewind(f);
+        ASSERT_EQ(DynamicArray_dump(f, r), 0);
+        rewind(f);
+        DynamicArray * loaded = DynamicArray_load(f);
+        ASSERT_NE(loaded, (DynamicArray *) NULL);
+        ASSERT_EQ(DynamicArray_size(loaded), DynamicArray_size(r));
+        for ( int i = 0; i < DynamicArray_size(r); i++ ) {
+            ASSERT_EQ(DynamicArray_get(loaded, i), DynamicArray_get(r, i));
+        }
+        DynamicArray_push_front(loaded, X);
+        ASSERT_EQ(DynamicArray_get(loaded, 0), X);
+        ASSERT_EQ(DynamicArray_load(f), (DynamicArray *) NULL);
+        fclose(f);
+
+        DynamicArray_destroy(da);
+        DynamicArray_destroy(r);
+        DynamicArray_destroy(loaded);
+    }
+
+    TEST(DynamicArray, RecycledHandlesAndScopes) {
+        DynamicArray * a = DynamicArray_new();
+        DynamicArray_set(a, 3, X);
+        DynamicArray_destroy(a);
+        DynamicArray_destroy(a);
+        ASSERT_EQ(DynamicArray_is_valid(a), 0);
+        int constructed = DynamicArray_num_arrays();
+        DynamicArray * b = DynamicArray_new();
+        ASSERT_EQ(b, a);
+        ASSERT_EQ(DynamicArray_num_arrays(), constructed + 1);
+        ASSERT_EQ(DynamicArray_size(b), 0);
+        ASSERT_EQ(DynamicArray_get(b, 3), 0.0);
+        DynamicArray_set(b, 3, X);
+        ASSERT_EQ(DynamicArray_get(b, 2), 0.0);
+
+        DynamicArray_begin_scope();
+        DynamicArray * x = DynamicArray_new(),
+                     * y = DynamicArray_new();
+        DynamicArray_destroy(y);
+        DynamicArray_begin_scope();
+        DynamicArray * z = DynamicArray_range(0, 100, 1);
+        DynamicArray_end_scope();
+        ASSERT_EQ(DynamicArray_is_valid(z), 0);
+        ASSERT_EQ(DynamicArray_is_valid(x), 1);
+        DynamicArray_end_scope();
+        ASSERT_EQ(DynamicArray_is_valid(x), 0);
+        ASSERT_EQ(DynamicArray_get(b, 3), X);
+        ASSERT_DEATH(DynamicArray_end_scope(), ".*Assertion.*");
+
+        for ( int i = 0; i < 1000; i++ ) {
+            DynamicArray_destroy(DynamicArray_new());
+        }
+        ASSERT_EQ(DynamicArray_new(), x);
+        DynamicArray_destroy_all();
+        DynamicArray * c = DynamicArray_new();
+        ASSERT_EQ(DynamicArray_size(c), 0);
+        DynamicArray_destroy(c);
+    }
+
 }